@@ -0,0 +1,261 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BatchConvert.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QTextStream>
+
+#include "ModelIO.h"
+#include "WZM.h"
+
+namespace
+{
+
+const char* outputExtension(wmit_filetype_t type)
+{
+	switch (type)
+	{
+	case WMIT_FT_OBJ:
+		return "obj";
+	case WMIT_FT_WZM:
+		return "wzm";
+	default:
+		return "pie";
+	}
+}
+
+// Returns nullptr on success, otherwise the reason of the failure
+const char* convertModel(const BatchJob& job, ModelCacheMode cacheMode, unsigned threads)
+{
+	ModelInfo info;
+	WZM model;
+
+	info.m_saveAsFile = job.output;
+	if (!guessModelTypeFromFilename(info.m_saveAsFile, info.m_save_type))
+	{
+		return "unsupported output format";
+	}
+
+	if (!loadModel(job.input, model, info, true, cacheMode, threads))
+	{
+		return "could not load model";
+	}
+
+	info.defaultPieCapsIfNeeded();
+
+	if (!saveModel(model, info))
+	{
+		return "could not save model";
+	}
+
+	return nullptr;
+}
+
+/*
+ * Two workers writing the same file would make the result depend on
+ * scheduling. Outputs only differing in case are rejected as well, they are
+ * the same file on case insensitive file systems.
+ */
+bool outputsAreUnique(const std::vector<BatchJob>& jobs)
+{
+	QHash<QString, QString> inputOfOutput;
+	bool unique = true;
+
+	for (const BatchJob& job : jobs)
+	{
+		const QString outKey = QDir::cleanPath(job.output).toLower();
+		const auto it = inputOfOutput.constFind(outKey);
+		if (it != inputOfOutput.constEnd())
+		{
+			std::cerr << "Input files \"" << qPrintable(QDir::toNativeSeparators(it.value()))
+				  << "\" and \"" << qPrintable(QDir::toNativeSeparators(job.input))
+				  << "\" would both be converted to \"" << qPrintable(QDir::toNativeSeparators(job.output))
+				  << "\"." << std::endl;
+			unique = false;
+			continue;
+		}
+		inputOfOutput.insert(outKey, job.input);
+	}
+
+	return unique;
+}
+
+} // namespace
+
+bool collectBatchJobs(const QString& indir, const QString& outdir, wmit_filetype_t outType,
+		      std::vector<BatchJob>& jobs)
+{
+	const QDir inDir(indir);
+	const QDir outDir(outdir);
+
+	if (!inDir.exists())
+	{
+		std::cerr << "Input directory \"" << qPrintable(indir) << "\" does not exist." << std::endl;
+		return false;
+	}
+
+	QStringList relPaths;
+	QDirIterator it(inDir.absolutePath(), QDir::Files, QDirIterator::Subdirectories);
+	while (it.hasNext())
+	{
+		const QString path = it.next();
+
+		// Name filters are case sensitive on some platforms, match "*.PIE" too
+		wmit_filetype_t type;
+		if (guessModelTypeFromFilename(path, type))
+		{
+			relPaths.append(inDir.relativeFilePath(path));
+		}
+	}
+
+	// Directory iteration order is filesystem dependent, keep runs reproducible
+	relPaths.sort();
+
+	for (const QString& relPath : relPaths)
+	{
+		const QFileInfo relInfo(relPath);
+		QString outRelPath = relInfo.completeBaseName() + '.' + outputExtension(outType);
+		if (relInfo.path() != ".")
+		{
+			outRelPath.prepend(relInfo.path() + '/');
+		}
+
+		jobs.push_back({inDir.absoluteFilePath(relPath), outDir.absoluteFilePath(outRelPath)});
+	}
+
+	// "foo.pie" and "foo.obj" both become "foo.<ext>"
+	return outputsAreUnique(jobs);
+}
+
+bool readBatchManifest(const QString& manifest, std::vector<BatchJob>& jobs)
+{
+	QFile file(manifest);
+
+	if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+	{
+		std::cerr << "Could not open manifest \"" << qPrintable(manifest) << "\"." << std::endl;
+		return false;
+	}
+
+	const QDir baseDir = QFileInfo(manifest).absoluteDir();
+	QTextStream in(&file);
+	int lineNo = 0;
+
+	while (!in.atEnd())
+	{
+		const QString line = in.readLine().trimmed();
+		++lineNo;
+
+		if (line.isEmpty() || line.startsWith('#'))
+			continue;
+
+		QStringList paths = line.split('\t');
+		paths.removeAll(QString());
+		if (paths.size() != 2)
+		{
+			std::cerr << qPrintable(manifest) << ":" << lineNo
+				  << ": expected \"input<TAB>output\"." << std::endl;
+			return false;
+		}
+
+		jobs.push_back({baseDir.absoluteFilePath(paths[0].trimmed()),
+				baseDir.absoluteFilePath(paths[1].trimmed())});
+	}
+
+	return outputsAreUnique(jobs);
+}
+
+size_t runBatchJobs(const std::vector<BatchJob>& jobs, unsigned threads, ModelCacheMode cacheMode)
+{
+	std::vector<const char*> results(jobs.size(), nullptr);
+	std::atomic<size_t> nextJob(0);
+
+	const unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	if (threads == 0)
+	{
+		threads = cores;
+	}
+	threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(jobs.size(), 1)));
+
+	// Importing a model is threaded too, each job gets its share of the cores
+	const unsigned modelThreads = std::max(1u, cores / threads);
+
+	// Create the output tree up front so workers never race on mkpath
+	for (const BatchJob& job : jobs)
+	{
+		QFileInfo(job.output).absoluteDir().mkpath(".");
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+
+	// Every job writes its own file, so the result does not depend on scheduling
+	auto worker = [&jobs, &results, &nextJob, cacheMode, modelThreads]()
+	{
+		for (size_t i = nextJob++; i < jobs.size(); i = nextJob++)
+		{
+			results[i] = convertModel(jobs[i], cacheMode, modelThreads);
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned i = 1; i < threads; ++i)
+	{
+		pool.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : pool)
+	{
+		thread.join();
+	}
+
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	size_t failed = 0;
+	for (size_t i = 0; i < jobs.size(); ++i)
+	{
+		if (results[i])
+		{
+			++failed;
+			std::cout << "[FAIL] " << qPrintable(QDir::toNativeSeparators(jobs[i].input))
+				  << ": " << results[i] << std::endl;
+		}
+		else
+		{
+			std::cout << "[ OK ] " << qPrintable(QDir::toNativeSeparators(jobs[i].input))
+				  << " -> " << qPrintable(QDir::toNativeSeparators(jobs[i].output)) << std::endl;
+		}
+	}
+
+	std::cout << std::endl << "Converted " << jobs.size() - failed << " of " << jobs.size()
+		  << " files, " << failed << " failed (" << threads << " threads, "
+		  << seconds << " s)." << std::endl;
+
+	return failed;
+}
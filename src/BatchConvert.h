@@ -0,0 +1,60 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef BATCHCONVERT_HPP
+#define BATCHCONVERT_HPP
+
+#include <vector>
+#include <QString>
+
+#include "ModelCache.h"
+#include "wmit.h"
+
+struct BatchJob
+{
+	QString input;
+	QString output;
+};
+
+/*!
+ * Collects every PIE, OBJ and WZM file below \a indir (recursively, sorted by
+ * relative path) into \a jobs. Outputs mirror the input tree under \a outdir
+ * with the extension replaced according to \a outType. Fails when two inputs
+ * would be converted to the same output.
+ */
+bool collectBatchJobs(const QString& indir, const QString& outdir, wmit_filetype_t outType,
+		      std::vector<BatchJob>& jobs);
+
+/*!
+ * Reads "input<TAB>output" pairs, one per line, from \a manifest. Empty lines
+ * and lines starting with '#' are skipped, relative paths are resolved against
+ * the manifest's directory. Fails when two lines share an output.
+ */
+bool readBatchManifest(const QString& manifest, std::vector<BatchJob>& jobs);
+
+/*!
+ * Converts all \a jobs using \a threads workers (0 = one per core) and prints
+ * a per-file summary in job order. The cores are split among the workers
+ * for importing, so the pools inside loadModel() do not pile up on them.
+ * Returns the number of failed conversions.
+ */
+size_t runBatchJobs(const std::vector<BatchJob>& jobs, unsigned threads,
+		    ModelCacheMode cacheMode = WMIT_CACHE_USE);
+
+#endif // BATCHCONVERT_HPP
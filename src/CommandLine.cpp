@@ -0,0 +1,232 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CommandLine.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <QString>
+
+#include "BatchConvert.h"
+#include "ModelIO.h"
+#include "WZM.h"
+#include "wmit.h"
+
+void printWelcomeBanner(const bool printLicense)
+{
+	std::cout << "Welcome to " WMIT_APPNAME " " WMIT_VER_STR << std::endl;
+
+	if (printLicense)
+	{
+		std::cout << std::endl <<
+		"Copyright (C) 2010-2021 Warzone 2100 Project" << std::endl <<
+		"This program comes with ABSOLUTELY NO WARRANTY;" << std::endl <<
+		"This is free software, and you are welcome to redistribute it" << std::endl <<
+		"under certain conditions; see About in graphical UI for details." << std::endl;
+	}
+
+	std::cout << std::endl;
+}
+
+void printCommandLineHelp(const bool withGui)
+{
+	printf("Usage:\n");
+	if (withGui)
+	{
+		printf("  <no parameters> (opens GUI application)\n");
+	}
+	printf("  --help (shows this message)\n");
+	if (withGui)
+	{
+		printf("  [filename] (opens a file in GUI)\n");
+	}
+	printf("  [input] [output] (converts between formats PIE and OBJ. Deprecated WZM format is supported as input.)\n");
+	printf("  --batch [indir] [outdir] --to pie|obj [--jobs N] (converts all models found in indir, in parallel)\n");
+	printf("  --batch-manifest [manifest] [--jobs N] (converts \"input<TAB>output\" pairs listed one per line)\n");
+	printf("Conversion options:\n");
+	printf("  --no-cache (always parse the inputs, do not read or write the model cache)\n");
+	printf("  --rebuild-cache (always parse the inputs and refresh their model cache entries)\n");
+}
+
+bool isBatchConversionArg(const char* arg)
+{
+	return strcmp("--batch", arg) == 0 || strcmp("--batch-manifest", arg) == 0;
+}
+
+ModelCacheMode takeCacheModeArgs(int& argc, char *argv[])
+{
+	ModelCacheMode mode = WMIT_CACHE_USE;
+	int kept = 1;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp("--no-cache", argv[i]) == 0)
+		{
+			mode = WMIT_CACHE_OFF;
+		}
+		else if (strcmp("--rebuild-cache", argv[i]) == 0)
+		{
+			mode = WMIT_CACHE_REBUILD;
+		}
+		else
+		{
+			argv[kept++] = argv[i];
+		}
+	}
+
+	argc = kept;
+	argv[argc] = nullptr;
+	return mode;
+}
+
+int runConversion(const char* input, const char* output, ModelCacheMode cacheMode)
+{
+	printWelcomeBanner(false);
+	std::cout << "Converting files:" << std::endl;
+	std::cout << "Input file \"" << input << '"' << std::endl;
+	std::cout << "Output file \"" << output << '"' << std::endl;
+	std::cout << std::endl;
+
+	QString inname = input;
+
+	ModelInfo info;
+	WZM model;
+
+	info.m_saveAsFile = output;
+	if (!guessModelTypeFromFilename(info.m_saveAsFile, info.m_save_type))
+	{
+		std::cerr << "Could not guess save model type from filename. Only PIE and OBJ formats are supported!" << std::endl;
+		return 1;
+	}
+
+	std::cout << "Loading model..." << std::endl;
+	if (!loadModel(inname, model, info, true, cacheMode))
+	{
+		printf("Could not load model\n");
+		return 1;
+	}
+	if (info.m_fromCache)
+	{
+		std::cout << "Loaded from the model cache." << std::endl;
+	}
+
+	info.defaultPieCapsIfNeeded();
+
+	std::cout << "Saving model..." << std::endl;
+	if(!saveModel(model, info))
+	{
+		printf("Could not save model\n");
+		return 1;
+	}
+
+	std::cout << "Done." << std::endl;
+	return 0;
+}
+
+static const unsigned long MAX_BATCH_JOBS = 1024;
+
+// Digits only, atoi() would silently turn "abc" into 0 (one job per core)
+static bool parseJobCount(const char* arg, unsigned& jobs)
+{
+	if (!isdigit(static_cast<unsigned char>(arg[0])))
+		return false;
+
+	char* end = nullptr;
+	errno = 0;
+	const unsigned long val = strtoul(arg, &end, 10);
+	if (errno != 0 || *end != '\0' || val > MAX_BATCH_JOBS)
+		return false;
+
+	jobs = static_cast<unsigned>(val);
+	return true;
+}
+
+int runBatchConversion(int argc, char *argv[], ModelCacheMode cacheMode)
+{
+	std::vector<BatchJob> jobs;
+	wmit_filetype_t outType = WMIT_FT_PIE;
+	bool haveOutType = false;
+	unsigned threads = 0;
+
+	const bool manifestMode = strcmp("--batch-manifest", argv[1]) == 0;
+	const int positional = manifestMode ? 1 : 2;
+
+	if (argc < 2 + positional)
+	{
+		std::cerr << "Missing arguments for " << argv[1] << ", see --help." << std::endl;
+		return 1;
+	}
+
+	for (int i = 2 + positional; i < argc; ++i)
+	{
+		if (strcmp("--to", argv[i]) == 0 && i + 1 < argc)
+		{
+			++i;
+			if (!guessModelTypeFromFilename(QString(".") + argv[i], outType) || outType == WMIT_FT_WZM)
+			{
+				std::cerr << "Unsupported output format \"" << argv[i] << "\". Only pie and obj are supported!" << std::endl;
+				return 1;
+			}
+			haveOutType = true;
+		}
+		else if (strcmp("--jobs", argv[i]) == 0 && i + 1 < argc)
+		{
+			++i;
+			if (!parseJobCount(argv[i], threads))
+			{
+				std::cerr << "Invalid job count \"" << argv[i] << "\", expected a number from 0 (one per core) to "
+					  << MAX_BATCH_JOBS << "." << std::endl;
+				return 1;
+			}
+		}
+		else
+		{
+			std::cerr << "Unknown argument \"" << argv[i] << "\", see --help." << std::endl;
+			return 1;
+		}
+	}
+
+	printWelcomeBanner(false);
+
+	if (manifestMode)
+	{
+		if (!readBatchManifest(argv[2], jobs))
+			return 1;
+	}
+	else
+	{
+		if (!haveOutType)
+		{
+			std::cerr << "Missing --to pie|obj for --batch." << std::endl;
+			return 1;
+		}
+		if (!collectBatchJobs(argv[2], argv[3], outType, jobs))
+			return 1;
+	}
+
+	std::cout << "Converting " << jobs.size() << " files..." << std::endl;
+
+	return runBatchJobs(jobs, threads, cacheMode) == 0 ? 0 : 1;
+}
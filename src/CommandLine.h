@@ -0,0 +1,44 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef COMMANDLINE_HPP
+#define COMMANDLINE_HPP
+
+/*
+  Command line modes shared by the GUI executable and wmit-cli.
+  Both return the process exit code.
+  */
+
+#include "ModelCache.h"
+
+void printWelcomeBanner(const bool printLicense);
+void printCommandLineHelp(const bool withGui);
+
+bool isBatchConversionArg(const char* arg);
+
+// Removes --no-cache and --rebuild-cache from argv, returns the model cache mode they select
+ModelCacheMode takeCacheModeArgs(int& argc, char *argv[]);
+
+// [input] [output]
+int runConversion(const char* input, const char* output, ModelCacheMode cacheMode = WMIT_CACHE_USE);
+
+// --batch [indir] [outdir] --to pie|obj [--jobs N] / --batch-manifest [manifest] [--jobs N]
+int runBatchConversion(int argc, char *argv[], ModelCacheMode cacheMode = WMIT_CACHE_USE);
+
+#endif // COMMANDLINE_HPP
@@ -0,0 +1,272 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ModelIO.h"
+
+#include <fstream>
+#include <iostream>
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QStandardPaths>
+
+#include "TextReader.h"
+
+bool guessModelTypeFromFilename(const QString& fname, wmit_filetype_t& type)
+{
+	const QString ext = fname.right(fname.size() - fname.lastIndexOf('.') - 1);
+
+	if (ext.compare(QString("wzm"), Qt::CaseInsensitive) == 0)
+	{
+		type = WMIT_FT_WZM;
+	}
+	else if (ext.compare(QString("obj"), Qt::CaseInsensitive) == 0)
+	{
+		type = WMIT_FT_OBJ;
+	}
+	else if (ext.compare(QString("pie"), Qt::CaseInsensitive) == 0)
+	{
+		type = WMIT_FT_PIE;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+QString modelCacheDirectory()
+{
+	const QByteArray override = qgetenv("WMIT_CACHE_DIR");
+	if (!override.isEmpty())
+	{
+		return QString::fromLocal8Bit(override);
+	}
+
+	const QString base = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+	if (base.isEmpty())
+	{
+		return QString();
+	}
+
+	return base + "/" WMIT_APPNAME "/models";
+}
+
+void pruneCacheDirectory(const QString& dir, const QStringList& nameFilters, qint64 maxBytes, qint64 writtenBytes)
+{
+	static QMutex mutex;
+	static QHash<QString, qint64> writtenSinceScan;
+
+	{
+		QMutexLocker lock(&mutex);
+
+		const QString slot = dir + '/' + nameFilters.join(';');
+		const auto it = writtenSinceScan.find(slot);
+		if (it != writtenSinceScan.end())
+		{
+			it.value() += writtenBytes;
+			if (it.value() < maxBytes / 8)
+				return;
+		}
+		writtenSinceScan[slot] = 0;
+	}
+
+	// Oldest first
+	const QFileInfoList entries = QDir(dir).entryInfoList(nameFilters, QDir::Files,
+							      QDir::Time | QDir::Reversed);
+
+	qint64 total = 0;
+	for (const QFileInfo& entry : entries)
+	{
+		total += entry.size();
+	}
+
+	for (int i = 0; i < entries.size() && total > maxBytes; ++i)
+	{
+		// Another process may have dropped it already
+		if (QFile::remove(entries[i].absoluteFilePath()) || !QFile::exists(entries[i].absoluteFilePath()))
+		{
+			total -= entries[i].size();
+		}
+	}
+}
+
+void touchCacheEntry(const QString& path)
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 10, 0))
+	QFile file(path);
+	if (file.open(QIODevice::ReadWrite))
+	{
+		file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+	}
+#else
+	Q_UNUSED(path);
+#endif
+}
+
+bool loadModel(const QString& file, WZM& model, ModelInfo &info, bool objWelder, ModelCacheMode cacheMode,
+	       unsigned threads)
+{
+	wmit_filetype_t type;
+
+	if (!guessModelTypeFromFilename(file, type))
+	{
+		printf("Could not guess model type from filename. Only formats PIE, WZM, and OBJ are supported.\n");
+		return false;
+	}
+
+	info.m_read_type = type;
+	info.m_fromCache = false;
+
+	if (info.m_read_type == WMIT_FT_WZM)
+	{
+		std::cout << WMIT_WARN_DEPRECATED_WZM << std::endl;
+	}
+
+	const bool isPie = type == WMIT_FT_PIE || type == WMIT_FT_PIE2;
+
+	// PIE and OBJ are parsed from the mapping as well, WZM only hashes it
+	MappedFile mapped;
+	if (type != WMIT_FT_WZM || cacheMode != WMIT_CACHE_OFF)
+	{
+		mapped.open(file.toLocal8Bit());
+	}
+
+	ModelCacheKey cacheKey;
+	std::string cachePath;
+	const QString cacheDir = cacheMode != WMIT_CACHE_OFF ? modelCacheDirectory() : QString();
+
+	if (mapped.isOpen() && !cacheDir.isEmpty() && QDir().mkpath(cacheDir))
+	{
+		const uint32_t options = type == WMIT_FT_OBJ && objWelder ? 1 : 0;
+		cacheKey = ModelCache::makeKey(mapped.data(), mapped.size(), type, options);
+		cachePath = ModelCache::entryPath(cacheDir.toLocal8Bit().constData(), cacheKey);
+
+		PieCaps caps;
+		if (cacheMode == WMIT_CACHE_USE && ModelCache::read(cachePath, cacheKey, model, caps))
+		{
+			if (isPie)
+				info.m_pieCaps = caps;
+			touchCacheEntry(QString::fromLocal8Bit(cachePath.c_str()));
+			info.m_fromCache = true;
+			return true;
+		}
+	}
+
+	bool read_success = false;
+	std::ifstream f;
+
+	switch (type)
+	{
+	case WMIT_FT_WZM:
+		f.open(file.toLocal8Bit(), std::ios::in | std::ios::binary);
+		read_success = model.read(f);
+		break;
+	case WMIT_FT_OBJ:
+	{
+		TextReader reader(mapped);
+		read_success = mapped.isOpen() && model.importFromOBJ(reader, objWelder, threads);
+		break;
+	}
+	case WMIT_FT_PIE:
+	case WMIT_FT_PIE2:
+		TextReader reader(mapped);
+		int pieversion = pieVersion(reader);
+		if (pieversion <= 2)
+		{
+			Pie2Model p2;
+			read_success = p2.read(reader);
+			if (read_success)
+			{
+				Pie3Model p3(p2);
+				info.m_pieCaps = p3.getCaps();
+				model = WZM(p3, threads);
+			}
+		}
+		else // 3 or higher
+		{
+			Pie3Model p3;
+			read_success = p3.read(reader);
+			if (read_success)
+			{
+				info.m_pieCaps = p3.getCaps();
+				model = WZM(p3, threads);
+			}
+		}
+	}
+
+	// A failed write only costs the next load its speedup
+	if (read_success && !cachePath.empty() &&
+	    ModelCache::write(cachePath, cacheKey, model, isPie ? info.m_pieCaps : PieCaps()))
+	{
+		pruneCacheDirectory(cacheDir, QStringList() << "*" WMIT_MODEL_CACHE_EXT, WMIT_MODEL_CACHE_MAX_BYTES,
+				    QFileInfo(QString::fromLocal8Bit(cachePath.c_str())).size());
+	}
+
+	return read_success;
+}
+
+bool saveModel(const WZM &model, const ModelInfo &info)
+{
+	std::ofstream out;
+	bool save_result = true;
+
+	if (info.m_save_type == WMIT_FT_WZM)
+	{
+		std::cerr << WMIT_WARN_DEPRECATED_WZM << std::endl;
+		return false;
+	}
+
+	out.open(info.m_saveAsFile.toLocal8Bit().constData());
+	if (!out.is_open())
+	{
+		return false;
+	}
+
+	switch (info.m_save_type)
+	{
+	case WMIT_FT_OBJ:
+		model.exportToOBJ(out);
+		break;
+	case WMIT_FT_PIE:
+	{
+		Pie3Model p3 = model;
+		p3.write(out, &info.m_pieCaps);
+		break;
+	}
+	case WMIT_FT_PIE2:
+	{
+		Pie3Model p3 = model;
+		Pie2Model p2 = p3;
+		p2.write(out, &info.m_pieCaps);
+		break;
+	}
+	default:
+		save_result = false;
+	}
+
+	out.close();
+
+	return save_result;
+}
@@ -0,0 +1,101 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MODELIO_HPP
+#define MODELIO_HPP
+
+#include <QString>
+#include <QStringList>
+
+#include "ModelCache.h"
+#include "Pie.h"
+#include "WZM.h"
+#include "wmit.h"
+
+struct ModelInfo
+{
+	ModelInfo() {clear();}
+
+	PieCaps m_pieCaps;
+	wmit_filetype_t m_save_type;
+	wmit_filetype_t m_read_type;
+	QString m_currentFile;
+	QString m_saveAsFile;
+	bool m_fromCache;	// the last loadModel() was served by the model cache
+
+	void clear()
+	{
+		m_save_type = m_read_type = WMIT_FT_PIE;
+		m_fromCache = false;
+		m_pieCaps.reset();
+		m_currentFile.clear();
+		m_saveAsFile.clear();
+	}
+
+	void defaultPieCapsIfNeeded()
+	{
+		if (m_read_type != WMIT_FT_PIE && m_read_type != WMIT_FT_PIE2)
+			m_pieCaps = m_save_type == WMIT_FT_PIE? PIE3_CAPS : PIE2_CAPS;
+	}
+
+	void prepareForSaveToSelf()
+	{
+		// Use orignal type and filename if we never went through a save before
+		if (!m_saveAsFile.isEmpty())
+			return;
+		m_save_type = m_read_type;
+		m_saveAsFile = m_currentFile;
+	}
+};
+
+bool guessModelTypeFromFilename(const QString &fname, wmit_filetype_t &type);
+
+/*!
+ * Directory of the binary model cache: $WMIT_CACHE_DIR when set, a WMIT
+ * folder in the user's cache location otherwise. Empty if there is none.
+ */
+QString modelCacheDirectory();
+
+/*!
+ * Deletes the least recently used files matching any of \a nameFilters in
+ * \a dir until the rest takes at most \a maxBytes. Meant to be called after
+ * every cache write of \a writtenBytes: the directory is scanned on the first
+ * call and then only once another eighth of \a maxBytes has been written.
+ */
+void pruneCacheDirectory(const QString& dir, const QStringList& nameFilters, qint64 maxBytes, qint64 writtenBytes);
+
+/*!
+ * Marks a cache entry as used, so pruneCacheDirectory() keeps it longer.
+ * Without Qt 5.10 entries are dropped in the order they were written.
+ */
+void touchCacheEntry(const QString& path);
+
+/*!
+ * Reads \a file into \a model, guessing the format from its extension.
+ * \a objWelder enables vertex welding for OBJ imports. Unchanged sources are
+ * loaded from the model cache according to \a cacheMode, which is kept below
+ * WMIT_MODEL_CACHE_MAX_BYTES. Importing uses up to \a threads threads
+ * (0 = one per core), callers that already run in parallel pass their share.
+ */
+bool loadModel(const QString& file, WZM& model, ModelInfo &info, bool objWelder = true,
+	       ModelCacheMode cacheMode = WMIT_CACHE_USE, unsigned threads = 0);
+
+bool saveModel(const WZM& model, const ModelInfo &info);
+
+#endif // MODELIO_HPP
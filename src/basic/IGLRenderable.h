@@ -20,11 +20,16 @@
 #ifndef IGLRENDERABLE_HPP
 #define IGLRENDERABLE_HPP
 
+class FrameTimings;
+
 class IGLRenderable
 {
 public:
 	virtual ~IGLRenderable(){}
 	virtual void render(const float* mtxModelView, const float* mtxProj, const float* posSun) = 0;
+
+	// Where render() reports its stage times and mesh counts, nullptr for none
+	virtual void setFrameTimings(FrameTimings*) {}
 };
 
 #endif // IGLRENDERABLE_HPP
@@ -29,6 +29,7 @@ struct ShaderInfo
 {
 	QPointer<QOpenGLShaderProgram> program;
 	bool is_external;
+	unsigned revision; // bumped on every (re)load, the program object is reused
 };
 
 class IGLShaderManager
@@ -52,6 +53,12 @@ public:
 		return m_shaders.contains(type) && m_shaders.value(type).is_external;
 	}
 
+	// Changes whenever the shader is loaded again, uniform locations are stale then
+	virtual unsigned shaderRevision(int type) const
+	{
+		return m_shaders.contains(type) ? m_shaders.value(type).revision : 0;
+	}
+
 	virtual QOpenGLShaderProgram* getShader(int type)
 	{
 		if (m_shaders.contains(type))
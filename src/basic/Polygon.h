@@ -19,16 +19,24 @@
 #ifndef POLYGON_HPP
 #define POLYGON_HPP
 
+#include <cstdint>
 #include <iostream>
+#include <vector>
 
 #include <GL/glew.h>
 
 #include "Vector.h"
+#include "TextReader.h"
+#include "TextWriter.h"
 
 
-struct IndexedTri : public Vector<GLushort,3>
+/*
+  Triangle indices are 32 bit so that high-poly source meshes
+  survive import; see Mesh::drawIndexType() for rendering.
+  */
+struct IndexedTri : public Vector<GLuint,3>
 {
-	typedef GLushort indexType;
+	typedef GLuint indexType;
 	indexType& a() {
 		return component[0];
 	}
@@ -52,37 +60,57 @@ struct IndexedTri : public Vector<GLushort,3>
 };
 
 /*
-  Pie polygons are triangle fans of with
-  texture and texture animation data.
+  The polygons of a pie level. Pie polygons are triangle fans
+  with texture and texture animation data.
+
+  Stored as flat arrays rather than one object per polygon: the indices
+  and texture coordinates of all fans are concatenated and m_offsets
+  tells where each one starts. Texture animation data is only stored
+  once a polygon of the level uses it.
   */
 template<typename U, typename S, size_t MAX>
-class PiePolygon
+class PiePolygons
 {
-	friend class Mesh;
 public:
-	PiePolygon();
-	virtual ~PiePolygon(){}
+	static const size_t MAX_VERTICES = MAX;
 
-	bool read(std::istream& in);
-	void write(std::ostream& out) const;
+	struct TexAnim
+	{
+		unsigned frames;
+		unsigned playbackRate;
+		S width, height;
+	};
 
-	unsigned getFrames() const;
-	unsigned getIndex(unsigned n) const;
-	U getUV(int index) const;
-	unsigned short vertices() const;
-	unsigned short triangles() const;
-protected:
+	PiePolygons();
+
+	size_t size() const {return m_flags.size();}
+	bool empty() const {return m_flags.empty();}
 	void clear();
-	static const size_t MAX_VERTICES = MAX;
-	unsigned short m_vertices;
-	short m_indices[MAX];
-	U m_texCoords[MAX];
-	unsigned long m_flags;
-
-	/// Texture Animation Data
-	unsigned m_frames;
-	unsigned m_playbackRate;
-	S m_width, m_height;
+	void reserve(size_t polygons, size_t vertices);
+
+	// Appends one polygon, nothing is added on failure
+	bool read(TextReader& in);
+	void write(TextWriter& out, size_t polygon) const;
+
+	// anim is only used when the 0x4000 flag is set
+	void add(uint32_t flags, unsigned short vertices, const unsigned* indices,
+		 const U* texCoords, const TexAnim& anim);
+
+	uint32_t getFlags(size_t polygon) const {return m_flags[polygon];}
+	TexAnim getTexAnim(size_t polygon) const;
+	unsigned getIndex(size_t polygon, unsigned n) const;
+	const U& getUV(size_t polygon, unsigned n) const;
+	unsigned short vertices(size_t polygon) const;
+	unsigned short triangles(size_t polygon) const;
+
+protected:
+	static TexAnim defaultTexAnim() {return TexAnim{1, 0, 0, 0};}
+
+	std::vector<uint32_t> m_offsets;	// size() + 1 entries
+	std::vector<unsigned> m_indices;
+	std::vector<U> m_texCoords;
+	std::vector<uint32_t> m_flags;
+	std::vector<TexAnim> m_texAnims;	// empty or size() entries
 };
 
 // Include template implementations
@@ -31,81 +31,99 @@
 */
 
 template<typename U, typename S, size_t MAX>
-PiePolygon<U, S, MAX>::PiePolygon():
-	m_vertices(0),
-	m_flags(0),
-	m_frames(0),
-	m_playbackRate(0),
-	m_width(0), m_height(0)
+PiePolygons<U, S, MAX>::PiePolygons():
+	m_offsets(1, 0)
 {
 }
 
 template<typename U, typename S, size_t MAX>
-bool PiePolygon<U, S, MAX>::read(std::istream& in)
+void PiePolygons<U, S, MAX>::clear()
 {
+	m_offsets.assign(1, 0);
+	m_indices.clear();
+	m_texCoords.clear();
+	m_flags.clear();
+	m_texAnims.clear();
+}
+
+template<typename U, typename S, size_t MAX>
+void PiePolygons<U, S, MAX>::reserve(size_t polygons, size_t vertices)
+{
+	m_offsets.reserve(polygons + 1);
+	m_indices.reserve(vertices);
+	m_texCoords.reserve(vertices);
+	m_flags.reserve(polygons);
+}
+
+template<typename U, typename S, size_t MAX>
+bool PiePolygons<U, S, MAX>::read(TextReader& in)
+{
+	uint32_t flags = 0;
+	unsigned short vertices = 0;
+	unsigned indices[MAX] = {};
+	U texCoords[MAX];
+	TexAnim anim = defaultTexAnim();
 	unsigned i;
-	clear();
 
-	in >> std::hex >> m_flags >> std::dec >> m_vertices;
-	if (in.fail() || m_vertices > MAX)
+	in.readHex(flags) >> vertices;
+	if (in.fail() || vertices > MAX)
 	{
-		clear();
 		return false;
 	}
 
-	for (i = 0; i < m_vertices; ++i)
+	for (i = 0; i < vertices; ++i)
 	{
-		in >> m_indices[i];
+		in >> indices[i];
 	}
 
-	if (m_flags & 0x4000)
+	if (flags & 0x4000)
 	{
-		in >> m_frames >> m_playbackRate >>	m_width >> m_height;
-	}
-	else
-	{
-		m_frames = 1;
+		in >> anim.frames >> anim.playbackRate >> anim.width >> anim.height;
 	}
 
-	for (i = 0; i < m_vertices; ++i)
+	for (i = 0; i < vertices; ++i)
 	{
-		in >> m_texCoords[i].u() >> m_texCoords[i].v();
+		in >> texCoords[i].u() >> texCoords[i].v();
 	}
 	if (in.fail() && !in.eof())
 	{
-		clear();
 		return false;
 	}
+
+	add(flags, vertices, indices, texCoords, anim);
 	return true;
 }
 
 template<typename U, typename S, size_t MAX>
-void PiePolygon<U, S, MAX>::write(std::ostream& out) const
+void PiePolygons<U, S, MAX>::write(TextWriter& out, size_t polygon) const
 {
+	const unsigned first = m_offsets[polygon];
+	const unsigned short count = vertices(polygon);
 	unsigned i;
 
-	out << std::hex << m_flags << std::dec << ' ';
-	out << m_vertices << ' ';
+	out.writeHex(m_flags[polygon]) << ' ';
+	out << count << ' ';
 
-	for (i = 0; i < m_vertices; ++i)
+	for (i = 0; i < count; ++i)
 	{
-		out << m_indices[i] << ' ';
+		out << m_indices[first + i] << ' ';
 	}
 
-	if (m_flags & 0x4000)
+	if (m_flags[polygon] & 0x4000)
 	{
-		out << m_frames << ' '
-				<< m_playbackRate << ' '
-				<< m_width	<< ' '
-				<< m_height	<< ' ';
+		const TexAnim anim = getTexAnim(polygon);
+		out << anim.frames << ' '
+				<< anim.playbackRate << ' '
+				<< anim.width	<< ' '
+				<< anim.height	<< ' ';
 	}
 
-	for (i = 0; i < m_vertices; ++i)
+	for (i = 0; i < count; ++i)
 	{
-		out << m_texCoords[i].u() << ' '
-				<< m_texCoords[i].v();
+		out << m_texCoords[first + i].u() << ' '
+				<< m_texCoords[first + i].v();
 		// last pair is w/o trailing space
-		if (i < (unsigned)(m_vertices - 1))
+		if (i < (unsigned)(count - 1))
 			out << ' ';
 	}
 
@@ -113,38 +131,49 @@ void PiePolygon<U, S, MAX>::write(std::ostream& out) const
 }
 
 template<typename U, typename S, size_t MAX>
-unsigned PiePolygon<U, S, MAX>::getFrames() const
+void PiePolygons<U, S, MAX>::add(uint32_t flags, unsigned short vertices, const unsigned* indices,
+				 const U* texCoords, const TexAnim& anim)
 {
-	return m_frames;
+	if ((flags & 0x4000) || !m_texAnims.empty())
+	{
+		// the earlier polygons had none
+		m_texAnims.resize(size(), defaultTexAnim());
+		m_texAnims.push_back((flags & 0x4000) ? anim : defaultTexAnim());
+	}
+
+	m_indices.insert(m_indices.end(), indices, indices + vertices);
+	m_texCoords.insert(m_texCoords.end(), texCoords, texCoords + vertices);
+	m_offsets.push_back(static_cast<uint32_t>(m_indices.size()));
+	m_flags.push_back(flags);
 }
 
 template<typename U, typename S, size_t MAX>
-unsigned PiePolygon<U, S, MAX>::getIndex(unsigned n) const
+typename PiePolygons<U, S, MAX>::TexAnim PiePolygons<U, S, MAX>::getTexAnim(size_t polygon) const
 {
-	//TODO: assert n >= vertices()
-	return m_indices[n];
+	return m_texAnims.empty() ? defaultTexAnim() : m_texAnims[polygon];
 }
 
 template<typename U, typename S, size_t MAX>
-U PiePolygon<U, S, MAX>::getUV(int index) const
+unsigned PiePolygons<U, S, MAX>::getIndex(size_t polygon, unsigned n) const
 {
-	return m_texCoords[index];
+	//TODO: assert n >= vertices()
+	return m_indices[m_offsets[polygon] + n];
 }
 
 template<typename U, typename S, size_t MAX>
-void PiePolygon<U, S, MAX>::clear()
+const U& PiePolygons<U, S, MAX>::getUV(size_t polygon, unsigned n) const
 {
-	*this = PiePolygon();
+	return m_texCoords[m_offsets[polygon] + n];
 }
 
 template<typename U, typename S, size_t MAX>
-unsigned short PiePolygon<U, S, MAX>::vertices() const
+unsigned short PiePolygons<U, S, MAX>::vertices(size_t polygon) const
 {
-	return m_vertices;
+	return static_cast<unsigned short>(m_offsets[polygon + 1] - m_offsets[polygon]);
 }
 
 template<typename U, typename S, size_t MAX>
-unsigned short PiePolygon<U, S, MAX>::triangles() const
+unsigned short PiePolygons<U, S, MAX>::triangles(size_t polygon) const
 {
-	return std::max(0,vertices() - 2);
+	return std::max(0, vertices(polygon) - 2);
 }
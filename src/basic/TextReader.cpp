@@ -0,0 +1,304 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TextReader.h"
+
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <locale>
+#include <sstream>
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+MappedFile::MappedFile():
+	m_data(nullptr), m_size(0), m_open(false), m_mapped(false)
+#ifdef _WIN32
+	, m_file(nullptr), m_mapping(nullptr)
+#endif
+{
+}
+
+MappedFile::MappedFile(const char* path): MappedFile()
+{
+	open(path);
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::open(const char* path)
+{
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr,
+				  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file != INVALID_HANDLE_VALUE)
+	{
+		LARGE_INTEGER size;
+		if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+		{
+			HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+			if (view)
+			{
+				m_file = file;
+				m_mapping = mapping;
+				m_data = static_cast<const char*>(view);
+				m_size = static_cast<size_t>(size.QuadPart);
+				m_mapped = m_open = true;
+				return true;
+			}
+			if (mapping)
+				CloseHandle(mapping);
+		}
+		CloseHandle(file);
+	}
+#else
+	int fd = ::open(path, O_RDONLY);
+	if (fd >= 0)
+	{
+		struct stat st;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+		{
+			void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			if (view != MAP_FAILED)
+			{
+				::close(fd);
+				m_data = static_cast<const char*>(view);
+				m_size = static_cast<size_t>(st.st_size);
+				m_mapped = m_open = true;
+				return true;
+			}
+		}
+		::close(fd);
+	}
+#endif
+
+	// Fallback: plain read into our own buffer
+	std::ifstream fin(path, std::ios::in | std::ios::binary);
+	if (!fin.is_open())
+		return false;
+
+	m_buffer.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+	m_data = m_buffer.data();
+	m_size = m_buffer.size();
+	m_open = true;
+	return true;
+}
+
+void MappedFile::close()
+{
+	if (m_mapped)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(m_data);
+		CloseHandle(m_mapping);
+		CloseHandle(m_file);
+		m_mapping = m_file = nullptr;
+#else
+		munmap(const_cast<char*>(m_data), m_size);
+#endif
+	}
+
+	m_buffer.clear();
+	m_data = nullptr;
+	m_size = 0;
+	m_open = m_mapped = false;
+}
+
+TextReader::TextReader(const char* begin, const char* end):
+	m_begin(begin), m_end(end), m_pos(begin),
+	m_fail(false), m_eof(false)
+{
+}
+
+TextReader::TextReader(std::string_view text):
+	TextReader(text.data(), text.data() + text.size())
+{
+}
+
+TextReader::TextReader(const MappedFile& file):
+	TextReader(file.data(), file.data() + file.size())
+{
+}
+
+static inline bool isSpace(char c)
+{
+	// Same set as isspace() in the "C" locale
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+bool TextReader::skipWhitespace()
+{
+	if (m_fail)
+		return false;
+
+	while (m_pos != m_end && isSpace(*m_pos))
+		++m_pos;
+
+	if (m_pos == m_end)
+	{
+		m_fail = m_eof = true;
+		return false;
+	}
+	return true;
+}
+
+std::string_view TextReader::nextWord()
+{
+	if (!skipWhitespace())
+		return std::string_view();
+
+	const char* start = m_pos;
+	while (m_pos != m_end && !isSpace(*m_pos))
+		++m_pos;
+
+	if (m_pos == m_end)
+		m_eof = true;
+
+	return std::string_view(start, static_cast<size_t>(m_pos - start));
+}
+
+TextReader& TextReader::operator>>(std::string_view& str)
+{
+	std::string_view word = nextWord();
+	if (!m_fail)
+		str = word;
+	return *this;
+}
+
+TextReader& TextReader::operator>>(std::string& str)
+{
+	std::string_view word = nextWord();
+	if (!m_fail)
+		str.assign(word.data(), word.size());
+	return *this;
+}
+
+bool TextReader::getline(std::string_view& line)
+{
+	if (m_fail)
+		return false;
+
+	if (m_pos == m_end)
+	{
+		m_fail = m_eof = true;
+		return false;
+	}
+
+	const char* start = m_pos;
+	const void* newline = memchr(m_pos, '\n', static_cast<size_t>(m_end - m_pos));
+	m_pos = newline ? static_cast<const char*>(newline) : m_end;
+
+	const char* stop = m_pos;
+	if (stop != start && *(stop - 1) == '\r')
+		--stop;
+
+	if (m_pos == m_end)
+		m_eof = true;
+	else
+		++m_pos; // eat '\n'
+
+	line = std::string_view(start, static_cast<size_t>(stop - start));
+	return true;
+}
+
+bool TextReader::parseUnsigned(unsigned long long& val, int base)
+{
+	if (base == 16 && m_end - m_pos > 2 && m_pos[0] == '0' && (m_pos[1] == 'x' || m_pos[1] == 'X'))
+		m_pos += 2;
+
+	std::from_chars_result res = std::from_chars(m_pos, m_end, val, base);
+	if (res.ec != std::errc())
+		return false;
+
+	m_pos = res.ptr;
+	if (m_pos == m_end)
+		m_eof = true;
+	return true;
+}
+
+#if defined(__cpp_lib_to_chars)
+
+template <typename T>
+static bool parseFloatImpl(const char*& pos, const char* end, T& val)
+{
+	std::from_chars_result res = std::from_chars(pos, end, val);
+	if (res.ec != std::errc())
+		return false;
+	pos = res.ptr;
+	return true;
+}
+
+#else
+
+// Standard libraries w/o floating point from_chars: fall back to the
+// classic locale stream parser on the current word only.
+template <typename T>
+static bool parseFloatImpl(const char*& pos, const char* end, T& val)
+{
+	const char* wordEnd = pos;
+	while (wordEnd != end && !isSpace(*wordEnd))
+		++wordEnd;
+
+	std::istringstream ss(std::string(pos, wordEnd));
+	ss.imbue(std::locale::classic());
+	ss >> val;
+	if (ss.fail())
+		return false;
+
+	std::streampos consumed = ss.tellg();
+	pos = consumed == std::streampos(-1) ? wordEnd : pos + static_cast<std::streamoff>(consumed);
+	return true;
+}
+
+#endif
+
+bool TextReader::parseFloat(float& val)
+{
+	if (!parseFloatImpl(m_pos, m_end, val))
+		return false;
+	if (m_pos == m_end)
+		m_eof = true;
+	return true;
+}
+
+bool TextReader::parseFloat(double& val)
+{
+	if (!parseFloatImpl(m_pos, m_end, val))
+		return false;
+	if (m_pos == m_end)
+		m_eof = true;
+	return true;
+}
@@ -0,0 +1,199 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef TEXTREADER_HPP
+#define TEXTREADER_HPP
+
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/*
+  Read-only view of a whole file.
+
+  Memory maps the file where the platform allows it, otherwise (or for
+  empty files) the content is read into an owned buffer.
+  */
+class MappedFile
+{
+public:
+	MappedFile();
+	explicit MappedFile(const char* path);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const char* path);
+	void close();
+
+	bool isOpen() const {return m_open;}
+	const char* data() const {return m_data;}
+	size_t size() const {return m_size;}
+
+private:
+	const char* m_data;
+	size_t m_size;
+	bool m_open;
+	bool m_mapped;
+	std::string m_buffer;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#endif
+};
+
+/*
+  Whitespace separated tokenizer working in place on a character range.
+
+  Implements the subset of std::istream extraction used by the text
+  format readers (sticky fail/eof state, tellg/seekg rewinding) so
+  they can be ported 1:1, but without locale lookups and without
+  allocating for every token read.
+  */
+class TextReader
+{
+public:
+	typedef const char* pos_type;
+
+	TextReader(const char* begin, const char* end);
+	explicit TextReader(std::string_view text);
+	explicit TextReader(const MappedFile& file);
+
+	pos_type tellg() const {return m_pos;}
+	void seekg(pos_type pos) {m_pos = pos;}
+
+	pos_type begin() const {return m_begin;}
+	pos_type end() const {return m_end;}
+
+	bool fail() const {return m_fail;}
+	bool eof() const {return m_eof;}
+	bool good() const {return !m_fail && !m_eof;}
+	void clear() {m_fail = m_eof = false;}
+
+	// Rest of the current line, w/o the line terminator (CR included)
+	bool getline(std::string_view& line);
+
+	// Hexadecimal unsigned integer, like "in >> std::hex >> val"
+	template <typename T>
+	TextReader& readHex(T& val);
+
+	TextReader& operator>>(std::string_view& str);
+	TextReader& operator>>(std::string& str);
+
+	TextReader& operator>>(float& val) {return readFloat(val);}
+	TextReader& operator>>(double& val) {return readFloat(val);}
+
+	template <typename T>
+	typename std::enable_if<std::is_integral<T>::value, TextReader&>::type
+	operator>>(T& val)
+	{
+		return readInteger(val, 10);
+	}
+
+private:
+	bool skipWhitespace();
+	std::string_view nextWord();
+
+	template <typename T>
+	TextReader& readInteger(T& val, int base);
+	template <typename T>
+	TextReader& readFloat(T& val);
+
+	bool parseUnsigned(unsigned long long& val, int base);
+	bool parseFloat(float& val);
+	bool parseFloat(double& val);
+
+	pos_type m_begin, m_end, m_pos;
+	bool m_fail, m_eof;
+};
+
+template <typename T>
+TextReader& TextReader::readHex(T& val)
+{
+	return readInteger(val, 16);
+}
+
+template <typename T>
+TextReader& TextReader::readInteger(T& val, int base)
+{
+	bool negative = false;
+	unsigned long long magnitude;
+
+	if (!skipWhitespace())
+	{
+		return *this;
+	}
+
+	if (*m_pos == '-' || *m_pos == '+')
+	{
+		negative = *m_pos == '-';
+		++m_pos;
+	}
+
+	if (!parseUnsigned(magnitude, base))
+	{
+		m_fail = true;
+		return *this;
+	}
+
+	if (std::is_signed<T>::value)
+	{
+		const unsigned long long limit = negative ?
+			0ULL - static_cast<unsigned long long>(std::numeric_limits<T>::min()) :
+			static_cast<unsigned long long>(std::numeric_limits<T>::max());
+		if (magnitude > limit)
+		{
+			m_fail = true;
+			return *this;
+		}
+	}
+	else if (magnitude > static_cast<unsigned long long>(std::numeric_limits<T>::max()))
+	{
+		m_fail = true;
+		return *this;
+	}
+
+	// Same as streams, negated unsigned values wrap around
+	val = static_cast<T>(negative ? 0ULL - magnitude : magnitude);
+	return *this;
+}
+
+template <typename T>
+TextReader& TextReader::readFloat(T& val)
+{
+	if (!skipWhitespace())
+	{
+		return *this;
+	}
+
+	if (*m_pos == '+')
+	{
+		++m_pos;
+	}
+
+	if (!parseFloat(val))
+	{
+		m_fail = true;
+	}
+	return *this;
+}
+
+#endif // TEXTREADER_HPP
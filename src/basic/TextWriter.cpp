@@ -0,0 +1,170 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TextWriter.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <locale>
+#include <sstream>
+
+TextWriter::TextWriter(std::ostream& out):
+	m_out(out),
+	m_block(new char[BLOCK_SIZE]),
+	m_pos(0),
+	m_floatFormat(FLOAT_GENERAL),
+	m_precision(6)
+{
+}
+
+TextWriter::~TextWriter()
+{
+	flush();
+}
+
+void TextWriter::setFloatFormat(FloatFormat format, int precision)
+{
+	m_floatFormat = format;
+	m_precision = std::min(std::max(precision, 0), 100);
+}
+
+void TextWriter::flush()
+{
+	flushBlock();
+	m_out.flush();
+}
+
+void TextWriter::flushBlock()
+{
+	if (m_pos)
+	{
+		m_out.write(m_block.get(), static_cast<std::streamsize>(m_pos));
+		m_pos = 0;
+	}
+}
+
+TextWriter& TextWriter::operator<<(std::string_view str)
+{
+	if (str.size() > BLOCK_SIZE - m_pos)
+	{
+		flushBlock();
+		if (str.size() > BLOCK_SIZE)
+		{
+			m_out.write(str.data(), static_cast<std::streamsize>(str.size()));
+			return *this;
+		}
+	}
+
+	memcpy(m_block.get() + m_pos, str.data(), str.size());
+	m_pos += str.size();
+	return *this;
+}
+
+TextWriter& TextWriter::writeHex(unsigned long long val)
+{
+	return writeUnsigned(val, 16);
+}
+
+TextWriter& TextWriter::writeSigned(long long val)
+{
+	char* pos = reserve();
+	std::to_chars_result res = std::to_chars(pos, m_block.get() + BLOCK_SIZE, val);
+	m_pos = static_cast<size_t>(res.ptr - m_block.get());
+	return *this;
+}
+
+TextWriter& TextWriter::writeUnsigned(unsigned long long val, int base)
+{
+	char* pos = reserve();
+	std::to_chars_result res = std::to_chars(pos, m_block.get() + BLOCK_SIZE, val, base);
+	m_pos = static_cast<size_t>(res.ptr - m_block.get());
+	return *this;
+}
+
+#if defined(__cpp_lib_to_chars)
+
+template <typename T>
+static char* formatFloatImpl(char* pos, char* end, T val, TextWriter::FloatFormat format, int precision)
+{
+	std::to_chars_result res;
+
+	switch (format)
+	{
+	case TextWriter::FLOAT_FIXED:
+		res = std::to_chars(pos, end, val, std::chars_format::fixed, precision);
+		break;
+	case TextWriter::FLOAT_SHORTEST:
+		res = std::to_chars(pos, end, val);
+		break;
+	default:
+		res = std::to_chars(pos, end, val, std::chars_format::general, precision);
+	}
+
+	return res.ptr;
+}
+
+#else
+
+// Standard libraries w/o floating point to_chars: fall back to a classic
+// locale stream, which is what the writers used before.
+template <typename T>
+static char* formatFloatImpl(char* pos, char* end, T val, TextWriter::FloatFormat format, int precision)
+{
+	std::ostringstream ss;
+	ss.imbue(std::locale::classic());
+
+	switch (format)
+	{
+	case TextWriter::FLOAT_FIXED:
+		ss << std::fixed;
+		ss.precision(precision);
+		break;
+	case TextWriter::FLOAT_SHORTEST:
+		ss.precision(std::numeric_limits<T>::max_digits10);
+		break;
+	default:
+		ss.precision(precision);
+	}
+	ss << val;
+
+	const std::string str = ss.str();
+	const size_t len = std::min(str.size(), static_cast<size_t>(end - pos));
+	memcpy(pos, str.data(), len);
+	return pos + len;
+}
+
+#endif
+
+TextWriter& TextWriter::writeFloat(float val)
+{
+	char* pos = reserve();
+	m_pos = static_cast<size_t>(formatFloatImpl(pos, m_block.get() + BLOCK_SIZE, val, m_floatFormat, m_precision) -
+				    m_block.get());
+	return *this;
+}
+
+TextWriter& TextWriter::writeFloat(double val)
+{
+	char* pos = reserve();
+	m_pos = static_cast<size_t>(formatFloatImpl(pos, m_block.get() + BLOCK_SIZE, val, m_floatFormat, m_precision) -
+				    m_block.get());
+	return *this;
+}
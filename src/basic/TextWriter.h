@@ -0,0 +1,122 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTWRITER_HPP
+#define TEXTWRITER_HPP
+
+#include <cstddef>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+/*
+  Buffered text emitter, the output counterpart of TextReader.
+
+  Implements the subset of std::ostream insertion used by the text
+  format writers. Numbers are formatted with std::to_chars straight into
+  a reusable block which is handed to the stream when full, so there are
+  no locale lookups and no allocations per value. The default float
+  format is the one of a fresh std::ostream ("%g", 6 digits), which keeps
+  the output byte identical to the stream based writers.
+  */
+class TextWriter
+{
+public:
+	enum FloatFormat
+	{
+		FLOAT_GENERAL,	// like "%.*g", the std::ostream default
+		FLOAT_FIXED,	// like "%.*f", the std::ostream std::fixed mode
+		FLOAT_SHORTEST	// shortest text that reads back to the same value, precision is ignored
+	};
+
+	explicit TextWriter(std::ostream& out);
+	~TextWriter();
+
+	TextWriter(const TextWriter&) = delete;
+	TextWriter& operator=(const TextWriter&) = delete;
+
+	// Precision is clamped to [0, 100]
+	void setFloatFormat(FloatFormat format, int precision = 6);
+	FloatFormat floatFormat() const {return m_floatFormat;}
+	int floatPrecision() const {return m_precision;}
+
+	// Hands the buffered text to the stream
+	void flush();
+	bool good() const {return m_out.good();}
+
+	// Hexadecimal unsigned integer, like "out << std::hex << val << std::dec"
+	TextWriter& writeHex(unsigned long long val);
+
+	TextWriter& operator<<(char c)
+	{
+		if (m_pos == BLOCK_SIZE)
+			flushBlock();
+		m_block[m_pos++] = c;
+		return *this;
+	}
+
+	TextWriter& operator<<(std::string_view str);
+	TextWriter& operator<<(const char* str) {return *this << std::string_view(str);}
+	TextWriter& operator<<(const std::string& str) {return *this << std::string_view(str);}
+
+	// Same as std::noboolalpha
+	TextWriter& operator<<(bool val) {return *this << (val ? '1' : '0');}
+
+	TextWriter& operator<<(float val) {return writeFloat(val);}
+	TextWriter& operator<<(double val) {return writeFloat(val);}
+
+	// Single byte integers are characters for streams, those are left out on purpose
+	template <typename T>
+	typename std::enable_if<std::is_integral<T>::value && (sizeof(T) > 1), TextWriter&>::type
+	operator<<(T val)
+	{
+		if (std::is_signed<T>::value)
+			return writeSigned(static_cast<long long>(val));
+		return writeUnsigned(static_cast<unsigned long long>(val), 10);
+	}
+
+private:
+	// Every number fits when at least this much room is left in the block
+	static const size_t MAX_NUMBER_CHARS = 512;
+	static const size_t BLOCK_SIZE = 64 * 1024;
+
+	void flushBlock();
+
+	TextWriter& writeSigned(long long val);
+	TextWriter& writeUnsigned(unsigned long long val, int base);
+	TextWriter& writeFloat(float val);
+	TextWriter& writeFloat(double val);
+
+	char* reserve()
+	{
+		if (BLOCK_SIZE - m_pos < MAX_NUMBER_CHARS)
+			flushBlock();
+		return m_block.get() + m_pos;
+	}
+
+	std::ostream& m_out;
+	std::unique_ptr<char[]> m_block;
+	size_t m_pos;
+	FloatFormat m_floatFormat;
+	int m_precision;
+};
+
+#endif // TEXTWRITER_HPP
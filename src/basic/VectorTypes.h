@@ -20,6 +20,8 @@
 #define VERTEXTYPES_HPP
 
 #include "Vector.h"
+#include "TextReader.h"
+#include "TextWriter.h"
 #include <iostream>
 
 template <typename T, size_t COMPONENTS = 2>
@@ -176,11 +178,23 @@ std::istream& operator>> (std::istream& in, Vertex<T>& ver)
     return in;
 }
 template <typename T>
+TextReader& operator>> (TextReader& in, Vertex<T>& ver)
+{
+    in >> ver.x() >> ver.y() >> ver.z();
+    return in;
+}
+template <typename T>
 std::ostream& operator<< (std::ostream& out, const Vertex<T>& ver)
 {
     out << ver.x() << ' ' << ver.y() << ' ' << ver.z() << ' ';
     return out;
 }
+template <typename T>
+TextWriter& operator<< (TextWriter& out, const Vertex<T>& ver)
+{
+    out << ver.x() << ' ' << ver.y() << ' ' << ver.z() << ' ';
+    return out;
+}
 
 template <typename T, size_t COMPONENTS = 4>
 struct Vertex4 : public Vector<T, COMPONENTS>
@@ -0,0 +1,253 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VERTEXWELDER_HPP
+#define VERTEXWELDER_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/*
+  Hash grid over point positions, for finding earlier points within an
+  epsilon of a position in O(1) amortized time.
+
+  Positions are quantized to cells a few epsilons wide and each cell keeps
+  a chain of the points added to it. A lookup only visits the cells the
+  epsilon box around the position overlaps; the caller owns the points and
+  decides which of those candidates actually match.
+  */
+template <typename V>
+class PositionHashGrid
+{
+public:
+	static constexpr unsigned npos = ~0u;
+
+	explicit PositionHashGrid(float eps = 0.0001f);
+
+	void reserve(size_t points);
+	void clear();
+
+	// Smallest index added near pos for which match(index) holds, or npos
+	template <typename F>
+	unsigned findFirst(const V& pos, F match) const;
+
+	// Indices have to be added in increasing order
+	void add(const V& pos, unsigned index);
+
+private:
+	// Cells are this many epsilons wide, so most lookups stay in one cell
+	static constexpr int CELL_EPS = 8;
+
+	struct Cell
+	{
+		int64_t x, y, z;
+		bool operator==(const Cell& rhs) const {return x == rhs.x && y == rhs.y && z == rhs.z;}
+	};
+
+	struct CellHash
+	{
+		size_t operator()(const Cell& c) const
+		{
+			uint64_t h = static_cast<uint64_t>(c.x) * 0x9E3779B97F4A7C15ULL;
+			h ^= static_cast<uint64_t>(c.y) * 0xC2B2AE3D27D4EB4FULL + (h << 6) + (h >> 2);
+			h ^= static_cast<uint64_t>(c.z) * 0x165667B19E3779F9ULL + (h << 6) + (h >> 2);
+			return static_cast<size_t>(h ^ (h >> 29));
+		}
+	};
+
+	int64_t cellOf(double val) const {return static_cast<int64_t>(std::floor(val * m_invCell));}
+	bool isGridded(const V& pos) const;
+
+	double m_searchRadius;
+	double m_invCell;
+
+	std::unordered_map<Cell, unsigned, CellHash> m_cells; // most recent point of each cell
+	std::vector<unsigned> m_next; // previous point added to the same cell
+};
+
+/*
+  Welds (position, uv, normal) points that are equal within an epsilon,
+  component-wise, on all three attributes - the criterion the std::set
+  based welding with compareWZMPoint_less_wEps used to apply.
+  When several previously added points match, the earliest one wins.
+  */
+template <typename V, typename U>
+class VertexWelder
+{
+public:
+	static constexpr unsigned npos = ~0u;
+
+	VertexWelder(float vertEps = 0.0001f, float uvEps = 0.0001f);
+
+	void reserve(size_t points);
+	void clear();
+
+	size_t size() const {return m_points.size();}
+
+	// Index of the first added point matching all three attributes, or npos
+	unsigned find(const V& pos, const U& uv, const V& nrm) const;
+
+	// Returns the index of the matching point, adding it if there is none
+	unsigned insert(const V& pos, const U& uv, const V& nrm, bool& inserted);
+
+private:
+	struct Point
+	{
+		V pos;
+		U uv;
+		V nrm;
+	};
+
+	typename V::equal_wEps m_vertEq;
+	typename U::equal_wEps m_uvEq;
+
+	PositionHashGrid<V> m_grid;
+	std::vector<Point> m_points;
+};
+
+template <typename V>
+PositionHashGrid<V>::PositionHashGrid(float eps):
+	// some slack so float rounding can't hide a neighbouring cell
+	m_searchRadius(eps * 1.5),
+	m_invCell(1.0 / (static_cast<double>(eps) * CELL_EPS))
+{
+}
+
+template <typename V>
+void PositionHashGrid<V>::reserve(size_t points)
+{
+	m_next.reserve(points);
+	m_cells.reserve(points);
+}
+
+template <typename V>
+void PositionHashGrid<V>::clear()
+{
+	m_next.clear();
+	m_cells.clear();
+}
+
+template <typename V>
+bool PositionHashGrid<V>::isGridded(const V& pos) const
+{
+	// NaN/inf never compare equal within epsilon, and can't be quantized
+	return std::isfinite(pos.x()) && std::isfinite(pos.y()) && std::isfinite(pos.z())
+		&& std::abs(pos.x() * m_invCell) < 1e15 && std::abs(pos.y() * m_invCell) < 1e15
+		&& std::abs(pos.z() * m_invCell) < 1e15;
+}
+
+template <typename V>
+template <typename F>
+unsigned PositionHashGrid<V>::findFirst(const V& pos, F match) const
+{
+	unsigned found = npos;
+	Cell c;
+
+	if (!isGridded(pos))
+		return npos;
+
+	const int64_t x0 = cellOf(pos.x() - m_searchRadius), x1 = cellOf(pos.x() + m_searchRadius);
+	const int64_t y0 = cellOf(pos.y() - m_searchRadius), y1 = cellOf(pos.y() + m_searchRadius);
+	const int64_t z0 = cellOf(pos.z() - m_searchRadius), z1 = cellOf(pos.z() + m_searchRadius);
+
+	for (c.x = x0; c.x <= x1; ++c.x)
+	{
+		for (c.y = y0; c.y <= y1; ++c.y)
+		{
+			for (c.z = z0; c.z <= z1; ++c.z)
+			{
+				auto it = m_cells.find(c);
+				if (it == m_cells.end())
+					continue;
+
+				// Chains run from the newest to the oldest point
+				for (unsigned i = it->second; i != npos && (found == npos || i < found); i = m_next[i])
+				{
+					if (match(i))
+						found = i;
+				}
+			}
+		}
+	}
+	return found;
+}
+
+template <typename V>
+void PositionHashGrid<V>::add(const V& pos, unsigned index)
+{
+	m_next.resize(index + 1, npos);
+
+	if (isGridded(pos))
+	{
+		auto cell = m_cells.emplace(Cell{cellOf(pos.x()), cellOf(pos.y()), cellOf(pos.z())}, index);
+		if (!cell.second)
+		{
+			m_next[index] = cell.first->second;
+			cell.first->second = index;
+		}
+	}
+}
+
+template <typename V, typename U>
+VertexWelder<V, U>::VertexWelder(float vertEps, float uvEps):
+	m_vertEq(vertEps), m_uvEq(uvEps), m_grid(vertEps)
+{
+}
+
+template <typename V, typename U>
+void VertexWelder<V, U>::reserve(size_t points)
+{
+	m_points.reserve(points);
+	m_grid.reserve(points);
+}
+
+template <typename V, typename U>
+void VertexWelder<V, U>::clear()
+{
+	m_points.clear();
+	m_grid.clear();
+}
+
+template <typename V, typename U>
+unsigned VertexWelder<V, U>::find(const V& pos, const U& uv, const V& nrm) const
+{
+	return m_grid.findFirst(pos, [&](unsigned i)
+	{
+		const Point& p = m_points[i];
+		return m_vertEq(p.pos, pos) && m_uvEq(p.uv, uv) && m_vertEq(p.nrm, nrm);
+	});
+}
+
+template <typename V, typename U>
+unsigned VertexWelder<V, U>::insert(const V& pos, const U& uv, const V& nrm, bool& inserted)
+{
+	unsigned index = find(pos, uv, nrm);
+
+	inserted = index == npos;
+	if (!inserted)
+		return index;
+
+	index = static_cast<unsigned>(m_points.size());
+	m_points.push_back({pos, uv, nrm});
+	m_grid.add(pos, index);
+	return index;
+}
+
+#endif // VERTEXWELDER_HPP
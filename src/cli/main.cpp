@@ -0,0 +1,53 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  wmit-cli: the command line conversion modes of WMIT, linked against
+  wmit_core only (no Qt GUI, OpenGL or QGLViewer).
+  */
+
+#include <cstring>
+#include <iostream>
+
+#include "CommandLine.h"
+
+int main(int argc, char *argv[])
+{
+	const ModelCacheMode cacheMode = takeCacheModeArgs(argc, argv);
+
+	if (argc == 2 && strcmp("--help", argv[1]) == 0)
+	{
+		printWelcomeBanner(true);
+		printCommandLineHelp(false);
+		return 0;
+	}
+
+	if (argc > 1 && isBatchConversionArg(argv[1]))
+	{
+		return runBatchConversion(argc, argv, cacheMode);
+	}
+
+	if (argc == 3)
+	{
+		return runConversion(argv[1], argv[2], cacheMode);
+	}
+
+	std::cerr << "Expected [input] [output] or --batch/--batch-manifest, see --help." << std::endl;
+	return 1;
+}
@@ -19,14 +19,13 @@
 
 #include "Mesh.h"
 
-#include "mikktspace.h"
-
 #include <algorithm>
+#include <atomic>
 #include <functional>
 #include <iterator>
+#include <limits>
 #include <map>
 #include <set>
-#include <tuple>
 
 #include <sstream>
 
@@ -34,56 +33,16 @@
 #include "Util.h"
 #include "Pie.h"
 #include "Vector.h"
+#include "VertexWelder.h"
+#include "TangentSpace.h"
 #include "Mesh.h"
 
-typedef std::tuple<WZMVertex, WZMUV, WZMVertex> WZMPoint;
+typedef VertexWelder<WZMVertex, WZMUV> WZMVertexWelder;
 
 // Scale animation numbers from int to float
 #define INT_SCALE       1000
 static const float FROM_INT_SCALE = 0.001f;
 
-struct compareWZMPoint_less_wEps
-{
-	using first_argument_type  = WZMPoint&;
-	using second_argument_type = WZMPoint&;
-	using result_type          = bool;
-
-	const WZMVertex::less_wEps vertLess;
-	const WZMUV::less_wEps uvLess;
-	const WZMVertex::equal_wEps vertEq;
-	const WZMUV::equal_wEps uvEq;
-
-public:
-	compareWZMPoint_less_wEps(float vertEps = 0.0001f, float uvEps = 0.0001f):
-		vertLess(vertEps), uvLess(uvEps), vertEq(vertEps), uvEq(uvEps) {}
-
-	bool operator() (const WZMPoint& lhs, const WZMPoint& rhs) const
-	{
-		if (vertLess(std::get<0>(lhs), std::get<0>(rhs)))
-		{
-			return true;
-		}
-		else
-		{
-			if (vertEq(std::get<0>(lhs), std::get<0>(rhs)))
-			{
-				if (uvLess(std::get<1>(lhs), std::get<1>(rhs)))
-				{
-					return true;
-				}
-				else
-				{
-					if (uvEq(std::get<1>(lhs), std::get<1>(rhs)))
-					{
-						return vertLess(std::get<2>(lhs), std::get<2>(rhs));
-					}
-				}
-			}
-		}
-		return false;
-	}
-};
-
 WZMConnector::WZMConnector(GLfloat x, GLfloat y, GLfloat z):
 	m_pos(x, y, z)
 {
@@ -109,20 +68,18 @@ Mesh::Mesh()
 	clear();
 }
 
-Mesh::Mesh(const Pie3Level& p3)
+Mesh::Mesh(const Pie3Level& p3, unsigned threads)
 {
-	std::vector<Pie3Polygon>::const_iterator itL;
-
-	typedef std::set<WZMPoint, compareWZMPoint_less_wEps> t_tupleSet;
-	t_tupleSet tupleSet;
-	std::pair<t_tupleSet::iterator, bool> inResult;
+	const Pie3Polygons& polygons = p3.m_polygons;
+	size_t poly;
 
-	std::vector<int> mapping;
-	std::vector<int>::iterator itMap;
+	WZMVertexWelder welder;
+	bool inserted;
 
 	IndexedTri iTri;
 	TexAnimData texAnim;
 	WZMVertex tmpNrm;
+	WZMUV tmpUv;
 	WZMVertex v[3];
 
 	auto nrmIt = p3.m_normals.begin();
@@ -140,40 +97,50 @@ Mesh::Mesh(const Pie3Level& p3)
 	 */
 
 	reservePoints(p3.m_points.size());
-	reserveIndices(p3.m_polygons.size());
+	reserveIndices(polygons.size());
+	welder.reserve(p3.m_points.size());
 
-	itL = p3.m_polygons.begin();
-	hasTexAnim = (itL != p3.m_polygons.end()) && (itL->m_flags & 0x4000);
+	hasTexAnim = !polygons.empty() && (polygons.getFlags(0) & 0x4000);
 	if (hasTexAnim)
 	{
-		m_texAnimFrames = itL->m_frames;
-		m_texAnimPlaybackRate = itL->m_playbackRate;
-		reserveTexAnimation(p3.m_polygons.size());
+		m_texAnimFrames = polygons.getTexAnim(0).frames;
+		m_texAnimPlaybackRate = polygons.getTexAnim(0).playbackRate;
+		reserveTexAnimation(polygons.size());
 	}
 
 	// For each pie3 polygon
-	for (; itL != p3.m_polygons.end(); ++itL)
+	for (poly = 0; poly < polygons.size(); ++poly)
 	{
+		// Broken polygon, the fields below would belong to the next one
+		if (polygons.vertices(poly) < 3)
+		{
+			if (!noPieNormals)
+				nrmIt += 3;
+			continue;
+		}
+
 		// Presumably those issues are no longer present in newer models.
 		// N.B. Make sure to advance normals when skipping with normals present
 		if (noPieNormals)
 		{
 			// pie2 integer-type problem?
-			if (itL->getIndex(0) == itL->getIndex(1) || itL->getIndex(1) == itL->getIndex(2) ||
-					itL->getIndex(0) == itL->getIndex(2))
+			if (polygons.getIndex(poly, 0) == polygons.getIndex(poly, 1) ||
+					polygons.getIndex(poly, 1) == polygons.getIndex(poly, 2) ||
+					polygons.getIndex(poly, 0) == polygons.getIndex(poly, 2))
 			{
 				continue;
 			}
-			if (itL->m_texCoords[0] == itL->m_texCoords[1] || itL->m_texCoords[1] == itL->m_texCoords[2] ||
-					itL->m_texCoords[0] == itL->m_texCoords[2])
+			if (polygons.getUV(poly, 0) == polygons.getUV(poly, 1) ||
+					polygons.getUV(poly, 1) == polygons.getUV(poly, 2) ||
+					polygons.getUV(poly, 0) == polygons.getUV(poly, 2))
 			{
 				continue;
 			}
 		}
 
-		v[0] = WZMVertex(p3.m_points[itL->getIndex(0)]);
-		v[1] = WZMVertex(p3.m_points[itL->getIndex(1)]);
-		v[2] = WZMVertex(p3.m_points[itL->getIndex(2)]);
+		v[0] = WZMVertex(p3.m_points[polygons.getIndex(poly, 0)]);
+		v[1] = WZMVertex(p3.m_points[polygons.getIndex(poly, 1)]);
+		v[2] = WZMVertex(p3.m_points[polygons.getIndex(poly, 2)]);
 
 		if (noPieNormals)
 			tmpNrm = WZMVertex(v[1] - v[0]).crossProduct(v[2] - v[0]).normalize();
@@ -184,30 +151,20 @@ Mesh::Mesh(const Pie3Level& p3)
 			if (p3.normals() != 0)
 				tmpNrm = *nrmIt++;
 
-			inResult = tupleSet.insert(WZMPoint(v[i], itL->getUV(i, 0), tmpNrm));
+			tmpUv = polygons.getUV(poly, i, 0);
 
-			t_tupleSet::difference_type dist = std::distance(tupleSet.begin(), inResult.first);
-
-			if (!inResult.second)
+			// Welder indices match ours, as every new point is added right away
+			iTri[i] = static_cast<IndexedTri::indexType>(welder.insert(v[i], tmpUv, tmpNrm, inserted));
+			if (inserted)
 			{
-				iTri[i] = static_cast<GLushort>(mapping[static_cast<size_t>(dist)]);
-			}
-			else
-			{
-				itMap = mapping.begin();
-				std::advance(itMap, dist);
-				mapping.insert(itMap, static_cast<int>(vertices()));
-				iTri[i] = static_cast<GLushort>(vertices());
-
-				const WZMPoint& curPoint(*inResult.first);
-				addPoint(std::get<0>(curPoint), std::get<1>(curPoint), std::get<2>(curPoint));
+				addPoint(v[i], tmpUv, tmpNrm);
 			}
 		}
 		addIndices(iTri);
 		if (hasTexAnim)
 		{
-			texAnim.width = itL->m_width;
-			texAnim.height = itL->m_height;
+			texAnim.width = polygons.getTexAnim(poly).width;
+			texAnim.height = polygons.getTexAnim(poly).height;
 			m_texAnimArray.emplace_back(texAnim);
 		}
 	}
@@ -227,7 +184,7 @@ Mesh::Mesh(const Pie3Level& p3)
 	// Anim object
 	importPieAnimation(p3.m_animobj);
 
-	finishImport();
+	finishImport(threads);
 }
 
 Mesh::~Mesh()
@@ -243,7 +200,6 @@ Mesh::operator Pie3Level() const
 {
 	Pie3Level p3;
 
-	std::vector<Pie3Vertex>::iterator itPV;
 	std::vector<TexAnimData>::const_iterator itTexAni;
 	std::vector<IndexedTri>::const_iterator itTri;
 
@@ -255,21 +211,30 @@ Mesh::operator Pie3Level() const
 	 */
 
 	IndexedTri tri;
-	Pie3Polygon p3Poly;
+	unsigned p3Indices[3];
+	Pie3UV p3TexCoords[3];
+	uint32_t p3Flags;
+	Pie3Polygons::TexAnim p3Anim = {0, 0, 0, 0};
 	Pie3UV	p3UV;
 	WZMVertex fixedVert;
-	typedef Pie3Vertex::equal_wEps equals;
+	const Pie3Vertex::equal_wEps equals(0.0001f);
+	PositionHashGrid<WZMVertex> pointGrid;
+	unsigned found;
 
-	p3Poly.m_flags = 0x200;
+	p3Flags = 0x200;
 	if (m_texAnimFrames > 0)
 	{
-		p3Poly.m_flags |= 0x4000;
-		p3Poly.m_frames = m_texAnimFrames;
-		p3Poly.m_playbackRate = m_texAnimPlaybackRate;
+		p3Flags |= 0x4000;
+		p3Anim.frames = m_texAnimFrames;
+		p3Anim.playbackRate = m_texAnimPlaybackRate;
 	}
 
 	itTexAni = m_texAnimArray.begin();
 
+	p3.m_polygons.reserve(m_indexArray.size(), m_indexArray.size() * 3);
+	p3.m_normals.reserve(m_indexArray.size() * 3);
+	pointGrid.reserve(m_vertexArray.size());
+
 	for (itTri = m_indexArray.begin(); itTri != m_indexArray.end(); ++itTri)
 	{
 		tri = *itTri;
@@ -277,35 +242,39 @@ Mesh::operator Pie3Level() const
 		{
 			auto curIndex = tri[i];
 			fixedVert = m_vertexArray[curIndex];
-			mybinder1st<equals> compare(fixedVert, equals(0.0001f));
 
-			itPV = std::find_if(p3.m_points.begin(), p3.m_points.end(), compare);
+			// First point within epsilon, same as a linear search would find
+			found = pointGrid.findFirst(fixedVert, [&](unsigned idx)
+			{
+				return equals(fixedVert, p3.m_points[idx]);
+			});
 
-			if (itPV == p3.m_points.end())
+			if (found == pointGrid.npos)
 			{
 				// add it now
-				p3Poly.m_indices[i] = p3.m_points.size();
+				p3Indices[i] = static_cast<unsigned>(p3.m_points.size());
+				pointGrid.add(fixedVert, p3.m_points.size());
 				p3.m_points.push_back(fixedVert);
 			}
 			else
 			{
-				p3Poly.m_indices[i] = std::distance(p3.m_points.begin(), itPV);
+				p3Indices[i] = found;
 			}
 
 			p3UV.u() = m_textureArray[curIndex].u();
 			p3UV.v() = m_textureArray[curIndex].v();
-			p3Poly.m_texCoords[i] = p3UV;
+			p3TexCoords[i] = p3UV;
 
 			p3.m_normals.push_back(m_normalArray[curIndex]);
 		}
 
 		if (m_texAnimFrames > 0)
 		{
-			p3Poly.m_width = itTexAni->width;
-			p3Poly.m_height = itTexAni->height;
+			p3Anim.width = itTexAni->width;
+			p3Anim.height = itTexAni->height;
 			++itTexAni;
 		}
-		p3.m_polygons.push_back(p3Poly);
+		p3.m_polygons.add(p3Flags, 3, p3Indices, p3TexCoords, p3Anim);
 	}
 
 	std::list<WZMConnector>::const_iterator itC;
@@ -481,6 +450,7 @@ bool Mesh::read(std::istream& in)
 		}
 		m_indexArray.push_back(tri);
 	}
+	touch();
 
 	in >> str >> i;
 	if (in.fail() || str.compare(WZM_MESH_DIRECTIVE_CONNECTORS) != 0)
@@ -506,16 +476,16 @@ bool Mesh::read(std::istream& in)
 	}
 
 	recalculateBoundData();
+	touch();
 
 	return true;
 }
 
-void Mesh::write(std::ostream &out) const
+void Mesh::write(TextWriter &out) const
 {
 	out << WZM_MESH_SIGNATURE << ' ' << (m_name.empty() ? "_noname_" : m_name ) << '\n';
 
-	// noboolalpha should be default...
-	out << WZM_MESH_DIRECTIVE_TEAMCOLOURS << " " << std::noboolalpha << teamColours() << '\n';
+	out << WZM_MESH_DIRECTIVE_TEAMCOLOURS << " " << teamColours() << '\n';
 
 	out << WZM_MESH_DIRECTIVE_MINMAXTSCEN << " "
 	    << m_mesh_aabb_min.x() << ' ' << m_mesh_aabb_min.y() << ' ' << m_mesh_aabb_min.z() << ' '
@@ -557,20 +527,17 @@ void Mesh::write(std::ostream &out) const
 	}
 }
 
-bool Mesh::importFromOBJ(const std::vector<OBJTri>&	faces,
+bool Mesh::importFromOBJ(std::vector<OBJTri>::const_iterator first,
+			 std::vector<OBJTri>::const_iterator last,
 			 const std::vector<OBJVertex>&  verts,
 			 const std::vector<OBJUV>&	uvArray,
 			 const std::vector<OBJVertex>&  normals,
-			 bool welder)
+			 bool welder, unsigned threads)
 {
-	typedef std::set<WZMPoint, compareWZMPoint_less_wEps> t_tupleSet;
-	t_tupleSet tupleSet;
+	WZMVertexWelder vertWelder;
+	bool inserted;
 
 	std::vector<OBJTri>::const_iterator itFaces;
-	std::pair<t_tupleSet::iterator, bool> inResult;
-
-	std::vector<unsigned> mapping;
-	std::vector<unsigned>::iterator itMap;
 
 	unsigned int i;
 
@@ -580,10 +547,17 @@ bool Mesh::importFromOBJ(const std::vector<OBJTri>&	faces,
 
 	clear();
 
-	reservePoints(verts.size());
-	reserveIndices(faces.size());
+	// Every face adds 3 points unless welded; the arrays are shared by all
+	// objects, so their size is only a cap for the welded case
+	const size_t faceCount = static_cast<size_t>(std::distance(first, last));
+	const unsigned maxPoints = static_cast<unsigned>(welder ? std::min(verts.size(), faceCount * 3) : faceCount * 3);
+
+	reservePoints(maxPoints);
+	reserveIndices(static_cast<unsigned>(faceCount));
+	if (welder)
+		vertWelder.reserve(maxPoints);
 
-	for (itFaces = faces.begin(); itFaces != faces.end(); ++itFaces)
+	for (itFaces = first; itFaces != last; ++itFaces)
 	{
 		for (i = 0; i < 3; ++i)
 		{
@@ -604,21 +578,12 @@ bool Mesh::importFromOBJ(const std::vector<OBJTri>&	faces,
 
 			if (welder)
 			{
-				inResult = tupleSet.insert(WZMPoint(verts[itFaces->tri[i]-1], tmpUv, tmpNrm));
+				const WZMVertex& pos = verts[itFaces->tri[i]-1];
 
-				if (!inResult.second)
+				tmpTri[i] = vertWelder.insert(pos, tmpUv, tmpNrm, inserted);
+				if (inserted)
 				{
-					tmpTri[i] = mapping[std::distance(tupleSet.begin(), inResult.first)];
-				}
-				else
-				{
-					itMap = mapping.begin();
-					std::advance(itMap, std::distance(tupleSet.begin(), inResult.first));
-					mapping.insert(itMap, vertices());
-					tmpTri[i] = vertices();
-
-					const WZMPoint& curPoint(*inResult.first);
-					addPoint(std::get<0>(curPoint), std::get<1>(curPoint), std::get<2>(curPoint));
+					addPoint(pos, tmpUv, tmpNrm);
 				}
 			}
 			else
@@ -630,94 +595,73 @@ bool Mesh::importFromOBJ(const std::vector<OBJTri>&	faces,
 		addIndices(tmpTri);
 	}
 
-	finishImport();
+	finishImport(threads);
 
 	return true;
 }
 
-std::stringstream* Mesh::exportToOBJ(const Mesh_exportToOBJ_InOutParams& params) const
+void Mesh::indexForOBJ(OBJExportTables& tables, std::vector<OBJPointIndex>& pointIndices) const
 {
 	const bool invertV = true;
-	std::stringstream* out = new std::stringstream;
-
-	std::pair<std::set<OBJVertex, OBJVertex::less_wEps>::iterator, bool> vertInResult;
-	std::pair<std::set<OBJUV, OBJUV::less_wEps>::iterator, bool> uvInResult;
-	std::pair<std::set<OBJVertex, OBJVertex::less_wEps>::iterator, bool> normInResult;
 
 	std::vector<IndexedTri>::const_iterator itF;
-	std::vector<unsigned>::iterator itMap;
-	unsigned i;
+	unsigned i, point;
 
+	OBJVertex vert, norm;
 	OBJUV uv;
 
-	*out << "o " << m_name << "\n";
+	pointIndices.assign(vertices(), OBJPointIndex{0, 0, 0});
 
+	// Visit the points in the order the faces are written,
+	// so the tables come out the same as with a per corner lookup
 	for (itF = m_indexArray.begin(); itF != m_indexArray.end(); ++itF)
 	{
-		*out << "f";
-
 		for (i = 0; i < 3; ++i)
 		{
-			*out << ' ';
-
-			vertInResult = params.vertSet->insert(m_vertexArray[itF->operator [](i)]);
-
-			if (!vertInResult.second)
-			{
-				*out << (*params.vertMapping)[std::distance(params.vertSet->begin(), vertInResult.first)] + 1;
-			}
-			else
+			point = itF->operator [](i == 0 ? 0 : 3 - i);
+			if (pointIndices[point].v != 0)
 			{
-				itMap = params.vertMapping->begin();
-				std::advance(itMap, std::distance(params.vertSet->begin(), vertInResult.first));
-				params.vertMapping->insert(itMap, params.vertices->size());
-				params.vertices->push_back(m_vertexArray[itF->operator [](i)]);
-				*out << params.vertices->size();
+				continue;
 			}
 
-			*out << '/';
+			// mirrorFromPoint(WZMVertex(), 0), which never yields -0
+			vert = m_vertexArray[point];
+			vert.x() = 0.f - vert.x();
+			pointIndices[point].v = tables.addVertex(vert);
 
-			uv = m_textureArray[itF->operator [](i)];
+			uv = m_textureArray[point];
 			if (invertV)
 			{
 				uv.v() = 1 - uv.v();
 			}
-			uvInResult = params.uvSet->insert(uv);
+			pointIndices[point].vt = tables.addUV(uv);
 
-			if (!uvInResult.second)
-			{
-				*out << (*params.uvMapping)[std::distance(params.uvSet->begin(), uvInResult.first)] + 1;
-			}
-			else
-			{
-				itMap = params.uvMapping->begin();
-				std::advance(itMap, std::distance(params.uvSet->begin(), uvInResult.first));
-				params.uvMapping->insert(itMap, params.uvs->size());
-				params.uvs->push_back(uv);
-				*out << params.uvs->size();
-			}
+			norm = m_normalArray[point];
+			norm.x() = -norm.x();
+			pointIndices[point].vn = tables.addNormal(norm);
+		}
+	}
+}
 
-			*out << '/';
+void Mesh::writeOBJFaces(TextWriter& out, const std::vector<OBJPointIndex>& pointIndices) const
+{
+	std::vector<IndexedTri>::const_iterator itF;
+	unsigned i;
 
-			normInResult = params.normSet->insert(m_normalArray[itF->operator [](i)]);
+	out << "o " << m_name << "\n";
 
-			if (!normInResult.second)
-			{
-				*out << (*params.normMapping)[std::distance(params.normSet->begin(), normInResult.first)] + 1;
-			}
-			else
-			{
-				itMap = params.normMapping->begin();
-				std::advance(itMap, std::distance(params.normSet->begin(), normInResult.first));
-				params.normMapping->insert(itMap, params.normals->size());
-				params.normals->push_back(m_normalArray[itF->operator [](i)]);
-				*out << params.normals->size();
-			}
+	for (itF = m_indexArray.begin(); itF != m_indexArray.end(); ++itF)
+	{
+		out << "f";
+
+		// reversed winding: a, c, b
+		for (i = 0; i < 3; ++i)
+		{
+			const OBJPointIndex& point = pointIndices[itF->operator [](i == 0 ? 0 : 3 - i)];
+			out << ' ' << point.v << '/' << point.vt << '/' << point.vn;
 		}
-		*out << '\n';
+		out << '\n';
 	}
-
-	return out;
 }
 
 std::string Mesh::getName() const
@@ -757,9 +701,16 @@ WZMConnector &Mesh::getConnector(int index)
 	return *pos;
 }
 
+void Mesh::setConnectorPos(int index, const WZMVertex& pos)
+{
+	getConnector(index).getPos() = pos;
+	touch();
+}
+
 void Mesh::addConnector (const WZMConnector& conn)
 {
 	m_connectors.push_back(conn);
+	touch();
 }
 
 void Mesh::rmConnector (int index)
@@ -772,6 +723,7 @@ void Mesh::rmConnector (int index)
 		return;
 	}
 	m_connectors.erase(pos);
+	touch();
 }
 
 size_t Mesh::connectors() const
@@ -784,6 +736,7 @@ void Mesh::replaceConnectors(const Mesh &fromMesh)
 	m_connectors.clear();
 	for (const auto& curConn: fromMesh.m_connectors)
 		m_connectors.push_back(curConn);
+	touch();
 }
 
 size_t Mesh::vertices() const
@@ -801,6 +754,43 @@ size_t Mesh::indices() const
 	return m_indexArray.size();
 }
 
+GLenum Mesh::drawIndexType() const
+{
+	return vertices() <= std::numeric_limits<GLushort>::max() ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+const GLvoid* Mesh::drawIndexData() const
+{
+	static_assert(sizeof(IndexedTri) == sizeof(GLuint)*3, "IndexedTri has become fat.");
+
+	if (m_indexArray.empty())
+		return nullptr;
+
+	if (drawIndexType() == GL_UNSIGNED_INT)
+		return &m_indexArray[0];
+
+	if (m_drawIndexGeneration != m_generation)
+	{
+		m_drawIndexArray.clear();
+		m_drawIndexArray.reserve(m_indexArray.size() * 3);
+		for (const IndexedTri& tri : m_indexArray)
+		{
+			m_drawIndexArray.push_back(static_cast<GLushort>(tri.a()));
+			m_drawIndexArray.push_back(static_cast<GLushort>(tri.b()));
+			m_drawIndexArray.push_back(static_cast<GLushort>(tri.c()));
+		}
+		m_drawIndexGeneration = m_generation;
+	}
+	return &m_drawIndexArray[0];
+}
+
+void Mesh::touch()
+{
+	// Shared by all meshes, so a mesh replaced by another one never looks unchanged
+	static std::atomic<unsigned long long> lastGeneration(0);
+	m_generation = ++lastGeneration;
+}
+
 bool Mesh::isValid() const
 {
 	// TODO: check m_frameArray, m_connectors
@@ -843,6 +833,9 @@ void Mesh::clear()
 	m_tangentArray.clear();
 	m_bitangentArray.clear();
 	m_indexArray.clear();
+	m_drawIndexArray.clear();
+	m_drawIndexGeneration = 0;
+	touch();
 
 	m_connectors.clear();
 	m_teamColours = false;
@@ -888,81 +881,20 @@ void Mesh::addIndices(const IndexedTri &trio)
 
 	// Tangents are no longer accumulated per triangle: MikkTSpace needs the
 	// whole mesh at once. Both callers (Mesh.cpp:202 and :626) run
-	// finishImport() once all indices are added, which drives recalculateTB().
+	// finishImport() once all indices are added, which drives recalculateTB()
+	// and with it a new generation() for the indices.
 }
 
-// MikkTSpace tangent generation
-//
-// Matches lib/ivis_opengl/imdload.cpp in WZ2100, which uses this same
-// reference implementation. Keeping the two in step is the whole point: WMIT's
-// viewport is only useful as a preview if its tangent frame is the game's.
-//
-// WZ2100 texture coordinates have V pointing DOWN the image while MikkTSpace
-// assumes the standard convention, so it is handed V-flipped coordinates. T is
-// unaffected by that flip and B = dP/dv changes sign, reproducing the -dP/dv
-// bitangent that ordinary OpenGL-convention ("green up") normal maps need.
-// Thus, fSign is used directly as w.
-
-namespace
+void Mesh::finishImport(unsigned threads)
 {
-	int mikkGetNumFaces(const SMikkTSpaceContext *pContext)
-	{
-		return static_cast<int>(static_cast<const Mesh *>(pContext->m_pUserData)->indices());
-	}
-
-	int mikkGetNumVerticesOfFace(const SMikkTSpaceContext *, const int)
-	{
-		return 3; // WZM/PIE meshes are triangulated
-	}
-
-	inline unsigned mikkIndex(const Mesh *mesh, const int iFace, const int iVert)
-	{
-		const IndexedTri &tri = mesh->getIndex(static_cast<size_t>(iFace));
-		return iVert == 0 ? tri.a() : (iVert == 1 ? tri.b() : tri.c());
-	}
-
-	void mikkGetPosition(const SMikkTSpaceContext *pContext, float fvPosOut[], const int iFace, const int iVert)
-	{
-		const Mesh *mesh = static_cast<const Mesh *>(pContext->m_pUserData);
-		const WZMVertex &v = mesh->getVertex(mikkIndex(mesh, iFace, iVert));
-		fvPosOut[0] = v.x();
-		fvPosOut[1] = v.y();
-		fvPosOut[2] = v.z();
-	}
-
-	void mikkGetNormal(const SMikkTSpaceContext *pContext, float fvNormOut[], const int iFace, const int iVert)
-	{
-		const Mesh *mesh = static_cast<const Mesh *>(pContext->m_pUserData);
-		const WZMVertex &n = mesh->getNormal(mikkIndex(mesh, iFace, iVert));
-		fvNormOut[0] = n.x();
-		fvNormOut[1] = n.y();
-		fvNormOut[2] = n.z();
-	}
-
-	void mikkGetTexCoord(const SMikkTSpaceContext *pContext, float fvTexcOut[], const int iFace, const int iVert)
-	{
-		const Mesh *mesh = static_cast<const Mesh *>(pContext->m_pUserData);
-		const WZMUV &uv = mesh->getUV(mikkIndex(mesh, iFace, iVert));
-		fvTexcOut[0] = uv.u();
-		fvTexcOut[1] = 1.f - uv.v(); // V flip - see the note above
-	}
-
-	void mikkSetTSpaceBasic(const SMikkTSpaceContext *pContext, const float fvTangent[], const float fSign, const int iFace, const int iVert)
-	{
-		Mesh *mesh = static_cast<Mesh *>(pContext->m_pUserData);
-		mesh->setTangent(mikkIndex(mesh, iFace, iVert),
-		                 WZMVertex4(fvTangent[0], fvTangent[1], fvTangent[2], fSign));
-	}
-}
-
-void Mesh::finishImport()
-{
-	recalculateTB();
+	recalculateTB(threads);
 	recalculateBoundData();
 }
 
 void Mesh::scale(GLfloat x, GLfloat y, GLfloat z)
 {
+	touch();
+
 	std::vector<WZMVertex>::iterator vertIt;
 	for (vertIt = m_vertexArray.begin(); vertIt < m_vertexArray.end(); ++vertIt)
 	{
@@ -1004,6 +936,8 @@ void Mesh::mirrorUsingLocalCenter(int axis)
 
 void Mesh::mirrorFromPoint(const WZMVertex& point, int axis)
 {
+	touch();
+
 	for (unsigned int i = 0; i < vertices(); ++i)
 	{
 		switch (axis)
@@ -1068,10 +1002,13 @@ void Mesh::reverseWinding()
 	{
 		std::swap((*it).b(), (*it).c());
 	}
+	touch();
 }
 
 void Mesh::flipNormals()
 {
+	touch();
+
 	std::vector<WZMVertex>::iterator nit;
 	for (nit = m_normalArray.begin(); nit != m_normalArray.end(); ++nit)
 	{
@@ -1090,6 +1027,8 @@ void Mesh::flipNormals()
 
 void Mesh::move(const WZMVertex &moveby)
 {
+	touch();
+
 	for (size_t i = 0; i < vertices(); ++i)
 	{
 		m_vertexArray[i] += moveby;
@@ -1123,8 +1062,10 @@ void Mesh::center(int axis)
 	move(moveby);
 }
 
-void Mesh::recalculateTB()
+void Mesh::recalculateTB(unsigned threads)
 {
+	touch();
+
 	size_t vert_num = vertices();
 
 	// Zero-out arrays
@@ -1141,30 +1082,29 @@ void Mesh::recalculateTB()
 	// MikkTSpace returns its results unindexed and warns against writing them
 	// through an index list that merges vertices. That is safe here because
 	// this mesh's index array only ever merges vertices agreeing on position,
-	// UV *and* normal (compareWZMPoint_less_wEps, 1e-4) - the same criterion
+	// UV *and* normal (VertexWelder, 1e-4) - the same criterion
 	// MikkTSpace welds on internally - so every corner sharing an index also
 	// receives the same tangent.
-	SMikkTSpaceInterface mikkInterface = {};
-	mikkInterface.m_getNumFaces = mikkGetNumFaces;
-	mikkInterface.m_getNumVerticesOfFace = mikkGetNumVerticesOfFace;
-	mikkInterface.m_getPosition = mikkGetPosition;
-	mikkInterface.m_getNormal = mikkGetNormal;
-	mikkInterface.m_getTexCoord = mikkGetTexCoord;
-	mikkInterface.m_setTSpaceBasic = mikkSetTSpaceBasic;
-
-	SMikkTSpaceContext mikkContext = {};
-	mikkContext.m_pInterface = &mikkInterface;
-	mikkContext.m_pUserData = this;
-
-	if (!genTangSpaceDefault(&mikkContext))
+	TangentSpaceInput in = {m_vertexArray.data(), m_normalArray.data(), m_textureArray.data(), vert_num,
+				m_indexArray.data(), m_indexArray.size()};
+	if (!generateTangentSpace(in, m_tangentArray.data(), threads))
 	{
 		std::cerr << "Mesh::recalculateTB - MikkTSpace tangent generation failed" << std::endl;
+		std::fill(m_tangentArray.begin(), m_tangentArray.end(), WZMVertex4());
 		return;
 	}
 
+	updateBitangents();
+}
+
+void Mesh::updateBitangents()
+{
+	touch();
+
 	// The renderer reconstructs the bitangent as w * cross(N, T).
 	// Keep the stored array consistent with that, for the debug draw and for scale() and mirror() which transform it alongside the tangent.
-	for (size_t i = 0; i < vert_num; ++i)
+	m_bitangentArray.resize(m_tangentArray.size());
+	for (size_t i = 0; i < m_tangentArray.size(); ++i)
 	{
 		m_bitangentArray[i] = m_normalArray[i].crossProduct(m_tangentArray[i].xyz())
 		                      * m_tangentArray[i].w();
@@ -1174,6 +1114,7 @@ void Mesh::recalculateTB()
 void Mesh::importPieAnimation(const ApieAnimObject &animobj)
 {
 	// replace current animation
+	touch();
 	m_frameArray.clear();
 	m_frameArray.reserve(animobj.frames.size());
 
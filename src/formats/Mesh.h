@@ -74,28 +74,39 @@ struct TexAnimData
 
 class Pie3Level;
 class ApieAnimObject;
-struct Mesh_exportToOBJ_InOutParams;
+class OBJExportTables;
 
 class Mesh
 {
 	friend class QWZM; // For rendering
+	friend class ModelCache;
+	friend class TangentSpaceJob;
 public:
 	Mesh();
-	Mesh(const Pie3Level& p3);
+	Mesh(const Pie3Level& p3, unsigned threads = 0); // threads for the tangents
 	virtual ~Mesh();
 
 	static Pie3Level backConvert(const Mesh& wzmMesh);
 	virtual operator Pie3Level() const;
 
 	bool read(std::istream& in);
-	void write(std::ostream& out) const;
+	void write(TextWriter& out) const;
 
-	bool importFromOBJ(const std::vector<OBJTri>&	faces,
+	// Builds the mesh from faces [first, last) of the shared OBJ arrays,
+	// only reads them so several meshes can be built at once. threads are
+	// used for the tangents.
+	bool importFromOBJ(std::vector<OBJTri>::const_iterator first,
+			   std::vector<OBJTri>::const_iterator last,
 			   const std::vector<OBJVertex>& verts,
 			   const std::vector<OBJUV>&	uvArray,
 			   const std::vector<OBJVertex>& normals,
-			   bool welder);
-	std::stringstream* exportToOBJ(const Mesh_exportToOBJ_InOutParams& params) const;
+			   bool welder, unsigned threads = 0);
+
+	// OBJ export is mirrored on x with the winding reversed. The first pass
+	// adds the attributes to the shared tables and gives each point its
+	// table indices, the second one writes the object with them.
+	void indexForOBJ(OBJExportTables& tables, std::vector<OBJPointIndex>& pointIndices) const;
+	void writeOBJFaces(TextWriter& out, const std::vector<OBJPointIndex>& pointIndices) const;
 
 	std::string getName() const;
 	void setName(const std::string& name);
@@ -104,7 +115,8 @@ public:
 	void setTeamColours(bool tc);
 
 	const WZMConnector& getConnector(int index) const;
-	WZMConnector& getConnector(int index);
+	WZMConnector& getConnector(int index); // does not touch(), edit via setConnectorPos()
+	void setConnectorPos(int index, const WZMVertex& pos);
 	void addConnector (const WZMConnector& conn);
 	void rmConnector (int index);
 	size_t connectors() const;
@@ -124,15 +136,25 @@ public:
 	void move(const WZMVertex& moveby);
 	void center(int axis); // -1 == all, x == 0, y == 1, z == 2
 
-	void recalculateTB();
+	// Threads as for generateTangentSpace(), 0 uses every core
+	void recalculateTB(unsigned threads = 0);
 
-	// Accessors used by the MikkTSpace callbacks in Mesh.cpp
-	// (indices() already exists above)
+	// Read only accessors (indices() already exists above)
 	const IndexedTri& getIndex(size_t i) const { return m_indexArray[i]; }
 	const WZMVertex& getVertex(size_t i) const { return m_vertexArray[i]; }
 	const WZMVertex& getNormal(size_t i) const { return m_normalArray[i]; }
 	const WZMUV& getUV(size_t i) const { return m_textureArray[i]; }
-	void setTangent(size_t i, const WZMVertex4& t) { m_tangentArray[i] = t; }
+
+	// Index data for glDrawElements: packed to 16 bits whenever all vertices
+	// can be addressed that way, the 32 bit array is used as is otherwise.
+	// The packed copy is redone when generation() has moved on.
+	GLenum drawIndexType() const;
+	const GLvoid* drawIndexData() const;
+
+	// Changes whenever the geometry, connectors or animation are edited, for
+	// caching derived data such as GPU buffers. Copies share the value since
+	// they share the contents.
+	unsigned long long generation() const {return m_generation;}
 	void importPieAnimation(const ApieAnimObject& animobj);
 
 	WZMVertex getCenterPoint() const;
@@ -151,6 +173,9 @@ protected:
 	std::vector<WZMVertex4> m_tangentArray;
 	std::vector<WZMVertex> m_bitangentArray;
 	std::vector<IndexedTri> m_indexArray;
+	mutable std::vector<GLushort> m_drawIndexArray; // lazily packed copy of m_indexArray
+	mutable unsigned long long m_drawIndexGeneration; // generation() it was packed at
+	unsigned long long m_generation;
 
 	std::list<WZMConnector> m_connectors;
 	std::string m_shader_vert;
@@ -164,8 +189,10 @@ protected:
 	void reserveIndices(const unsigned size);
 	void reserveTexAnimation(const unsigned size);
 	void addIndices(const IndexedTri& trio);
+	void touch(); // new generation()
 	void addPoint(const WZMVertex &vertex, const WZMUV &uv, const WZMVertex &normal);
-	void finishImport();
+	void finishImport(unsigned threads);
+	void updateBitangents();
 
 	void recalculateBoundData();
 };
@@ -0,0 +1,447 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ModelCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "TextReader.h"
+
+#ifdef _WIN32
+#  include <process.h>
+#else
+#  include <unistd.h>
+#endif
+
+// The arrays are copied as flat component arrays, as they are handed to OpenGL
+static_assert(sizeof(WZMVertex) == 3 * sizeof(GLfloat), "WZMVertex must be 3 packed floats");
+static_assert(sizeof(WZMVertex4) == 4 * sizeof(GLfloat), "WZMVertex4 must be 4 packed floats");
+static_assert(sizeof(WZMUV) == 2 * sizeof(GLclampf), "WZMUV must be 2 packed floats");
+static_assert(sizeof(IndexedTri) == 3 * sizeof(IndexedTri::indexType), "IndexedTri must be 3 packed indices");
+static_assert(sizeof(Frame) == 3 * sizeof(WZMVertex), "Frame must be 3 packed vertices");
+static_assert(sizeof(TexAnimData) == 2 * sizeof(float), "TexAnimData must be 2 packed floats");
+
+namespace
+{
+
+const char CACHE_MAGIC[8] = {'W', 'M', 'I', 'T', 'C', 'A', 'C', 'H'};
+const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+const uint32_t CACHE_END_MARKER = 0x444E4557; // "WEND"
+const size_t CACHE_ARRAY_ALIGN = 16;
+
+struct CacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t hash;
+	uint64_t size;
+	uint32_t readType;
+	uint32_t options;
+	uint32_t pieCaps;
+	uint32_t meshes;
+};
+
+inline uint64_t mix64(uint64_t v)
+{
+	v ^= v >> 33;
+	v *= 0xff51afd7ed558ccdULL;
+	v ^= v >> 33;
+	v *= 0xc4ceb9fe1a85ec53ULL;
+	v ^= v >> 33;
+	return v;
+}
+
+inline uint64_t rotl64(uint64_t v, int r)
+{
+	return (v << r) | (v >> (64 - r));
+}
+
+uint64_t hashBytes(const char* data, size_t size, uint64_t seed)
+{
+	uint64_t h = mix64(seed ^ (size * 0x9e3779b97f4a7c15ULL));
+	size_t i = 0;
+
+	for (; i + 8 <= size; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, data + i, 8);
+		h = rotl64(h ^ mix64(word), 27) * 0x9e3779b97f4a7c15ULL + 0x52dce729;
+	}
+
+	uint64_t tail = 0;
+	if (i < size)
+		memcpy(&tail, data + i, size - i);
+	return mix64(h ^ mix64(tail ^ (size - i)));
+}
+
+uint32_t capsToBits(const PieCaps& caps)
+{
+	uint32_t bits = 0;
+	for (int i = 0; i < static_cast<int>(PIE_OPT_DIRECTIVES::pod_MAXVAL); ++i)
+	{
+		if (caps.test(static_cast<PIE_OPT_DIRECTIVES>(i)))
+			bits |= 1u << i;
+	}
+	return bits;
+}
+
+PieCaps bitsToCaps(uint32_t bits)
+{
+	PieCaps caps;
+	for (int i = 0; i < static_cast<int>(PIE_OPT_DIRECTIVES::pod_MAXVAL); ++i)
+	{
+		caps.set(static_cast<PIE_OPT_DIRECTIVES>(i), (bits >> i) & 1u);
+	}
+	return caps;
+}
+
+class CacheWriter
+{
+public:
+	template <typename T>
+	void pod(const T& val)
+	{
+		m_buf.append(reinterpret_cast<const char*>(&val), sizeof(T));
+	}
+
+	void u32(uint32_t val) {pod(val);}
+
+	void str(const std::string& s)
+	{
+		u32(static_cast<uint32_t>(s.size()));
+		m_buf.append(s);
+		align(4);
+	}
+
+	template <typename V>
+	void array(const std::vector<V>& arr)
+	{
+		u32(static_cast<uint32_t>(arr.size()));
+		align(CACHE_ARRAY_ALIGN);
+		if (!arr.empty())
+			m_buf.append(reinterpret_cast<const char*>(arr.data()), arr.size() * sizeof(V));
+	}
+
+	void align(size_t to)
+	{
+		m_buf.resize((m_buf.size() + to - 1) / to * to, '\0');
+	}
+
+	const std::string& buffer() const {return m_buf;}
+
+private:
+	std::string m_buf;
+};
+
+class CacheReader
+{
+public:
+	CacheReader(const char* data, size_t size):
+		m_begin(data), m_cur(data), m_end(data + size) {}
+
+	template <typename T>
+	bool pod(T& val)
+	{
+		if (static_cast<size_t>(m_end - m_cur) < sizeof(T))
+			return false;
+		memcpy(static_cast<void*>(&val), m_cur, sizeof(T));
+		m_cur += sizeof(T);
+		return true;
+	}
+
+	bool u32(uint32_t& val) {return pod(val);}
+
+	bool str(std::string& s)
+	{
+		uint32_t len;
+		if (!u32(len) || static_cast<size_t>(m_end - m_cur) < len)
+			return false;
+		s.assign(m_cur, len);
+		m_cur += len;
+		return align(4);
+	}
+
+	template <typename V>
+	bool array(std::vector<V>& arr)
+	{
+		uint32_t count;
+		if (!u32(count) || !align(CACHE_ARRAY_ALIGN))
+			return false;
+		if (static_cast<size_t>(m_end - m_cur) / sizeof(V) < count)
+			return false;
+		arr.resize(count);
+		if (count)
+			memcpy(static_cast<void*>(arr.data()), m_cur, count * sizeof(V));
+		m_cur += count * sizeof(V);
+		return true;
+	}
+
+	bool align(size_t to)
+	{
+		const size_t offset = static_cast<size_t>(m_cur - m_begin);
+		const size_t pad = (to - offset % to) % to;
+		if (static_cast<size_t>(m_end - m_cur) < pad)
+			return false;
+		m_cur += pad;
+		return true;
+	}
+
+	bool atEnd() const {return m_cur == m_end;}
+
+private:
+	const char* m_begin;
+	const char* m_cur;
+	const char* m_end;
+};
+
+} // namespace
+
+ModelCacheKey ModelCache::makeKey(const char* data, size_t size, uint32_t readType, uint32_t options)
+{
+	ModelCacheKey key;
+	key.hash = ::hashBytes(data, size, WMIT_MODEL_CACHE_VERSION);
+	key.size = size;
+	key.readType = readType;
+	key.options = options;
+	key.version = WMIT_MODEL_CACHE_VERSION;
+	return key;
+}
+
+uint64_t ModelCache::hashBytes(const char* data, size_t size, uint64_t seed)
+{
+	return ::hashBytes(data, size, seed);
+}
+
+std::string ModelCache::temporaryPath(const std::string& path)
+{
+#ifdef _WIN32
+	const long pid = static_cast<long>(_getpid());
+#else
+	const long pid = static_cast<long>(getpid());
+#endif
+
+	std::stringstream tmpName;
+	tmpName << path << ".tmp" << pid << '-' << std::hash<std::thread::id>()(std::this_thread::get_id());
+	return tmpName.str();
+}
+
+std::string ModelCache::entryPath(const std::string& dir, const ModelCacheKey& key)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%016llx-%u-%u-v%u" WMIT_MODEL_CACHE_EXT,
+		 static_cast<unsigned long long>(key.hash), key.readType, key.options, key.version);
+	return dir + '/' + name;
+}
+
+bool ModelCache::read(const std::string& path, const ModelCacheKey& key, WZM& model, PieCaps& caps)
+{
+	MappedFile mapped(path.c_str());
+	if (!mapped.isOpen())
+		return false;
+
+	CacheReader in(mapped.data(), mapped.size());
+	CacheHeader header;
+
+	if (!in.pod(header) ||
+	    memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+	    header.version != WMIT_MODEL_CACHE_VERSION || header.version != key.version ||
+	    header.byteOrder != CACHE_BYTE_ORDER ||
+	    header.hash != key.hash || header.size != key.size ||
+	    header.readType != key.readType || header.options != key.options ||
+	    header.meshes > mapped.size())
+	{
+		return false;
+	}
+
+	WZM tmp;
+	uint32_t count, val;
+
+	if (!in.u32(count))
+		return false;
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		std::string name;
+		if (!in.u32(val) || val >= WZM_TEX__LAST || !in.str(name))
+			return false;
+		tmp.m_textures[static_cast<wzm_texture_type_t>(val)] = name;
+	}
+
+	for (int i = WZM_MAT__FIRST; i < WZM_MAT__LAST; ++i)
+	{
+		if (!in.pod(tmp.m_material.vals[i]))
+			return false;
+	}
+	if (!in.pod(tmp.m_material.shininess) ||
+	    !in.u32(tmp.m_pie_read_type) || !in.u32(tmp.m_ani_interpolate) ||
+	    !in.u32(count))
+	{
+		return false;
+	}
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		int32_t id;
+		std::string event;
+		if (!in.pod(id) || !in.str(event))
+			return false;
+		tmp.m_events[id] = event;
+	}
+
+	tmp.m_meshes.resize(header.meshes);
+	for (Mesh& msh : tmp.m_meshes)
+	{
+		std::vector<WZMVertex> connectors;
+
+		if (!in.str(msh.m_name) ||
+		    !in.pod(msh.m_frame_time) || !in.pod(msh.m_frame_cycles) ||
+		    !in.u32(msh.m_texAnimFrames) || !in.u32(msh.m_texAnimPlaybackRate) ||
+		    !in.u32(val) ||
+		    !in.str(msh.m_shader_vert) || !in.str(msh.m_shader_frag) ||
+		    !in.pod(msh.m_mesh_weightcenter) || !in.pod(msh.m_mesh_aabb_min) ||
+		    !in.pod(msh.m_mesh_aabb_max) || !in.pod(msh.m_mesh_tspcenter) ||
+		    !in.array(msh.m_frameArray) || !in.array(msh.m_texAnimArray) ||
+		    !in.array(msh.m_vertexArray) || !in.array(msh.m_textureArray) ||
+		    !in.array(msh.m_normalArray) || !in.array(msh.m_tangentArray) ||
+		    !in.array(msh.m_bitangentArray) || !in.array(msh.m_indexArray) ||
+		    !in.array(connectors))
+		{
+			return false;
+		}
+		msh.m_teamColours = val != 0;
+
+		// The renderer trusts the indices, do not let a damaged entry through
+		const IndexedTri::indexType vertices = static_cast<IndexedTri::indexType>(msh.m_vertexArray.size());
+		for (const IndexedTri& tri : msh.m_indexArray)
+		{
+			if (tri.a() >= vertices || tri.b() >= vertices || tri.c() >= vertices)
+				return false;
+		}
+
+		for (const WZMVertex& pos : connectors)
+			msh.m_connectors.push_back(WZMConnector(pos));
+	}
+
+	if (!in.u32(val) || val != CACHE_END_MARKER || !in.atEnd())
+		return false;
+
+	model = tmp;
+	caps = bitsToCaps(header.pieCaps);
+	return true;
+}
+
+bool ModelCache::write(const std::string& path, const ModelCacheKey& key, const WZM& model, const PieCaps& caps)
+{
+	CacheWriter out;
+	CacheHeader header;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = WMIT_MODEL_CACHE_VERSION;
+	header.byteOrder = CACHE_BYTE_ORDER;
+	header.hash = key.hash;
+	header.size = key.size;
+	header.readType = key.readType;
+	header.options = key.options;
+	header.pieCaps = capsToBits(caps);
+	header.meshes = static_cast<uint32_t>(model.m_meshes.size());
+	out.pod(header);
+
+	out.u32(static_cast<uint32_t>(model.m_textures.size()));
+	for (const auto& tex : model.m_textures)
+	{
+		out.u32(static_cast<uint32_t>(tex.first));
+		out.str(tex.second);
+	}
+
+	for (int i = WZM_MAT__FIRST; i < WZM_MAT__LAST; ++i)
+		out.pod(model.m_material.vals[i]);
+	out.pod(model.m_material.shininess);
+	out.u32(model.m_pie_read_type);
+	out.u32(model.m_ani_interpolate);
+
+	out.u32(static_cast<uint32_t>(model.m_events.size()));
+	for (const auto& event : model.m_events)
+	{
+		out.pod(static_cast<int32_t>(event.first));
+		out.str(event.second);
+	}
+
+	for (const Mesh& msh : model.m_meshes)
+	{
+		std::vector<WZMVertex> connectors;
+		for (const WZMConnector& conn : msh.m_connectors)
+			connectors.push_back(conn.getPos());
+
+		out.str(msh.m_name);
+		out.pod(msh.m_frame_time);
+		out.pod(msh.m_frame_cycles);
+		out.u32(msh.m_texAnimFrames);
+		out.u32(msh.m_texAnimPlaybackRate);
+		out.u32(msh.m_teamColours ? 1 : 0);
+		out.str(msh.m_shader_vert);
+		out.str(msh.m_shader_frag);
+		out.pod(msh.m_mesh_weightcenter);
+		out.pod(msh.m_mesh_aabb_min);
+		out.pod(msh.m_mesh_aabb_max);
+		out.pod(msh.m_mesh_tspcenter);
+		out.array(msh.m_frameArray);
+		out.array(msh.m_texAnimArray);
+		out.array(msh.m_vertexArray);
+		out.array(msh.m_textureArray);
+		out.array(msh.m_normalArray);
+		out.array(msh.m_tangentArray);
+		out.array(msh.m_bitangentArray);
+		out.array(msh.m_indexArray);
+		out.array(connectors);
+	}
+
+	out.u32(CACHE_END_MARKER);
+
+	const std::string tmpPath = temporaryPath(path);
+
+	std::ofstream f(tmpPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!f.is_open())
+		return false;
+	f.write(out.buffer().data(), static_cast<std::streamsize>(out.buffer().size()));
+	f.close();
+	if (!f)
+	{
+		remove(tmpPath.c_str());
+		return false;
+	}
+
+	// rename() does not replace existing files everywhere
+	if (rename(tmpPath.c_str(), path.c_str()) != 0)
+	{
+		remove(path.c_str());
+		if (rename(tmpPath.c_str(), path.c_str()) != 0)
+		{
+			remove(tmpPath.c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
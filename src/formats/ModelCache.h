@@ -0,0 +1,94 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef MODELCACHE_HPP
+#define MODELCACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Pie.h"
+#include "WZM.h"
+
+/*
+  Bump whenever importing the same source can produce a different model (or
+  the entry layout changes), entries of other versions are never served.
+  2: OBJ faces with a zero or out of range vertex, UV or normal index fail
+  3: PIE polygons with less than 3 vertices are skipped
+  4: tangents of large meshes are generated in batches
+  */
+#define WMIT_MODEL_CACHE_VERSION 4
+#define WMIT_MODEL_CACHE_EXT ".wmitcache"
+// Least recently used entries beyond this are deleted, see pruneCacheDirectory()
+#define WMIT_MODEL_CACHE_MAX_BYTES (256LL * 1024 * 1024)
+
+enum ModelCacheMode
+{
+	WMIT_CACHE_OFF = 0,	// always parse the source, never touch the cache
+	WMIT_CACHE_USE,		// load from the cache when the source is unchanged, fill it otherwise
+	WMIT_CACHE_REBUILD	// always parse the source and overwrite the cache entry
+};
+
+/*
+  Identifies a source file: a hash of its bytes plus everything else that
+  changes what importing it produces.
+  */
+struct ModelCacheKey
+{
+	uint64_t hash;
+	uint64_t size;
+	uint32_t readType;	// wmit_filetype_t of the source
+	uint32_t options;	// importer options, e.g. the OBJ welder
+	uint32_t version;	// WMIT_MODEL_CACHE_VERSION of the importer
+
+	ModelCacheKey(): hash(0), size(0), readType(0), options(0), version(0) {}
+};
+
+/*
+  Binary snapshot of an imported WZM, so reopening an unchanged model skips
+  the text parsing and the mesh conversion.
+
+  The file is a fixed header followed by the model and its meshes; every
+  array is stored as raw native-endian data starting on a 16 byte boundary,
+  so the whole file can be memory mapped and the arrays copied straight into
+  the Mesh vectors. Entries are written to a temporary file and renamed in
+  place, concurrent writers of the same key (in any process) simply race for
+  the last rename.
+  */
+class ModelCache
+{
+public:
+	static ModelCacheKey makeKey(const char* data, size_t size, uint32_t readType, uint32_t options);
+
+	// Content hash of the keys, seeded with the cache version
+	static uint64_t hashBytes(const char* data, size_t size, uint64_t seed);
+
+	// "<hash>-<type>-<options>-v<version>.wmitcache" below dir
+	static std::string entryPath(const std::string& dir, const ModelCacheKey& key);
+
+	// Where an entry is written before it is renamed to path, unique per process and thread
+	static std::string temporaryPath(const std::string& path);
+
+	// Fails (without output) when the entry is missing, stale or of another version
+	static bool read(const std::string& path, const ModelCacheKey& key, WZM& model, PieCaps& caps);
+	static bool write(const std::string& path, const ModelCacheKey& key, const WZM& model, const PieCaps& caps);
+};
+
+#endif // MODELCACHE_HPP
@@ -21,13 +21,16 @@
 #define OBJ_HPP
 
 #include <iostream>
+#include <limits>
+#include <string>
 #include <vector>
-#include <set>
 
 #include <GL/glew.h>
 
 #include "VectorTypes.h"
 #include "Polygon.h"
+#include "TextWriter.h"
+#include "VertexWelder.h"
 
 typedef Vertex<GLfloat> OBJVertex;
 typedef UV<GLclampf> OBJUV;
@@ -36,9 +39,9 @@ struct OBJTri
 {
 	IndexedTri tri;
 
-	// signed short: -1 means not specified
-	Vector<short, 3> nrm;
-	Vector<short, 3> uvs;
+	// signed: -1 means not specified
+	Vector<GLint, 3> nrm;
+	Vector<GLint, 3> uvs;
 
 	bool operator == (const OBJTri& rhs)
 	{
@@ -57,42 +60,91 @@ struct OBJTri
 		return tri < rhs.tri;
 	}
 };
-inline void writeOBJVertex(const OBJVertex& vert, std::ostream& out)
+
+// An "o" record of the file: faces [first, last) of the face list
+struct OBJObject
+{
+	std::string name;
+	size_t first, last;
+};
+
+inline void writeOBJVertex(const OBJVertex& vert, TextWriter& out)
 {
 	out << "v " << vert.x() << ' '
 			<< vert.y()  << ' '
 			<< vert.z() << '\n';
 }
 
-inline void writeOBJUV(const OBJUV& uv, std::ostream& out)
+inline void writeOBJUV(const OBJUV& uv, TextWriter& out)
 {
 	out << "vt " << uv.u() << ' '
 			<< uv.v() << '\n';
 }
 
-inline void writeOBJNormal(const OBJVertex& norm, std::ostream& out)
+inline void writeOBJNormal(const OBJVertex& norm, TextWriter& out)
 {
 	out << "vn " << norm.x() << ' '
 			<< norm.y()  << ' '
 			<< norm.z() << '\n';
 }
 
-/* Ugh, those wretched template parameters have a way of fuglying things up
- * so I'm burrying them here so that hopefuly no-one sees them...
- * these are function parameters, currently assumed to be valid pointers,
- * these are treated like references.
- */
-struct Mesh_exportToOBJ_InOutParams
+// 1 based v/vt/vn of an exported point, 0 while unassigned
+struct OBJPointIndex
 {
-	std::vector<OBJVertex>* vertices;
-	std::set<OBJVertex, OBJVertex::less_wEps>* vertSet;
-	std::vector<unsigned>* vertMapping;
-	std::vector<OBJUV>* uvs;
-	std::set<OBJUV, OBJUV::less_wEps>* uvSet;
-	std::vector<unsigned>* uvMapping;
-	std::vector<OBJVertex>* normals;
-	std::set<OBJVertex, OBJVertex::less_wEps>* normSet;
-	std::vector<unsigned>* normMapping;
+	unsigned v, vt, vn;
+};
+
+/*
+  The shared v/vt/vn tables of an OBJ export. Values equal within epsilon
+  share the entry of the first one added, which is what the std::set based
+  export used to do; the lookups go through hash grids so building the
+  tables is linear in the number of face corners.
+  */
+class OBJExportTables
+{
+public:
+	OBJExportTables():
+		m_vertGrid(std::numeric_limits<GLfloat>::epsilon()),
+		m_uvGrid(std::numeric_limits<GLfloat>::epsilon()),
+		m_normGrid(std::numeric_limits<GLfloat>::epsilon())
+	{
+	}
+
+	// 1 based indices, as written to the faces
+	unsigned addVertex(const OBJVertex& vert) {return add(vert, m_vertices, m_vertGrid, m_vertEq);}
+	unsigned addUV(const OBJUV& uv) {return add(uv, m_uvs, m_uvGrid, m_uvEq);}
+	unsigned addNormal(const OBJVertex& norm) {return add(norm, m_normals, m_normGrid, m_vertEq);}
+
+	const std::vector<OBJVertex>& vertices() const {return m_vertices;}
+	const std::vector<OBJUV>& uvs() const {return m_uvs;}
+	const std::vector<OBJVertex>& normals() const {return m_normals;}
+
+private:
+	static OBJVertex gridPos(const OBJVertex& vert) {return vert;}
+	static OBJVertex gridPos(const OBJUV& uv) {return OBJVertex(uv.u(), uv.v(), 0.f);}
+
+	template <typename T, typename Eq>
+	static unsigned add(const T& val, std::vector<T>& table, PositionHashGrid<OBJVertex>& grid, const Eq& equal)
+	{
+		unsigned index = grid.findFirst(gridPos(val), [&](unsigned i) {return equal(table[i], val);});
+
+		if (index == PositionHashGrid<OBJVertex>::npos)
+		{
+			index = static_cast<unsigned>(table.size());
+			table.push_back(val);
+			grid.add(gridPos(val), index);
+		}
+		return index + 1;
+	}
+
+	std::vector<OBJVertex> m_vertices;
+	std::vector<OBJUV> m_uvs;
+	std::vector<OBJVertex> m_normals;
+
+	PositionHashGrid<OBJVertex> m_vertGrid, m_uvGrid, m_normGrid;
+
+	OBJVertex::equal_wEps m_vertEq;
+	OBJUV::equal_wEps m_uvEq;
 };
 
 #endif // OBJ_HPP
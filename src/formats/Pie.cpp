@@ -43,10 +43,29 @@ int pieVersion(std::istream& in)
 	return -1;
 }
 
-bool tryToReadDirective(std::istream &in, const char* directive, const bool isOptional, std::function<bool(std::istream&)> dirLoaderFunc)
+int pieVersion(TextReader& in)
 {
-	std::string str;
-	std::streampos entrypoint = in.tellg();
+	std::string_view pie;
+	unsigned version;
+	TextReader::pos_type start = in.tellg();
+
+	// PIE %u
+	in >> pie >> version;
+	if (in.good() && pie.compare(PIE_MODEL_SIGNATURE) == 0)
+	{
+		in.seekg(start);
+		if (version == 2 || version == 3)
+		{
+			return version;
+		}
+	}
+	return -1;
+}
+
+bool tryToReadDirective(TextReader &in, const char* directive, const bool isOptional, std::function<bool(TextReader&)> dirLoaderFunc)
+{
+	std::string_view str;
+	TextReader::pos_type entrypoint = in.tellg();
 
 	in >> str;
 	if (in.fail() || (str.compare(directive) != 0))
@@ -177,69 +196,65 @@ Pie3Connector::operator Pie2Connector() const
 	return p2;
 }
 
-Pie3Polygon::Pie3Polygon()
+void Pie3Polygons::upConvert(const Pie2Polygons& p2)
 {
-	m_vertices = 3;
-}
+	size_t poly;
+	unsigned i, j;
+	unsigned indices[3];
+	Pie3UV texCoords[3];
+	TexAnim anim;
 
-Pie3Polygon::~Pie3Polygon()
-{
-}
-
-int Pie3Polygon::upConvert(const Pie2Polygon& pie2Poly, std::back_insert_iterator<std::vector<Pie3Polygon> > result)
-{
-	unsigned i;
-
-	for(i = 0; i < pie2Poly.triangles(); ++i, ++result)
+	for (poly = 0; poly < p2.size(); ++poly)
 	{
-		Pie3Polygon p3;
-		p3.m_indices[0] = pie2Poly.m_indices[0];
-		p3.m_texCoords[0] = pie2Poly.m_texCoords[0];
-
-		p3.m_indices[1] = pie2Poly.m_indices[i+1];
-		p3.m_texCoords[1] = pie2Poly.m_texCoords[i+1];
-
-		p3.m_indices[2] = pie2Poly.m_indices[i+2];
-		p3.m_texCoords[2] = pie2Poly.m_texCoords[i+2];
+		const Pie2Polygons::TexAnim p2Anim = p2.getTexAnim(poly);
 
-		p3.m_vertices = 3;
-		p3.m_flags = pie2Poly.m_flags; // FIXME: need to check whether these flags are supported
+		anim.frames = p2Anim.frames;
+		anim.playbackRate = p2Anim.playbackRate;
+		anim.width = p2Anim.width/256.f;
+		anim.height = p2Anim.height/256.f;
 
-		p3.m_frames = pie2Poly.m_frames;
-		p3.m_playbackRate = pie2Poly.m_playbackRate;
-		p3.m_width = pie2Poly.m_width/256.f;
-		p3.m_height = pie2Poly.m_height/256.f;
-		(*result) = p3;
+		for (i = 0; i < p2.triangles(poly); ++i)
+		{
+			for (j = 0; j < 3; ++j)
+			{
+				const unsigned corner = j == 0 ? 0 : i + j;
+				indices[j] = p2.getIndex(poly, corner);
+				texCoords[j] = p2.getUV(poly, corner);
+			}
+
+			// FIXME: need to check whether these flags are supported
+			add(p2.getFlags(poly), 3, indices, texCoords, anim);
+		}
 	}
-	return pie2Poly.triangles();
 }
 
-Pie2Polygon Pie3Polygon::backConvert(const Pie3Polygon& p3)
+void Pie3Polygons::backConvert(Pie2Polygons& p2) const
 {
-	return p3;
-}
+	size_t poly;
+	unsigned i;
+	unsigned indices[3];
+	Pie2UV texCoords[3];
+	Pie2Polygons::TexAnim p2Anim;
 
-Pie3Polygon::operator Pie2Polygon() const
-{
-	Pie2Polygon p2;
-	int i;
+	p2.reserve(size(), m_indices.size());
 
-	for (i = 2; i >= 0; --i)
+	for (poly = 0; poly < size(); ++poly)
 	{
-		p2.m_indices[i] = m_indices[i];
-		p2.m_texCoords[i] = m_texCoords[i];
-	}
-
-	p2.m_vertices = 3;
+		const TexAnim anim = getTexAnim(poly);
 
-	p2.m_flags = m_flags;
+		for (i = 0; i < vertices(poly); ++i)
+		{
+			indices[i] = getIndex(poly, i);
+			texCoords[i] = getUV(poly, i);
+		}
 
-	p2.m_frames = m_frames;
-	p2.m_playbackRate = m_playbackRate;
-	p2.m_width = ceil(m_width * 256.f);
-	p2.m_height = ceil(m_height * 256.f);
+		p2Anim.frames = anim.frames;
+		p2Anim.playbackRate = anim.playbackRate;
+		p2Anim.width = ceil(anim.width * 256.f);
+		p2Anim.height = ceil(anim.height * 256.f);
 
-	return p2;
+		p2.add(getFlags(poly), vertices(poly), indices, texCoords, p2Anim);
+	}
 }
 
 /*
@@ -248,8 +263,10 @@ Pie3Polygon::operator Pie2Polygon() const
  * case I might consider adding template parameters...
  * don't tempt me!
  */
-Pie3UV Pie3Polygon::getUV(unsigned index, unsigned frame) const
+Pie3UV Pie3Polygons::getUV(size_t polygon, unsigned index, unsigned frame) const
 {
+	const Pie3UV& uv = getUV(polygon, index);
+	const TexAnim anim = getTexAnim(polygon);
 	double u, v;
 	double width, height;
 	int framesPerLine = 1;
@@ -257,12 +274,12 @@ Pie3UV Pie3Polygon::getUV(unsigned index, unsigned frame) const
 
 	if (frame == 0)
 	{
-		return m_texCoords[index];
+		return uv;
 	}
 
-	if (m_width != 0)
+	if (anim.width != 0)
 	{
-		framesPerLine = 1 / m_width;
+		framesPerLine = 1 / anim.width;
 	}
 
 	/* This works because wrap around is only permitted if you start the animation at the
@@ -271,8 +288,8 @@ Pie3UV Pie3Polygon::getUV(unsigned index, unsigned frame) const
 	frameH = frame % framesPerLine;
 	frameV = frame / framesPerLine;	// note the integer divsion
 
-	width = m_texCoords[index].u() + m_width * frameH;
-	height = m_texCoords[index].v() + m_height * frameV;
+	width = uv.u() + anim.width * frameH;
+	height = uv.v() + anim.height * frameV;
 
 	u = width;
 	v = height;
@@ -286,15 +303,10 @@ Pie3Level::Pie3Level()
 
 Pie3Level::Pie3Level(const Pie2Level& p2)
 {
-	std::vector<Pie2Polygon>::const_iterator it;
-
 	std::transform(p2.m_points.begin(), p2.m_points.end(),
 				   back_inserter(m_points), Pie3Vertex::upConvert);
 
-	for (it = p2.m_polygons.begin(); it != p2.m_polygons.end(); ++it)
-	{
-		Pie3Polygon::upConvert(*it, back_inserter(m_polygons));
-	}
+	m_polygons.upConvert(p2.m_polygons);
 
 	std::transform(p2.m_connectors.begin(), p2.m_connectors.end(),
 				   back_inserter(m_connectors), Pie3Connector::upConvert);
@@ -324,8 +336,7 @@ Pie3Level::operator Pie2Level() const
 	std::transform(m_points.begin(), m_points.end(),
 				   back_inserter(p2.m_points), Pie3Vertex::backConvert);
 
-	std::transform(m_polygons.begin(), m_polygons.end(),
-				   back_inserter(p2.m_polygons), Pie3Polygon::backConvert);
+	m_polygons.backConvert(p2.m_polygons);
 
 	std::transform(m_connectors.begin(), m_connectors.end(),
 				   back_inserter(p2.m_connectors), Pie3Connector::backConvert);
@@ -383,7 +394,7 @@ unsigned Pie3Model::textureWidth() const
 	return 0;
 }
 
-bool ApieAnimFrame::read(std::istream &in)
+bool ApieAnimFrame::read(TextReader &in)
 {
 	in >> num;
 	if ( in.fail())
@@ -393,12 +404,12 @@ bool ApieAnimFrame::read(std::istream &in)
 	return !in.fail();
 }
 
-void ApieAnimFrame::write(std::ostream &out) const
+void ApieAnimFrame::write(TextWriter &out) const
 {
 	out << num  << ' ' << pos  << ' ' << rot  << ' ' << scale;
 }
 
-bool ApieAnimObject::read(std::istream &in)
+bool ApieAnimObject::read(TextReader &in)
 {
 	clear();
 
@@ -423,7 +434,7 @@ bool ApieAnimObject::read(std::istream &in)
 	return true;
 }
 
-void ApieAnimObject::write(std::ostream &out) const
+void ApieAnimObject::write(TextWriter &out) const
 {
 	out << ' ' << time << ' ' << cycles << ' ' << numframes;
 	for (size_t i = 0; i < static_cast<size_t>(numframes); ++i)
@@ -436,53 +447,48 @@ void ApieAnimObject::write(std::ostream &out) const
 
 bool ApieAnimObject::readStandaloneAniFile(const char *file)
 {
-	std::ifstream fin;
+	MappedFile fin;
 
 	clear();
 
-	fin.open(file, std::ios::in | std::ios::binary);
-
-	if (!fin.is_open())
+	if (!fin.open(file))
 		return false;
 
-	return readStandaloneAniStream(fin);
+	TextReader reader(fin);
+	return readStandaloneAniStream(reader);
 }
 
-bool ApieAnimObject::readStandaloneAniStream(std::istream &fin)
+bool ApieAnimObject::readStandaloneAniStream(TextReader &fin)
 {
-	std::string str;
-	std::streampos entrypoint = fin.tellg();
+	std::string_view str;
+	TextReader::pos_type entrypoint = fin.tellg();
 
 	clear();
 
-	std::getline(fin, str);
-	if (fin.fail())
+	// CR is cut off by getline
+	if (!fin.getline(str))
 	{
 		return false;
 	}
 
-	// Cut off CR
-	if (!str.empty() && str.back() == '\r')
-		str = str.substr(0, str.size() - 1);
-
 	// Attempt to read mesh name
 	if (str.find(PIE_MODEL_DIRECTIVE_ANIMOBJECT) == 0)
 	{
-		str.clear();
+		str = std::string_view();
 
 		fin.clear();
 		fin.seekg(entrypoint);
 	}
 
 	if (tryToReadDirective(fin, PIE_MODEL_DIRECTIVE_ANIMOBJECT, false,
-		[this](std::istream& inn)
+		[this](TextReader& inn)
 		{
 			return read(inn);
 		}))
 	{
-			name = str;
+			name = std::string(str);
 			// read up to next line
-			std::getline(fin, str);
+			fin.getline(str);
 			return true;
 	}
 	return false;
@@ -524,17 +530,16 @@ const char *getPieDirectiveDescription(PIE_OPT_DIRECTIVES dir)
 
 bool ApieAnimList::readAniFile(const char *file)
 {
-	std::ifstream fin;
+	MappedFile fin;
 
 	clear();
 
-	fin.open(file, std::ios::in | std::ios::binary);
-
-	if (!fin.is_open())
+	if (!fin.open(file))
 		return false;
 
+	TextReader reader(fin);
 	ApieAnimObject nextAnim;
-	while (nextAnim.readStandaloneAniStream(fin))
+	while (nextAnim.readStandaloneAniStream(reader))
 	{
 		anims.emplace_back(nextAnim);
 	};
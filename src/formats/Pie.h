@@ -28,6 +28,8 @@
 #include <GL/glew.h>
 #include "VectorTypes.h"
 #include "Polygon.h"
+#include "TextReader.h"
+#include "TextWriter.h"
 
 #include "WZM.h" // for friends
 
@@ -131,8 +133,8 @@ enum class PIE_OPT_DIRECTIVES
 const char* getPieDirectiveName(PIE_OPT_DIRECTIVES dir);
 const char* getPieDirectiveDescription(PIE_OPT_DIRECTIVES dir);
 
-bool tryToReadDirective(std::istream &in, const char* directive, const bool isOptional,
-			std::function<bool(std::istream&)> dirLoaderFunc);
+bool tryToReadDirective(TextReader &in, const char* directive, const bool isOptional,
+			std::function<bool(TextReader&)> dirLoaderFunc);
 
 template<>
 struct EnumTraits<PIE_OPT_DIRECTIVES>
@@ -153,8 +155,8 @@ public:
 	Vertex<int> pos, rot;
 	Vertex<float> scale;
 
-	bool read(std::istream& in);
-	void write(std::ostream& out) const;
+	bool read(TextReader& in);
+	void write(TextWriter& out) const;
 };
 
 class ApieAnimObject
@@ -167,10 +169,10 @@ public:
 	bool isValid() const {return !frames.empty();}
 	void clear() {frames.clear(); name.clear();}
 
-	bool read(std::istream& in);
-	void write(std::ostream& out) const;
+	bool read(TextReader& in);
+	void write(TextWriter& out) const;
 
-	bool readStandaloneAniStream(std::istream& fin);
+	bool readStandaloneAniStream(TextReader& fin);
 	bool readStandaloneAniFile(const char* file);
 };
 
@@ -190,13 +192,13 @@ class APieLevel
 {
 	typedef Vertex<GLfloat> PieNormal;
 	friend Mesh::operator Pie3Level() const;
-	friend Mesh::Mesh(const Pie3Level& p3);
+	friend Mesh::Mesh(const Pie3Level& p3, unsigned threads);
 public:
 	APieLevel();
 	virtual ~APieLevel() {}
 
-	virtual bool read(std::istream& in, PieCaps& caps);
-	virtual void write(std::ostream& out, const PieCaps& caps) const;
+	virtual bool read(TextReader& in, PieCaps& caps);
+	virtual void write(TextWriter& out, const PieCaps& caps) const;
 
 	size_t points() const;
 	size_t normals() const;
@@ -207,11 +209,11 @@ public:
 
 protected:
 	void clearAll();
-	bool readAnimObjectDirective(std::istream &in, PieCaps& caps);
+	bool readAnimObjectDirective(TextReader &in, PieCaps& caps);
 
 	std::vector<V> m_points;
 	std::vector<PieNormal> m_normals;
-	std::vector<P> m_polygons;
+	P m_polygons;
 	std::list<C> m_connectors;
 	WZMaterial m_material; // PIE3+
 	std::string m_shader_vert;
@@ -229,6 +231,7 @@ public:
 	virtual unsigned version() const =0;
 
 	virtual bool read(std::istream& in);
+	virtual bool read(TextReader& in);
 	virtual void write(std::ostream& out, const PieCaps* piecaps = nullptr) const;
 
 	size_t levels() const;
@@ -246,18 +249,18 @@ protected:
 	virtual unsigned textureHeight() const =0;
 	virtual unsigned textureWidth() const =0;
 
-	virtual bool readHeaderBlock(std::istream& in);
+	virtual bool readHeaderBlock(TextReader& in);
 
-	virtual bool readTexturesBlock(std::istream& in);
-	bool readTextureDirective(std::istream& in);
-	bool readNormalmapDirective(std::istream& in);
-	bool readSpecmapDirective(std::istream& in);
+	virtual bool readTexturesBlock(TextReader& in);
+	bool readTextureDirective(TextReader& in);
+	bool readNormalmapDirective(TextReader& in);
+	bool readSpecmapDirective(TextReader& in);
 
-	virtual bool readLevelsBlock(std::istream& in);
-	bool readEventsDirective(std::istream& in);
-	int readLevelsDirective(std::istream& in);
-	bool readLevels(int levels, std::istream& in);
-	bool readAnimObjectDirective(std::istream &in);
+	virtual bool readLevelsBlock(TextReader& in);
+	bool readEventsDirective(TextReader& in);
+	int readLevelsDirective(TextReader& in);
+	bool readLevels(int levels, TextReader& in);
+	bool readAnimObjectDirective(TextReader &in);
 
 	std::string m_texture;
 	std::string m_texture_normalmap;
@@ -277,8 +280,8 @@ template <typename V>
 struct PieConnector
 {
 	virtual ~PieConnector(){}
-	bool read(std::istream& in);
-	void write(std::ostream& out) const;
+	bool read(TextReader& in);
+	void write(TextWriter& out) const;
 	V pos;
 };
 
@@ -290,6 +293,7 @@ struct PieConnector
   *	@return	int Version of the pie version.
   */
 int pieVersion(std::istream& in);
+int pieVersion(TextReader& in);
 
 /**********************************************
   Pie version 2
@@ -298,15 +302,9 @@ typedef UV<GLushort> Pie2UV;
 typedef Vertex<GLint> Pie2Vertex;
 typedef PieConnector<Pie2Vertex> Pie2Connector;
 
-class Pie2Polygon : public PiePolygon<Pie2UV, GLushort, 16>
-{
-	friend class Pie3Polygon; // only for operator thisclass() and thatclass(const thisclass&)
-public:
-	Pie2Polygon(){}
-	virtual ~Pie2Polygon(){}
-};
+typedef PiePolygons<Pie2UV, GLushort, 16> Pie2Polygons;
 
-class Pie2Level : public APieLevel<Pie2Vertex, Pie2Polygon, Pie2Connector>
+class Pie2Level : public APieLevel<Pie2Vertex, Pie2Polygons, Pie2Connector>
 {
 	friend class Pie3Level; // only for operator thisclass() and thatclass(const thisclass&)
 public:
@@ -362,24 +360,20 @@ public:
 	operator Pie2Connector() const;
 };
 
-class Pie3Polygon : public PiePolygon<Pie3UV, GLclampf, 3>
+class Pie3Polygons : public PiePolygons<Pie3UV, GLclampf, 3>
 {
 public:
-	Pie3Polygon();
-	virtual ~Pie3Polygon();
+	// Pie2 fans are split into triangles
+	void upConvert(const Pie2Polygons& p2);
+	void backConvert(Pie2Polygons& p2) const;
 
-	static int upConvert(const Pie2Polygon& pie2Poly, std::back_insert_iterator<std::vector<Pie3Polygon> > result);
-	static Pie2Polygon backConvert(const Pie3Polygon& p3);
-	operator Pie2Polygon() const;
-
-	Pie3UV getUV(unsigned index, unsigned frame) const;
-
-private:
+	using PiePolygons::getUV;
+	Pie3UV getUV(size_t polygon, unsigned index, unsigned frame) const;
 };
 
-class Pie3Level : public APieLevel<Pie3Vertex, Pie3Polygon, Pie3Connector>
+class Pie3Level : public APieLevel<Pie3Vertex, Pie3Polygons, Pie3Connector>
 {
-    friend WZM::WZM(const Pie3Model &p3);
+    friend WZM::WZM(const Pie3Model &p3, unsigned threads);
     friend WZM::operator Pie3Model() const;
 public:
 	Pie3Level();
@@ -393,7 +387,7 @@ public:
 
 class Pie3Model : public APieModel<Pie3Level>
 {
-	friend WZM::WZM(const Pie3Model &p3);
+	friend WZM::WZM(const Pie3Model &p3, unsigned threads);
 	friend WZM::operator Pie3Model() const;
 public:
 	Pie3Model();
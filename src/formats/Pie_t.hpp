@@ -37,10 +37,10 @@ APieLevel< V, P, C>::APieLevel(): m_material(true)
 
 // Optional directive
 template<typename V, typename P, typename C>
-bool APieLevel< V, P, C>::readAnimObjectDirective(std::istream& in, PieCaps& caps)
+bool APieLevel< V, P, C>::readAnimObjectDirective(TextReader& in, PieCaps& caps)
 {
 	return tryToReadDirective(in, PIE_MODEL_DIRECTIVE_ANIMOBJECT, true,
-		[this, &caps](std::istream& inn)
+		[this, &caps](TextReader& inn)
 		{
 			caps.set(PIE_OPT_DIRECTIVES::podANIMOBJECT);
 			return m_animobj.read(inn);
@@ -50,11 +50,11 @@ bool APieLevel< V, P, C>::readAnimObjectDirective(std::istream& in, PieCaps& cap
 
 // TODO: Write error messages to std::cerr
 template<typename V, typename P, typename C>
-bool APieLevel< V, P, C>::read(std::istream& in, PieCaps& caps)
+bool APieLevel< V, P, C>::read(TextReader& in, PieCaps& caps)
 {
-	std::string str;
+	std::string_view str;
 	unsigned uint;
-	std::streampos mark;
+	TextReader::pos_type mark;
 
 	clearAll();
 
@@ -118,6 +118,7 @@ bool APieLevel< V, P, C>::read(std::istream& in, PieCaps& caps)
 		uint *= 3;
 		if (uint > 0)
 			caps.set(PIE_OPT_DIRECTIVES::podNORMALS);
+		m_normals.reserve(uint);
 		for (; uint > 0; --uint)
 		{
 			PieNormal normal;
@@ -146,15 +147,14 @@ bool APieLevel< V, P, C>::read(std::istream& in, PieCaps& caps)
 		streamfail();
 	}
 
-	m_polygons.reserve(uint);
+	// Most polygons are triangles
+	m_polygons.reserve(uint, static_cast<size_t>(uint) * 3);
 	for (; uint > 0; --uint)
 	{
-		P poly;
-		if (!poly.read(in))
+		if (!m_polygons.read(in))
 		{
 			streamfail();
 		}
-		m_polygons.emplace_back(poly);
 	}
 
 	mark = in.tellg();
@@ -193,10 +193,9 @@ bool APieLevel< V, P, C>::read(std::istream& in, PieCaps& caps)
 }
 
 template<typename V, typename P, typename C>
-void APieLevel< V, P, C>::write(std::ostream &out, const PieCaps &caps) const
+void APieLevel< V, P, C>::write(TextWriter &out, const PieCaps &caps) const
 {
 	typename std::vector<V>::const_iterator ptIt;
-	typename std::vector<P>::const_iterator polyIt;
 	typename std::list<C>::const_iterator cIt;
 
 	if (caps.test(PIE_OPT_DIRECTIVES::podMATERIALS) && !m_material.isDefault())
@@ -219,7 +218,7 @@ void APieLevel< V, P, C>::write(std::ostream &out, const PieCaps &caps) const
 		size_t nCnt = 0;
 
 		out << "NORMALS " << static_cast<int>(normals() / 3);
-		out << std::fixed;
+		out.setFloatFormat(TextWriter::FLOAT_FIXED);
 		for (auto nIt = m_normals.begin(); nIt != m_normals.end(); ++nIt)
 		{
 			if (nCnt++ % 3 == 0)
@@ -228,15 +227,15 @@ void APieLevel< V, P, C>::write(std::ostream &out, const PieCaps &caps) const
 			if (nCnt % 3 != 0)
 				out << ' ';
 		}
-		out.unsetf(std::ios::floatfield);
+		out.setFloatFormat(TextWriter::FLOAT_GENERAL);
 		out << '\n';
 	}
 
 	out << "POLYGONS " << polygons() << '\n';
-	for (polyIt = m_polygons.begin(); polyIt != m_polygons.end(); ++polyIt)
+	for (size_t poly = 0; poly < m_polygons.size(); ++poly)
 	{
 		out << "\t";
-		polyIt->write(out);
+		m_polygons.write(out, poly);
 	}
 
 	if (caps.test(PIE_OPT_DIRECTIVES::podCONNECTORS) && (connectors() != 0))
@@ -296,14 +295,14 @@ void APieLevel< V, P, C>::clearAll()
 template<typename V, typename P, typename C>
 bool APieLevel<V, P, C>::isValid() const
 {
-	typename std::vector<P>::const_iterator it;
+	size_t poly;
 	unsigned i;
 
-	for (it = m_polygons.begin(); it != m_polygons.end(); ++it)
+	for (poly = 0; poly < m_polygons.size(); ++poly)
 	{
-		for (i = 0; i < it->vertices(); ++i)
+		for (i = 0; i < m_polygons.vertices(poly); ++i)
 		{
-			if (it->getIndex(i) >= m_points.size())
+			if (m_polygons.getIndex(poly, i) >= m_points.size())
 			{
 				return false;
 			}
@@ -313,14 +312,14 @@ bool APieLevel<V, P, C>::isValid() const
 }
 
 template <typename V>
-bool PieConnector<V>::read(std::istream& in)
+bool PieConnector<V>::read(TextReader& in)
 {
 	in >> pos.x() >> pos.y() >> pos.z();
 	return in.good() || in.eof();
 }
 
 template <typename V>
-void PieConnector<V>::write(std::ostream& out) const
+void PieConnector<V>::write(TextWriter& out) const
 {
 	out << pos.x() << ' ' << pos.y() << ' ' << pos.z() << '\n';
 }
@@ -376,6 +375,26 @@ inline bool APieModel<L>::isFeatureSet(unsigned feature) const
 	return (m_read_type & feature);
 }
 
+template <typename L>
+bool APieModel<L>::read(std::istream& in)
+{
+	std::streampos start = in.tellg();
+
+	// Parse the rest of the stream from memory
+	std::string buffer((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	TextReader reader(buffer);
+
+	in.clear();
+	if (read(reader))
+	{
+		in.seekg(start + static_cast<std::streamoff>(reader.tellg() - reader.begin()));
+		return true;
+	}
+
+	in.seekg(start);
+	return false;
+}
+
 #define streamfail() do {\
 	clearAll();	\
 	in.clear();	\
@@ -384,9 +403,9 @@ inline bool APieModel<L>::isFeatureSet(unsigned feature) const
 
 // TODO: Write error messages to std::cerr
 template <typename L>
-bool APieModel<L>::read(std::istream& in)
+bool APieModel<L>::read(TextReader& in)
 {
-	std::streampos start = in.tellg();
+	TextReader::pos_type start = in.tellg();
 
 	clearAll();
 
@@ -402,9 +421,9 @@ bool APieModel<L>::read(std::istream& in)
 #undef streamfail
 
 template <typename L>
-bool APieModel<L>::readHeaderBlock(std::istream& in)
+bool APieModel<L>::readHeaderBlock(TextReader& in)
 {
-	std::string str;
+	std::string_view str;
 	unsigned uint;
 
 	// PIE %u
@@ -415,14 +434,15 @@ bool APieModel<L>::readHeaderBlock(std::istream& in)
 	}
 
 	// TYPE %x
-	in >> str >> std::hex >> m_read_type >> std::dec;
+	in >> str;
+	in.readHex(m_read_type);
 	if ( in.fail() || str.compare(PIE_MODEL_DIRECTIVE_TYPE) != 0)
 	{
 		return false;
 	}
 
 	return tryToReadDirective(in, PIE_MODEL_DIRECTIVE_INTERPOLATE, true,
-		[this](std::istream& inn)
+		[this](TextReader& inn)
 		{
 			unsigned uint;
 
@@ -441,15 +461,15 @@ bool APieModel<L>::readHeaderBlock(std::istream& in)
 }
 
 template <typename L>
-bool APieModel<L>::readTexturesBlock(std::istream& in)
+bool APieModel<L>::readTexturesBlock(TextReader& in)
 {
     return readTextureDirective(in) && readNormalmapDirective(in) && readSpecmapDirective(in);
 }
 
 template <typename L>
-bool APieModel<L>::readTextureDirective(std::istream& in)
+bool APieModel<L>::readTextureDirective(TextReader& in)
 {
-	std::string str;
+	std::string_view str;
 	unsigned uint;
 
 	// TEXTURE 0 %s %u %u
@@ -474,11 +494,11 @@ bool APieModel<L>::readTextureDirective(std::istream& in)
 
 // Optional directive
 template <typename L>
-bool APieModel<L>::readNormalmapDirective(std::istream& in)
+bool APieModel<L>::readNormalmapDirective(TextReader& in)
 {
-	std::string str;
+	std::string_view str;
 	unsigned uint;
-	std::streampos entrypoint = in.tellg();
+	TextReader::pos_type entrypoint = in.tellg();
 
 	// NORMALMAP 0 %s
 	in >> str >> uint >> m_texture_normalmap;
@@ -503,11 +523,11 @@ bool APieModel<L>::readNormalmapDirective(std::istream& in)
 
 // Optional directive
 template <typename L>
-bool APieModel<L>::readSpecmapDirective(std::istream& in)
+bool APieModel<L>::readSpecmapDirective(TextReader& in)
 {
-	std::string str;
+	std::string_view str;
 	unsigned uint;
-	std::streampos entrypoint = in.tellg();
+	TextReader::pos_type entrypoint = in.tellg();
 
 	// <TYPE> 0 %s
 	in >> str >> uint >> m_texture_specmap;
@@ -532,10 +552,10 @@ bool APieModel<L>::readSpecmapDirective(std::istream& in)
 
 // Optional directive
 template <typename L>
-bool APieModel<L>::readEventsDirective(std::istream& in)
+bool APieModel<L>::readEventsDirective(TextReader& in)
 {
-	std::string str;
-	std::streampos entrypoint = in.tellg();
+	std::string_view str;
+	TextReader::pos_type entrypoint = in.tellg();
 
 	// EVENT type filename.pie
 	in >> str;
@@ -558,13 +578,13 @@ bool APieModel<L>::readEventsDirective(std::istream& in)
 	if (in.fail())
 		return false;
 
-	m_events.emplace(type, str);
+	m_events.emplace(type, std::string(str));
 	m_caps.set(PIE_OPT_DIRECTIVES::podEVENT);
 	return true;
 }
 
 template <typename L>
-bool APieModel<L>::readLevelsBlock(std::istream& in)
+bool APieModel<L>::readLevelsBlock(TextReader& in)
 {
 	// Optional sequence of event directives
 	while (readEventsDirective(in)) {}
@@ -581,24 +601,26 @@ bool APieModel<L>::readLevelsBlock(std::istream& in)
 }
 
 template <typename L>
-bool APieModel<L>::readLevels(int levels, std::istream& in)
+bool APieModel<L>::readLevels(int levels, TextReader& in)
 {
+	m_levels.reserve(levels);
 	for (; levels > 0; --levels)
 	{
-		L lvl;
-		if (!lvl.read(in, m_caps))
+		// Read in place, levels are expensive to copy
+		m_levels.emplace_back();
+		if (!m_levels.back().read(in, m_caps))
 		{
+			m_levels.pop_back();
 			return false;
 		}
-		m_levels.push_back(lvl);
 	}
 	return true;
 }
 
 template <typename L>
-int APieModel<L>::readLevelsDirective(std::istream& in)
+int APieModel<L>::readLevelsDirective(TextReader& in)
 {
-	std::string str;
+	std::string_view str;
 	unsigned uint;
 
 	// LEVELS %u
@@ -612,16 +634,18 @@ int APieModel<L>::readLevelsDirective(std::istream& in)
 }
 
 template <typename L>
-void APieModel<L>::write(std::ostream& out, const PieCaps *piecaps) const
+void APieModel<L>::write(std::ostream& stream, const PieCaps *piecaps) const
 {
 	typename std::vector<L>::const_iterator it;
 	unsigned i = 1;
 
 	const PieCaps& caps(piecaps ? *piecaps : m_def_caps);
+	TextWriter out(stream);
 
 	out << PIE_MODEL_SIGNATURE << " " << version() << '\n';
 
-	out << PIE_MODEL_DIRECTIVE_TYPE << " " << std::hex << getType() << std::dec << '\n';
+	out << PIE_MODEL_DIRECTIVE_TYPE << " ";
+	out.writeHex(getType()) << '\n';
 
 	if (caps.test(PIE_OPT_DIRECTIVES::podINTERPOLATE))
 	{
@@ -0,0 +1,434 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TangentSpace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+
+#include "mikktspace.h"
+#include "WZM.h"
+
+// MikkTSpace tangent generation
+//
+// Matches lib/ivis_opengl/imdload.cpp in WZ2100, which uses this same
+// reference implementation. Keeping the two in step is the whole point: WMIT's
+// viewport is only useful as a preview if its tangent frame is the game's.
+//
+// WZ2100 texture coordinates have V pointing DOWN the image while MikkTSpace
+// assumes the standard convention, so it is handed V-flipped coordinates. T is
+// unaffected by that flip and B = dP/dv changes sign, reproducing the -dP/dv
+// bitangent that ordinary OpenGL-convention ("green up") normal maps need.
+// Thus, fSign is used directly as w.
+
+namespace
+{
+	// Smaller meshes, which includes every game model, are done in one pass.
+	// Larger ones always get batches of the same size, whatever the number
+	// of threads, so that the tangents do not depend on the machine.
+	const size_t MIN_SPLIT_TRIANGLES = 16 * 1024;
+	const size_t BATCH_TRIANGLES = 8 * 1024;
+
+	// The triangles handed to one MikkTSpace run
+	struct MikkJob
+	{
+		const TangentSpaceInput* in;
+		const unsigned* faces;	// subset of in->triangles, all of them when null
+		size_t faceCount;
+		WZMVertex4* tangents;
+
+		unsigned index(const int iFace, const int iVert) const
+		{
+			const size_t face = faces ? faces[iFace] : static_cast<size_t>(iFace);
+			const IndexedTri &tri = in->triangles[face];
+			return iVert == 0 ? tri.a() : (iVert == 1 ? tri.b() : tri.c());
+		}
+	};
+
+	inline const MikkJob *mikkJob(const SMikkTSpaceContext *pContext)
+	{
+		return static_cast<const MikkJob *>(pContext->m_pUserData);
+	}
+
+	int mikkGetNumFaces(const SMikkTSpaceContext *pContext)
+	{
+		return static_cast<int>(mikkJob(pContext)->faceCount);
+	}
+
+	int mikkGetNumVerticesOfFace(const SMikkTSpaceContext *, const int)
+	{
+		return 3; // WZM/PIE meshes are triangulated
+	}
+
+	void mikkGetPosition(const SMikkTSpaceContext *pContext, float fvPosOut[], const int iFace, const int iVert)
+	{
+		const MikkJob *job = mikkJob(pContext);
+		const WZMVertex &v = job->in->positions[job->index(iFace, iVert)];
+		fvPosOut[0] = v.x();
+		fvPosOut[1] = v.y();
+		fvPosOut[2] = v.z();
+	}
+
+	void mikkGetNormal(const SMikkTSpaceContext *pContext, float fvNormOut[], const int iFace, const int iVert)
+	{
+		const MikkJob *job = mikkJob(pContext);
+		const WZMVertex &n = job->in->normals[job->index(iFace, iVert)];
+		fvNormOut[0] = n.x();
+		fvNormOut[1] = n.y();
+		fvNormOut[2] = n.z();
+	}
+
+	inline float mikkV(const WZMUV &uv)
+	{
+		return 1.f - uv.v(); // V flip - see the note above
+	}
+
+	void mikkGetTexCoord(const SMikkTSpaceContext *pContext, float fvTexcOut[], const int iFace, const int iVert)
+	{
+		const MikkJob *job = mikkJob(pContext);
+		const WZMUV &uv = job->in->uvs[job->index(iFace, iVert)];
+		fvTexcOut[0] = uv.u();
+		fvTexcOut[1] = mikkV(uv);
+	}
+
+	void mikkSetTSpaceBasic(const SMikkTSpaceContext *pContext, const float fvTangent[], const float fSign, const int iFace, const int iVert)
+	{
+		const MikkJob *job = mikkJob(pContext);
+		job->tangents[job->index(iFace, iVert)] = WZMVertex4(fvTangent[0], fvTangent[1], fvTangent[2], fSign);
+	}
+
+	bool runMikk(const MikkJob& job)
+	{
+		SMikkTSpaceInterface mikkInterface = {};
+		mikkInterface.m_getNumFaces = mikkGetNumFaces;
+		mikkInterface.m_getNumVerticesOfFace = mikkGetNumVerticesOfFace;
+		mikkInterface.m_getPosition = mikkGetPosition;
+		mikkInterface.m_getNormal = mikkGetNormal;
+		mikkInterface.m_getTexCoord = mikkGetTexCoord;
+		mikkInterface.m_setTSpaceBasic = mikkSetTSpaceBasic;
+
+		SMikkTSpaceContext mikkContext = {};
+		mikkContext.m_pInterface = &mikkInterface;
+		mikkContext.m_pUserData = const_cast<MikkJob *>(&job);
+
+		return genTangSpaceDefault(&mikkContext);
+	}
+
+	// What MikkTSpace compares when welding corners, with -0 turned into +0
+	// so that bitwise equal keys are exactly the ones its == accepts
+	struct WeldKey
+	{
+		float val[8];
+
+		bool operator==(const WeldKey& rhs) const
+		{
+			for (int i = 0; i < 8; ++i)
+			{
+				if (!(val[i] == rhs.val[i]))
+					return false;
+			}
+			return true;
+		}
+	};
+
+	struct WeldKeyHash
+	{
+		size_t operator()(const WeldKey& key) const
+		{
+			uint64_t hash = 14695981039346656037ULL;
+			for (int i = 0; i < 8; ++i)
+			{
+				uint32_t bits;
+				std::memcpy(&bits, &key.val[i], sizeof(bits));
+				hash = (hash ^ bits) * 1099511628211ULL;
+			}
+			return static_cast<size_t>(hash ^ (hash >> 32));
+		}
+	};
+
+	WeldKey weldKey(const TangentSpaceInput& in, size_t i)
+	{
+		const WZMVertex &p = in.positions[i], &n = in.normals[i];
+		const WZMUV &uv = in.uvs[i];
+		WeldKey key = {{p.x() + 0.f, p.y() + 0.f, p.z() + 0.f,
+				n.x() + 0.f, n.y() + 0.f, n.z() + 0.f,
+				uv.u() + 0.f, mikkV(uv) + 0.f}};
+		return key;
+	}
+
+	unsigned findRoot(std::vector<unsigned>& parent, unsigned i)
+	{
+		while (parent[i] != i)
+		{
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	}
+
+	void unite(std::vector<unsigned>& parent, unsigned a, unsigned b)
+	{
+		a = findRoot(parent, a);
+		b = findRoot(parent, b);
+		if (a != b)
+			parent[std::max(a, b)] = std::min(a, b);
+	}
+
+	// MikkTSpace's vertex welding depends on the bounds of the positions it
+	// is given, it only reduces to plain equality when they are well behaved
+	bool canSplit(const TangentSpaceInput& in)
+	{
+		const float limit = 1e18f;
+
+		for (size_t i = 0; i < in.vertices; ++i)
+		{
+			const WZMVertex &p = in.positions[i];
+			if (!(std::fabs(p.x()) < limit && std::fabs(p.y()) < limit && std::fabs(p.z()) < limit))
+				return false;
+		}
+		for (size_t i = 0; i < in.triangleCount; ++i)
+		{
+			const IndexedTri &tri = in.triangles[i];
+			if (tri.a() >= in.vertices || tri.b() >= in.vertices || tri.c() >= in.vertices)
+				return false;
+		}
+		return true;
+	}
+
+	// Groups the islands into batches of roughly batchSize triangles, the
+	// triangles of a batch are listed in their original order
+	void buildBatches(const TangentSpaceInput& in, size_t batchSize,
+			  std::vector<std::vector<unsigned>>& batches)
+	{
+		const unsigned none = std::numeric_limits<unsigned>::max();
+		std::vector<unsigned> parent(in.vertices);
+
+		for (size_t i = 0; i < in.vertices; ++i)
+			parent[i] = static_cast<unsigned>(i);
+
+		for (size_t i = 0; i < in.triangleCount; ++i)
+		{
+			const IndexedTri &tri = in.triangles[i];
+			unite(parent, tri.a(), tri.b());
+			unite(parent, tri.a(), tri.c());
+		}
+
+		std::unordered_map<WeldKey, unsigned, WeldKeyHash> welded;
+		welded.reserve(in.vertices);
+		for (size_t i = 0; i < in.vertices; ++i)
+		{
+			auto res = welded.emplace(weldKey(in, i), static_cast<unsigned>(i));
+			if (!res.second)
+				unite(parent, res.first->second, static_cast<unsigned>(i));
+		}
+
+		std::vector<unsigned> islandSize(in.vertices, 0);
+		for (size_t i = 0; i < in.triangleCount; ++i)
+			++islandSize[findRoot(parent, in.triangles[i].a())];
+
+		// Islands go to the batches in the order they are first met
+		std::vector<unsigned> batchOf(in.vertices, none);
+		std::vector<size_t> batchTriangles;
+		size_t load = batchSize;
+		for (size_t i = 0; i < in.triangleCount; ++i)
+		{
+			const unsigned root = findRoot(parent, in.triangles[i].a());
+			if (batchOf[root] != none)
+				continue;
+			if (load >= batchSize)
+			{
+				batchTriangles.push_back(0);
+				load = 0;
+			}
+			batchOf[root] = static_cast<unsigned>(batchTriangles.size() - 1);
+			batchTriangles.back() += islandSize[root];
+			load += islandSize[root];
+		}
+
+		batches.resize(batchTriangles.size());
+		for (size_t i = 0; i < batches.size(); ++i)
+			batches[i].reserve(batchTriangles[i]);
+		for (size_t i = 0; i < in.triangleCount; ++i)
+			batches[batchOf[findRoot(parent, in.triangles[i].a())]].push_back(static_cast<unsigned>(i));
+	}
+}
+
+bool generateTangentSpace(const TangentSpaceInput& in, WZMVertex4* tangents,
+			  unsigned threads, const std::atomic<bool>* cancel,
+			  TangentSpacePasses* passes)
+{
+	if (passes)
+		*passes = TANGENTS_SINGLE_PASS;
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	MikkJob whole = {&in, nullptr, in.triangleCount, tangents};
+
+	if (in.triangleCount < MIN_SPLIT_TRIANGLES || !canSplit(in))
+		return !(cancel && *cancel) && runMikk(whole);
+
+	std::vector<std::vector<unsigned>> batches;
+	buildBatches(in, BATCH_TRIANGLES, batches);
+
+	if (batches.size() < 2)
+		return !(cancel && *cancel) && runMikk(whole);
+
+	// Islands share no vertex, so every batch writes its own tangents
+	std::atomic<size_t> nextBatch(0);
+	std::atomic<bool> failed(false);
+
+	auto worker = [&]()
+	{
+		for (size_t i = nextBatch++; i < batches.size() && !failed && !(cancel && *cancel); i = nextBatch++)
+		{
+			MikkJob job = {&in, batches[i].data(), batches[i].size(), tangents};
+			if (!runMikk(job))
+				failed = true;
+		}
+	};
+
+	threads = static_cast<unsigned>(std::min<size_t>(threads, batches.size()));
+
+	std::vector<std::thread> pool;
+	for (unsigned i = 1; i < threads; ++i)
+	{
+		pool.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : pool)
+	{
+		thread.join();
+	}
+
+	if (cancel && *cancel)
+		return false;
+	if (passes)
+		*passes = TANGENTS_SPLIT;
+	return !failed;
+}
+
+TangentSpaceJob::TangentSpaceJob(const WZM& model, int mesh):
+	m_state(std::make_shared<State>())
+{
+	m_state->cancel = false;
+	m_state->finished = false;
+	m_state->succeeded = false;
+	m_state->abandoned = false;
+
+	for (size_t i = 0; i < model.m_meshes.size(); ++i)
+	{
+		if (mesh >= 0 && static_cast<size_t>(mesh) != i)
+			continue;
+
+		const Mesh& src = model.m_meshes[i];
+		MeshTangents copy;
+		copy.mesh = i;
+		copy.positions = src.m_vertexArray;
+		copy.normals = src.m_normalArray;
+		copy.uvs = src.m_textureArray;
+		copy.triangles = src.m_indexArray;
+		m_state->meshes.push_back(std::move(copy));
+	}
+}
+
+TangentSpaceJob::~TangentSpaceJob()
+{
+	cancel();
+	if (m_thread.joinable())
+	{
+		// A batch of the mesh is not interrupted, so joining could stall the
+		// caller. Once abandoned is set under the lock the worker no longer
+		// calls back into whoever owned the job.
+		std::lock_guard<std::mutex> lock(m_state->callbackMutex);
+		m_state->abandoned = true;
+		m_thread.detach();
+	}
+}
+
+void TangentSpaceJob::start(std::function<void()> onFinished, unsigned threads)
+{
+	if (m_thread.joinable())
+		return;
+
+	std::shared_ptr<State> state = m_state;
+	m_thread = std::thread([state, onFinished, threads]()
+	{
+		run(*state, threads);
+		state->finished = true;
+
+		std::lock_guard<std::mutex> lock(state->callbackMutex);
+		if (onFinished && !state->abandoned)
+			onFinished();
+	});
+}
+
+void TangentSpaceJob::wait()
+{
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void TangentSpaceJob::run(State& state, unsigned threads)
+{
+	state.succeeded = true;
+	for (MeshTangents& mesh: state.meshes)
+	{
+		mesh.tangents.assign(mesh.positions.size(), WZMVertex4());
+		if (mesh.triangles.empty() || mesh.positions.empty())
+			continue;
+
+		TangentSpaceInput in = {mesh.positions.data(), mesh.normals.data(), mesh.uvs.data(), mesh.positions.size(),
+					mesh.triangles.data(), mesh.triangles.size()};
+		if (!generateTangentSpace(in, mesh.tangents.data(), threads, &state.cancel))
+		{
+			state.succeeded = false;
+			return;
+		}
+	}
+}
+
+bool TangentSpaceJob::apply(WZM& model)
+{
+	wait();
+	if (!m_state->finished || !m_state->succeeded || m_state->cancel)
+		return false;
+
+	bool stored = false;
+	for (MeshTangents& result: m_state->meshes)
+	{
+		if (result.mesh >= model.m_meshes.size())
+			continue;
+
+		Mesh& mesh = model.m_meshes[result.mesh];
+		if (mesh.m_vertexArray != result.positions || mesh.m_normalArray != result.normals ||
+				mesh.m_textureArray != result.uvs || mesh.m_indexArray != result.triangles)
+			continue;
+
+		mesh.m_tangentArray.swap(result.tangents);
+		mesh.updateBitangents();
+		stored = true;
+	}
+	m_state->meshes.clear();
+	return stored;
+}
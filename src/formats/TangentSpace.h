@@ -0,0 +1,136 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TANGENTSPACE_HPP
+#define TANGENTSPACE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Mesh.h"
+
+class WZM;
+
+/*
+  The arrays of an indexed triangle mesh, as MikkTSpace reads them.
+  */
+struct TangentSpaceInput
+{
+	const WZMVertex* positions;
+	const WZMVertex* normals;
+	const WZMUV* uvs;
+	size_t vertices;
+	const IndexedTri* triangles;
+	size_t triangleCount;
+};
+
+// How generateTangentSpace() processed a mesh, for tests and benchmarks
+enum TangentSpacePasses
+{
+	TANGENTS_SINGLE_PASS = 0,	// the whole mesh in one pass
+	TANGENTS_SPLIT			// islands run in batches
+};
+
+/*
+  Runs MikkTSpace over the mesh and stores one tangent per vertex in
+  tangents (w is the handedness), which must hold in.vertices entries.
+
+  Meshes of game model size are done in a single pass, exactly as the game
+  does. Larger ones are cut into islands: triangles sharing a vertex, or a
+  corner MikkTSpace would weld (same position, normal and UV), always end up
+  in the same island. The islands are grouped into batches of a fixed size,
+  keeping the original triangle order, and the batches are spread over up
+  to threads workers (0: one per core).
+
+  The result does not depend on the thread count, but it is not always the
+  one of a single pass: MikkTSpace leaves its last run of sorted edges in
+  the order of a quicksort over all edges of the call, and only pairs up
+  triangles whose shared edges end up next to each other. A few vertices on
+  the last edges of every batch can thus get different tangents.
+
+  cancel is polled between batches. Returns false when MikkTSpace failed or
+  the run was cancelled, tangents are incomplete then. When passes is given
+  it receives how the mesh was processed.
+  */
+bool generateTangentSpace(const TangentSpaceInput& in, WZMVertex4* tangents,
+			  unsigned threads = 0, const std::atomic<bool>* cancel = nullptr,
+			  TangentSpacePasses* passes = nullptr);
+
+/*
+  Tangent generation on a background thread, for keeping a UI responsive.
+
+  The job works on a copy of the geometry of the meshes, so the model can
+  be used meanwhile. apply() stores the result on the calling thread, and
+  skips every mesh whose geometry no longer matches the copy.
+
+  Destroying a running job does not wait for it: the worker is cancelled
+  and left to finish on its own with the copy, without calling onFinished.
+  */
+class TangentSpaceJob
+{
+public:
+	// Copies the geometry of one mesh of the model, or of all when mesh < 0
+	TangentSpaceJob(const WZM& model, int mesh = -1);
+	~TangentSpaceJob();	// cancels, see above
+
+	TangentSpaceJob(const TangentSpaceJob&) = delete;
+	TangentSpaceJob& operator=(const TangentSpaceJob&) = delete;
+
+	// onFinished is called on the worker thread, also after a cancel
+	void start(std::function<void()> onFinished = std::function<void()>(), unsigned threads = 0);
+	void cancel() {m_state->cancel = true;}
+	void wait();
+	bool isFinished() const {return m_state->finished;}
+
+	// Waits for the job, false when it was cancelled or nothing was stored
+	bool apply(WZM& model);
+
+private:
+	struct MeshTangents
+	{
+		size_t mesh;
+		std::vector<WZMVertex> positions;
+		std::vector<WZMVertex> normals;
+		std::vector<WZMUV> uvs;
+		std::vector<IndexedTri> triangles;
+		std::vector<WZMVertex4> tangents;
+	};
+
+	// Owned together with the worker, which may outlive the job
+	struct State
+	{
+		std::vector<MeshTangents> meshes;
+		std::atomic<bool> cancel, finished;
+		bool succeeded;
+		std::mutex callbackMutex;	// held while calling onFinished
+		bool abandoned;			// the job is gone, skip onFinished
+	};
+
+	static void run(State& state, unsigned threads);
+
+	std::shared_ptr<State> m_state;
+	std::thread m_thread;
+};
+
+#endif // TANGENTSPACE_HPP
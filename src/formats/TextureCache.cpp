@@ -0,0 +1,415 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TextureCache.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "ModelCache.h"
+#include "TextReader.h"
+
+namespace
+{
+
+const char CACHE_MAGIC[8] = {'W', 'M', 'I', 'T', 'T', 'E', 'X', 'C'};
+const uint32_t CACHE_BYTE_ORDER = 0x01020304;
+const uint32_t CACHE_END_MARKER = 0x444E4557; // "WEND"
+const uint32_t MAX_LEVELS = 32;
+
+struct CacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t hash;
+	uint64_t size;
+	uint32_t format;
+	uint32_t levels;
+};
+
+struct LevelHeader
+{
+	uint32_t width;
+	uint32_t height;
+	uint64_t bytes;
+};
+
+size_t levelBytes(TextureFormat format, uint32_t width, uint32_t height)
+{
+	if (format == WMIT_TEXTURE_BC3)
+		return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * 16;
+	return static_cast<size_t>(width) * height * 4;
+}
+
+void downsample(const uint8_t* src, uint32_t width, uint32_t height, size_t stride, TextureLevel& dst)
+{
+	dst.width = std::max(width / 2, 1u);
+	dst.height = std::max(height / 2, 1u);
+	dst.data.resize(levelBytes(WMIT_TEXTURE_RGBA8, dst.width, dst.height));
+
+	uint8_t* out = dst.data.data();
+	for (uint32_t y = 0; y < dst.height; ++y)
+	{
+		const uint8_t* row0 = src + std::min(2 * y, height - 1) * stride;
+		const uint8_t* row1 = src + std::min(2 * y + 1, height - 1) * stride;
+
+		for (uint32_t x = 0; x < dst.width; ++x)
+		{
+			const size_t x0 = std::min(2 * x, width - 1) * 4;
+			const size_t x1 = std::min(2 * x + 1, width - 1) * 4;
+
+			for (int c = 0; c < 4; ++c)
+			{
+				*out++ = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] +
+							      row1[x0 + c] + row1[x1 + c] + 2) / 4);
+			}
+		}
+	}
+}
+
+inline uint16_t toRGB565(const uint8_t* rgb)
+{
+	return static_cast<uint16_t>(((rgb[0] * 31 + 127) / 255) << 11 |
+				     ((rgb[1] * 63 + 127) / 255) << 5 |
+				     ((rgb[2] * 31 + 127) / 255));
+}
+
+inline void fromRGB565(uint16_t c, int* rgb)
+{
+	const int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+void encodeAlphaBlock(const uint8_t block[16][4], uint8_t* out)
+{
+	int amin = 255, amax = 0;
+	for (int i = 0; i < 16; ++i)
+	{
+		amin = std::min<int>(amin, block[i][3]);
+		amax = std::max<int>(amax, block[i][3]);
+	}
+
+	out[0] = static_cast<uint8_t>(amax);
+	out[1] = static_cast<uint8_t>(amin);
+
+	// Eight value mode (alpha0 > alpha1), a flat block keeps all indices at 0
+	int palette[8] = {amax, amin};
+	for (int i = 1; i < 7; ++i)
+		palette[i + 1] = ((7 - i) * amax + i * amin) / 7;
+
+	uint64_t bits = 0;
+	if (amax != amin)
+	{
+		for (int i = 0; i < 16; ++i)
+		{
+			int best = 0, bestDist = 256;
+			for (int j = 0; j < 8; ++j)
+			{
+				const int dist = std::abs(block[i][3] - palette[j]);
+				if (dist < bestDist)
+				{
+					best = j;
+					bestDist = dist;
+				}
+			}
+			bits |= static_cast<uint64_t>(best) << (3 * i);
+		}
+	}
+
+	for (int i = 0; i < 6; ++i)
+		out[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+}
+
+void encodeColourBlock(const uint8_t block[16][4], uint8_t* out)
+{
+	uint8_t cmin[3] = {255, 255, 255}, cmax[3] = {0, 0, 0};
+	for (int i = 0; i < 16; ++i)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			cmin[c] = std::min(cmin[c], block[i][c]);
+			cmax[c] = std::max(cmax[c], block[i][c]);
+		}
+	}
+
+	// Pull the bounding box in a bit, the interpolated colours cover the ends better then
+	for (int c = 0; c < 3; ++c)
+	{
+		const int inset = (cmax[c] - cmin[c]) / 16;
+		cmin[c] = static_cast<uint8_t>(cmin[c] + inset);
+		cmax[c] = static_cast<uint8_t>(cmax[c] - inset);
+	}
+
+	uint16_t c0 = toRGB565(cmax), c1 = toRGB565(cmin);
+	if (c0 < c1)
+		std::swap(c0, c1);
+
+	// Four colour mode needs c0 > c1, equal end points give a flat block with all indices at 0
+	uint32_t bits = 0;
+	if (c0 != c1)
+	{
+		int palette[4][3];
+		fromRGB565(c0, palette[0]);
+		fromRGB565(c1, palette[1]);
+		for (int c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		for (int i = 0; i < 16; ++i)
+		{
+			int best = 0, bestDist = 3 * 256 * 256;
+			for (int j = 0; j < 4; ++j)
+			{
+				int dist = 0;
+				for (int c = 0; c < 3; ++c)
+				{
+					const int d = block[i][c] - palette[j][c];
+					dist += d * d;
+				}
+				if (dist < bestDist)
+				{
+					best = j;
+					bestDist = dist;
+				}
+			}
+			bits |= static_cast<uint32_t>(best) << (2 * i);
+		}
+	}
+
+	out[0] = static_cast<uint8_t>(c0);
+	out[1] = static_cast<uint8_t>(c0 >> 8);
+	out[2] = static_cast<uint8_t>(c1);
+	out[3] = static_cast<uint8_t>(c1 >> 8);
+	for (int i = 0; i < 4; ++i)
+		out[4 + i] = static_cast<uint8_t>(bits >> (8 * i));
+}
+
+void compressLevelBC3(const TextureLevel& src, TextureLevel& dst)
+{
+	dst.width = src.width;
+	dst.height = src.height;
+	dst.data.resize(levelBytes(WMIT_TEXTURE_BC3, src.width, src.height));
+
+	uint8_t* out = dst.data.data();
+	uint8_t block[16][4];
+	for (uint32_t by = 0; by < src.height; by += 4)
+	{
+		for (uint32_t bx = 0; bx < src.width; bx += 4)
+		{
+			for (uint32_t y = 0; y < 4; ++y)
+			{
+				const size_t row = std::min(by + y, src.height - 1) * static_cast<size_t>(src.width);
+				for (uint32_t x = 0; x < 4; ++x)
+				{
+					const size_t texel = (row + std::min(bx + x, src.width - 1)) * 4;
+					memcpy(block[y * 4 + x], &src.data[texel], 4);
+				}
+			}
+
+			encodeAlphaBlock(block, out);
+			encodeColourBlock(block, out + 8);
+			out += 16;
+		}
+	}
+}
+
+} // namespace
+
+size_t TextureChain::byteSize() const
+{
+	size_t bytes = 0;
+	for (const TextureLevel& level : levels)
+		bytes += level.data.size();
+	return bytes;
+}
+
+void buildMipChain(const uint8_t* rgba, uint32_t width, uint32_t height, size_t stride,
+		   TextureChain& chain)
+{
+	chain.format = WMIT_TEXTURE_RGBA8;
+	chain.levels.clear();
+	if (width == 0 || height == 0)
+		return;
+
+	chain.levels.emplace_back();
+	TextureLevel& base = chain.levels.back();
+	base.width = width;
+	base.height = height;
+	base.data.resize(levelBytes(WMIT_TEXTURE_RGBA8, width, height));
+	for (uint32_t y = 0; y < height; ++y)
+		memcpy(&base.data[y * static_cast<size_t>(width) * 4], rgba + y * stride, width * 4);
+
+	while (chain.levels.back().width > 1 || chain.levels.back().height > 1)
+	{
+		TextureLevel next;
+		const TextureLevel& prev = chain.levels.back();
+		downsample(prev.data.data(), prev.width, prev.height, prev.width * 4, next);
+		chain.levels.push_back(std::move(next));
+	}
+}
+
+void compressChainBC3(const TextureChain& rgba, TextureChain& bc3)
+{
+	TextureChain out;
+	out.format = WMIT_TEXTURE_BC3;
+	out.levels.resize(rgba.levels.size());
+	for (size_t i = 0; i < rgba.levels.size(); ++i)
+		compressLevelBC3(rgba.levels[i], out.levels[i]);
+	bc3 = std::move(out);
+}
+
+TextureCacheKey TextureCache::makeKey(const char* data, size_t size, TextureFormat format)
+{
+	TextureCacheKey key;
+	// Independent of the model cache version, models and textures are invalidated separately
+	key.hash = ModelCache::hashBytes(data, size, WMIT_TEXTURE_CACHE_VERSION);
+	key.size = size;
+	key.format = format;
+	return key;
+}
+
+std::string TextureCache::entryPath(const std::string& dir, const TextureCacheKey& key)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%016llx-%u" WMIT_TEXTURE_CACHE_EXT,
+		 static_cast<unsigned long long>(key.hash), key.format);
+	return dir + '/' + name;
+}
+
+bool TextureCache::read(const std::string& path, const TextureCacheKey& key, TextureChain& chain)
+{
+	MappedFile mapped(path.c_str());
+	if (!mapped.isOpen())
+		return false;
+
+	const char* cur = mapped.data();
+	const char* const end = mapped.data() + mapped.size();
+
+	CacheHeader header;
+	if (static_cast<size_t>(end - cur) < sizeof(header))
+		return false;
+	memcpy(&header, cur, sizeof(header));
+	cur += sizeof(header);
+
+	if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+	    header.version != WMIT_TEXTURE_CACHE_VERSION ||
+	    header.byteOrder != CACHE_BYTE_ORDER ||
+	    header.hash != key.hash || header.size != key.size ||
+	    header.format != key.format || header.levels == 0 || header.levels > MAX_LEVELS)
+	{
+		return false;
+	}
+
+	TextureChain tmp;
+	tmp.format = static_cast<TextureFormat>(header.format);
+	tmp.levels.resize(header.levels);
+	for (TextureLevel& level : tmp.levels)
+	{
+		LevelHeader lh;
+		if (static_cast<size_t>(end - cur) < sizeof(lh))
+			return false;
+		memcpy(&lh, cur, sizeof(lh));
+		cur += sizeof(lh);
+
+		// The uploader trusts the sizes, do not let a damaged entry through
+		if (lh.width == 0 || lh.height == 0 ||
+		    lh.bytes != levelBytes(tmp.format, lh.width, lh.height) ||
+		    static_cast<uint64_t>(end - cur) < lh.bytes)
+		{
+			return false;
+		}
+
+		level.width = lh.width;
+		level.height = lh.height;
+		level.data.assign(cur, cur + lh.bytes);
+		cur += lh.bytes;
+	}
+
+	uint32_t marker;
+	if (static_cast<size_t>(end - cur) != sizeof(marker))
+		return false;
+	memcpy(&marker, cur, sizeof(marker));
+	if (marker != CACHE_END_MARKER)
+		return false;
+
+	chain = std::move(tmp);
+	return true;
+}
+
+bool TextureCache::write(const std::string& path, const TextureCacheKey& key, const TextureChain& chain)
+{
+	if (chain.isNull() || chain.levels.size() > MAX_LEVELS)
+		return false;
+
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = WMIT_TEXTURE_CACHE_VERSION;
+	header.byteOrder = CACHE_BYTE_ORDER;
+	header.hash = key.hash;
+	header.size = key.size;
+	header.format = key.format;
+	header.levels = static_cast<uint32_t>(chain.levels.size());
+
+	const std::string tmpPath = ModelCache::temporaryPath(path);
+
+	std::ofstream f(tmpPath.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!f.is_open())
+		return false;
+
+	f.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (const TextureLevel& level : chain.levels)
+	{
+		LevelHeader lh;
+		memset(&lh, 0, sizeof(lh));
+		lh.width = level.width;
+		lh.height = level.height;
+		lh.bytes = level.data.size();
+		f.write(reinterpret_cast<const char*>(&lh), sizeof(lh));
+		f.write(reinterpret_cast<const char*>(level.data.data()), static_cast<std::streamsize>(level.data.size()));
+	}
+	f.write(reinterpret_cast<const char*>(&CACHE_END_MARKER), sizeof(CACHE_END_MARKER));
+	f.close();
+
+	if (!f)
+	{
+		remove(tmpPath.c_str());
+		return false;
+	}
+
+	// rename() does not replace existing files everywhere
+	if (rename(tmpPath.c_str(), path.c_str()) != 0)
+	{
+		remove(path.c_str());
+		if (rename(tmpPath.c_str(), path.c_str()) != 0)
+		{
+			remove(tmpPath.c_str());
+			return false;
+		}
+	}
+	return true;
+}
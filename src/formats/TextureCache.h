@@ -0,0 +1,110 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TEXTURECACHE_HPP
+#define TEXTURECACHE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define WMIT_TEXTURE_CACHE_VERSION 1
+#define WMIT_TEXTURE_CACHE_EXT ".wmittex"
+// Least recently used entries beyond this are deleted, together with the
+// viewer's shader program binaries, see pruneCacheDirectory()
+#define WMIT_TEXTURE_CACHE_MAX_BYTES (512LL * 1024 * 1024)
+
+enum TextureFormat
+{
+	WMIT_TEXTURE_RGBA8 = 0,	// 4 bytes per texel, R G B A
+	WMIT_TEXTURE_BC3	// S3TC DXT5, 16 bytes per 4x4 block
+};
+
+struct TextureLevel
+{
+	uint32_t width;
+	uint32_t height;
+	std::vector<uint8_t> data;
+
+	TextureLevel(): width(0), height(0) {}
+};
+
+/*
+  A texture with its complete mip chain, level 0 is the full image and the
+  last level is 1x1.
+  */
+struct TextureChain
+{
+	TextureFormat format;
+	std::vector<TextureLevel> levels;
+
+	TextureChain(): format(WMIT_TEXTURE_RGBA8) {}
+
+	bool isNull() const {return levels.empty();}
+	size_t byteSize() const;
+};
+
+/*
+  Builds the mip chain of an RGBA8 image with a 2x2 box filter. Every level
+  halves the size of the previous one (rounding down, never below 1), the
+  last row or column of an odd sized level only contributes to the level
+  right below it. stride is the distance between scanlines in bytes.
+  */
+void buildMipChain(const uint8_t* rgba, uint32_t width, uint32_t height, size_t stride,
+		   TextureChain& chain);
+
+// BC3 encodes every level of an RGBA8 chain, edge blocks repeat the last texels
+void compressChainBC3(const TextureChain& rgba, TextureChain& bc3);
+
+/*
+  Identifies a texture source: a hash of the image file bytes and the format
+  the chain is stored in.
+  */
+struct TextureCacheKey
+{
+	uint64_t hash;
+	uint64_t size;
+	uint32_t format;
+
+	TextureCacheKey(): hash(0), size(0), format(WMIT_TEXTURE_RGBA8) {}
+};
+
+/*
+  Decoded and downsampled textures on disk, so reopening a model skips both
+  the image decoder and the mip chain generation.
+
+  Entries are a fixed header followed by the levels, written the same way as
+  the model cache ones (temporary file renamed in place). Every saved version
+  of an image gets its own entry, the old ones are left to the size limit.
+  */
+class TextureCache
+{
+public:
+	static TextureCacheKey makeKey(const char* data, size_t size, TextureFormat format);
+
+	// "<hash>-<format>.wmittex" below dir
+	static std::string entryPath(const std::string& dir, const TextureCacheKey& key);
+
+	// Fails (without output) when the entry is missing, stale or of another version
+	static bool read(const std::string& path, const TextureCacheKey& key, TextureChain& chain);
+	static bool write(const std::string& path, const TextureCacheKey& key, const TextureChain& chain);
+};
+
+#endif // TEXTURECACHE_HPP
@@ -20,14 +20,21 @@
 #include "WZM.h"
 
 #include <algorithm>
+#include <atomic>
 #include <iterator>
 #include <map>
 #include <set>
 #include <list>
 
+#include <charconv>
 #include <cmath>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <mutex>
 
 #include <sstream>
+#include <thread>
 
 #include "Generic.h"
 #include "Util.h"
@@ -65,6 +72,15 @@ std::istream& operator>> (std::istream& in, WZMaterial& mat)
 	return in;
 }
 
+TextReader& operator>> (TextReader& in, WZMaterial& mat)
+{
+    if (!mat.m_skipemissive)
+        in >> mat.vals[WZM_MAT_EMISSIVE];
+    in >> mat.vals[WZM_MAT_AMBIENT] >> mat.vals[WZM_MAT_DIFFUSE] >> mat.vals[WZM_MAT_SPECULAR];
+	in >> mat.shininess;
+	return in;
+}
+
 std::ostream& operator<< (std::ostream& out, const WZMaterial& mat)
 {
     if (!mat.m_skipemissive)
@@ -74,12 +90,21 @@ std::ostream& operator<< (std::ostream& out, const WZMaterial& mat)
 	return out;
 }
 
+TextWriter& operator<< (TextWriter& out, const WZMaterial& mat)
+{
+    if (!mat.m_skipemissive)
+        out << mat.vals[WZM_MAT_EMISSIVE];
+    out << mat.vals[WZM_MAT_AMBIENT] << mat.vals[WZM_MAT_DIFFUSE] << mat.vals[WZM_MAT_SPECULAR];
+	out << mat.shininess;
+	return out;
+}
+
 WZM::WZM(): m_pie_read_type(0),
 	m_ani_interpolate(PIE_MODEL_DEF_INTERPOLATE)
 {
 }
 
-WZM::WZM(const Pie3Model &p3)
+WZM::WZM(const Pie3Model &p3, unsigned threads)
 {
 	std::vector<Pie3Level>::const_iterator it;
 	std::stringstream ss;
@@ -98,7 +123,7 @@ WZM::WZM(const Pie3Model &p3)
 
 	for (it = p3.m_levels.begin(); it != p3.m_levels.end(); ++it)
 	{
-		m_meshes.push_back(*it);
+		m_meshes.push_back(Mesh(*it, threads));
 
 		// name
 		ss << m_meshes.size();
@@ -252,9 +277,10 @@ bool WZM::read(std::istream& in)
 	return true;
 }
 
-void WZM::write(std::ostream& out) const
+void WZM::write(std::ostream& stream) const
 {
 	std::vector<Mesh>::const_iterator it;
+	TextWriter out(stream);
 
 	out << "WZM " << version() << '\n';
 
@@ -301,22 +327,164 @@ void WZM::write(std::ostream& out) const
 	}
 }
 
+bool WZM::importFromOBJ(std::istream& in, bool welder, unsigned threads)
+{
+	const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	TextReader reader(text);
+	return importFromOBJ(reader, welder, threads);
+}
+
+struct OBJRecordCounts
+{
+	size_t verts, uvs, normals, faces;
+};
+
+// Cheap first pass over the text, only looks at the first characters of each line
+static OBJRecordCounts countOBJRecords(const char* pos, const char* end)
+{
+	OBJRecordCounts counts = {0, 0, 0, 0};
+
+	while (pos != end)
+	{
+		if (*pos == 'v')
+		{
+			const char next = pos + 1 != end ? pos[1] : '\0';
+			if (next == 't')
+				++counts.uvs;
+			else if (next == 'n')
+				++counts.normals;
+			else if (next != 'p')
+				++counts.verts;
+		}
+		else if (*pos == 'f')
+		{
+			++counts.faces;
+		}
+
+		pos = static_cast<const char*>(memchr(pos, '\n', static_cast<size_t>(end - pos)));
+		if (!pos)
+			break;
+		++pos;
+	}
+
+	return counts;
+}
+
+/*
+ * One index of a face vertex. Negative indices are relative to the last
+ * element defined so far (-1 is the last one). Like a failed stream
+ * extraction, an unparsable index yields 0.
+ */
+static long long parseOBJIndex(std::string_view str, size_t defined)
+{
+	const char* pos = str.data();
+	const char* end = pos + str.size();
+	bool negative = false;
+	long long val;
+
+	if (pos != end && (*pos == '-' || *pos == '+'))
+	{
+		negative = *pos == '-';
+		++pos;
+	}
+
+	if (std::from_chars(pos, end, val).ec != std::errc())
+	{
+		return 0;
+	}
+
+	return negative ? static_cast<long long>(defined) + 1 - val : val;
+}
+
+/*
+ * Narrows a parsed index for OBJTri. Whatever cannot be a 1-based index
+ * becomes 0, which the range check of the object then rejects.
+ */
+static GLint narrowOBJIndex(long long index)
+{
+	return index < 1 || index > std::numeric_limits<GLint>::max() ? 0 : static_cast<GLint>(index);
+}
+
+/*
+ * Builds one mesh per object on a small pool of threads (0: one per core),
+ * threads left over are shared among the meshes for their tangents. Every
+ * worker writes only its own slot of m_meshes and reads the shared arrays,
+ * so the result does not depend on scheduling. An exception in a worker
+ * stops the others and is rethrown here once all have joined.
+ */
+void WZM::buildOBJMeshes(const std::vector<OBJObject>& objects,
+			 const std::vector<OBJTri>& faces,
+			 const std::vector<OBJVertex>& verts,
+			 const std::vector<OBJUV>& uvs,
+			 const std::vector<OBJVertex>& normals,
+			 bool welder, unsigned threads)
+{
+	std::atomic<size_t> nextObject(0);
+	std::atomic<bool> failed(false);
+	std::exception_ptr error;
+	std::mutex errorMutex;
+
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	const unsigned poolThreads = static_cast<unsigned>(std::min<size_t>(threads, objects.size()));
+	const unsigned meshThreads = std::max(1u, threads / std::max(1u, poolThreads));
+
+	m_meshes.resize(objects.size());
+
+	auto worker = [&]()
+	{
+		try
+		{
+			for (size_t i = nextObject++; i < objects.size() && !failed; i = nextObject++)
+			{
+				Mesh& mesh = m_meshes[i];
+				mesh.importFromOBJ(faces.begin() + static_cast<std::ptrdiff_t>(objects[i].first),
+						   faces.begin() + static_cast<std::ptrdiff_t>(objects[i].last),
+						   verts, uvs, normals, welder, meshThreads);
+				mesh.mirrorFromPoint(WZMVertex(), 0);
+				mesh.reverseWinding();
+				mesh.setTeamColours(false);
+				mesh.setName(objects[i].name);
+			}
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(errorMutex);
+			if (!error)
+				error = std::current_exception();
+			failed = true;
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned i = 1; i < poolThreads; ++i)
+	{
+		pool.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : pool)
+	{
+		thread.join();
+	}
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
 /*
  * This function does the parsing,
  * we'll let class Mesh do the WZM'izing
  */
-bool WZM::importFromOBJ(std::istream& in, bool welder)
+bool WZM::importFromOBJ(TextReader& in, bool welder, unsigned threads)
 {
 	const bool invertV = true;
 	std::vector<OBJVertex> vertArray, normArray;
 	std::vector<OBJUV> uvArray;
 	std::vector<OBJTri> groupedFaces;
+	std::vector<OBJObject> objects;
 
 	std::string name("Default"); //Default name of default obj group is default
-	std::vector<std::string> vertices, indices;
-	std::vector<std::string>::iterator itVStr;
-	std::string str;
-	std::stringstream ss;
+	std::string_view line, token;
 
 	// Only give warnings once
 	bool warnLine = false, warnPoint = false;
@@ -330,6 +498,43 @@ bool WZM::importFromOBJ(std::istream& in, bool welder)
 
 	clear();
 
+	const OBJRecordCounts counts = countOBJRecords(in.tellg(), in.end());
+	vertArray.reserve(counts.verts);
+	uvArray.reserve(counts.uvs);
+	normArray.reserve(counts.normals);
+	groupedFaces.reserve(counts.faces);
+
+	// Closes the current object, its faces may only use what is defined so far
+	auto addGroupedFaces = [&]() -> bool
+	{
+		const size_t first = objects.empty() ? 0 : objects.back().last;
+
+		// Mesh::importFromOBJ indexes the arrays unchecked, UVs and normals
+		// may be left out (-1)
+		auto inRange = [](long long index, size_t defined)
+		{
+			return index >= 1 && static_cast<unsigned long long>(index) <= defined;
+		};
+
+		for (size_t face = first; face < groupedFaces.size(); ++face)
+		{
+			const OBJTri& checked = groupedFaces[face];
+			for (i = 0; i < 3; ++i)
+			{
+				if (!inRange(checked.tri[i], vertArray.size()) ||
+				    (checked.uvs[i] != -1 && !inRange(checked.uvs[i], uvArray.size())) ||
+				    (checked.nrm[i] != -1 && !inRange(checked.nrm[i], normArray.size())))
+				{
+					std::cerr << "WZM::importFromOBJ - Face index out of range in object \"" << name << "\"" << std::endl;
+					return false;
+				}
+			}
+		}
+
+		objects.push_back({name, first, groupedFaces.size()});
+		return true;
+	};
+
 	/*	Build "global" vertex and
 	 *	texture coordinate arrays.
 	 *	Also figure out the mesh/group boundaries
@@ -339,29 +544,28 @@ bool WZM::importFromOBJ(std::istream& in, bool welder)
 	 * because it accepts any whitespace as a space.
 	 */
 
-	while (!(in.eof()|| in.fail()))
+	while (in.getline(line))
 	{
-		std::getline(in, str);
-		ss.str(str);
-		ss.seekg(0);
-		ss.clear();
-
-		if (str.empty() || ss.fail())
+		if (line.empty())
 		{
 			continue;
 		}
 
-		switch(ss.get())
+		// The directive is the very first character, vertex records are two
+		// characters wide, faces skip their whole first word
+		TextReader record(line.substr(std::min<size_t>(line[0] == 'v' ? 2 : line[0] == 'f' ? 0 : 1, line.size())));
+
+		switch(line[0])
 		{
 		case '#':
 			// ignore comments
 			continue;
 		case 'v':
-			switch(ss.get())
+			switch(line.size() > 1 ? line[1] : '\0')
 			{
 			case 't':
-				ss >> uv.u() >> uv.v();
-				if (ss.fail())
+				record >> uv.u() >> uv.v();
+				if (record.fail())
 				{
 					return false;
 				}
@@ -372,8 +576,8 @@ bool WZM::importFromOBJ(std::istream& in, bool welder)
 				uvArray.push_back(uv);
 				break;
 			case 'n':	// normals
-				ss >> vert.x() >> vert.y() >> vert.z();
-				if (ss.fail())
+				record >> vert.x() >> vert.y() >> vert.z();
+				if (record.fail())
 				{
 					return false;
 				}
@@ -382,8 +586,8 @@ bool WZM::importFromOBJ(std::istream& in, bool welder)
 			case 'p':	// and parameter vertices
 				break;
 			default:
-				ss >> vert.x() >> vert.y() >> vert.z();
-				if (ss.fail())
+				record >> vert.x() >> vert.y() >> vert.z();
+				if (record.fail())
 				{
 					return false;
 				}
@@ -391,19 +595,9 @@ bool WZM::importFromOBJ(std::istream& in, bool welder)
 			}
 			break;
 		case 'f':
-			vertices = split(str);
-			if (vertices.size() < 2 + 1)
-			{
-				 /* Should never happen, faces will have >= 3+1 tokens
-				  * ( more than 3 vertices + the "f" directive)
-				  */
-				break;
-			}
+			record >> token;
 
-			itVStr = vertices.begin();
-			++itVStr; // Advance to first vertex
-
-			for (i = 0; itVStr != vertices.end(); ++itVStr, ++i)
+			for (i = 0; record >> token, !record.fail(); ++i)
 			{
 				if (i <= 2)
 				{
@@ -416,31 +610,34 @@ bool WZM::importFromOBJ(std::istream& in, bool welder)
 					pos = 2;
 				}
 
-				indices = split(*itVStr, '/');
-
-				ss.str(indices[0]), ss.clear(), ss.seekg(0);
+				// v, v/vt, v//vn or v/vt/vn
+				const size_t vEnd = token.find('/');
+				tri.tri.operator [](pos) = static_cast<IndexedTri::indexType>(
+							narrowOBJIndex(parseOBJIndex(token.substr(0, vEnd), vertArray.size())));
+				tri.uvs.operator [](pos) = -1;
+				tri.nrm.operator [](pos) = -1;
 
-				ss >> tri.tri.operator [](pos);
-
-				if (indices.size() >= 2 && !indices[1].empty())
-				{
-					ss.str(indices[1]), ss.clear(), ss.seekg(0);
-					ss >> tri.uvs.operator [](pos);
-				}
-				else
+				if (vEnd != std::string_view::npos)
 				{
-					tri.uvs.operator [](pos) = -1;
-					tri.nrm.operator [](pos) = -1;
-				}
-
-				if (indices.size() == 3 && !indices[2].empty())
-				{
-					ss.str(indices[2]), ss.clear(), ss.seekg(0);
-					ss >> tri.nrm.operator [](pos);
-				}
-				else
-				{
-					tri.nrm.operator [](pos) = -1;
+					const std::string_view rest = token.substr(vEnd + 1);
+					const size_t uvEnd = rest.find('/');
+
+					if (uvEnd != 0 && !rest.empty())
+					{
+						tri.uvs.operator [](pos) = narrowOBJIndex(
+									parseOBJIndex(rest.substr(0, uvEnd), uvArray.size()));
+					}
+
+					if (uvEnd != std::string_view::npos)
+					{
+						const std::string_view nrm = rest.substr(uvEnd + 1);
+						// a fourth part voids the normal
+						if (!nrm.empty() && nrm.find('/') == std::string_view::npos)
+						{
+							tri.nrm.operator [](pos) = narrowOBJIndex(
+										parseOBJIndex(nrm, normArray.size()));
+						}
+					}
 				}
 
 				if (i >= 2)
@@ -466,123 +663,79 @@ bool WZM::importFromOBJ(std::istream& in, bool welder)
 			}
 			break;
 		case 'o':
-			if (!groupedFaces.empty())
+			if (groupedFaces.size() > (objects.empty() ? 0 : objects.back().last) && !addGroupedFaces())
 			{
-				m_meshes.push_back(Mesh());
-				Mesh& mesh = m_meshes.back();
-				mesh.importFromOBJ(groupedFaces, vertArray, uvArray, normArray, welder);
-				mesh.mirrorFromPoint(WZMVertex(), 0);
-				mesh.reverseWinding();
-				mesh.setTeamColours(false);
-				mesh.setName(name);
-				groupedFaces.clear();
+				return false;
+			}
+			record >> token;
+			if (!record.fail())
+			{
+				name.assign(token.data(), token.size());
 			}
-			ss >> name;
 			if (!isValidWzName(name))
 			{
-				ss.str(std::string()), ss.clear(), ss.seekg(0);
-				ss << m_meshes.size();
-				ss >> name;
+				name = std::to_string(objects.size());
 			}
 			break;
 		}
 	}
-	if (!groupedFaces.empty())
+	if (groupedFaces.size() > (objects.empty() ? 0 : objects.back().last) && !addGroupedFaces())
 	{
-		m_meshes.push_back(Mesh());
-		Mesh& mesh = m_meshes.back();
-		mesh.importFromOBJ(groupedFaces, vertArray, uvArray, normArray, welder);
-		mesh.mirrorFromPoint(WZMVertex(), 0);
-		mesh.reverseWinding();
-		mesh.setTeamColours(false);
-		mesh.setName(name);
+		return false;
 	}
+
+	buildOBJMeshes(objects, groupedFaces, vertArray, uvArray, normArray, welder, threads);
 	return true;
 }
 
-void WZM::exportToOBJ(std::ostream &out) const
+void WZM::exportToOBJ(std::ostream &stream) const
 {
-	std::list<std::stringstream*> objectBuffers;
-
-	Mesh_exportToOBJ_InOutParams params;
-
-	OBJVertex::less_wEps vertCompare;
-	std::set<OBJVertex, OBJVertex::less_wEps> vertSet(vertCompare);
-	std::vector<OBJVertex> vertices;
-	std::vector<unsigned> vertMapping;
-
-	params.vertices = &vertices;
-	params.vertSet = &vertSet;
-	params.vertMapping = &vertMapping;
-
-	OBJUV::less_wEps uvCompare;
-	std::set<OBJUV, OBJUV::less_wEps> uvSet(uvCompare);
-	std::vector<OBJUV> uvs;
-	std::vector<unsigned> uvMapping;
-
-	params.uvs = &uvs;
-	params.uvSet = &uvSet;
-	params.uvMapping = &uvMapping;
-
-	OBJVertex::less_wEps normCompare;
-	std::set<OBJVertex, OBJVertex::less_wEps> normSet(normCompare);
-	std::vector<OBJVertex> normals;
-	std::vector<unsigned> normMapping;
+	TextWriter out(stream);
+	OBJExportTables tables;
+	std::vector<std::vector<OBJPointIndex> > pointIndices(m_meshes.size());
 
-	params.normals = &normals;
-	params.normSet = &normSet;
-	params.normMapping = &normMapping;
-
-	std::vector<Mesh>::const_iterator itM;
-	std::vector<OBJVertex>::iterator itVert;
-	std::vector<OBJUV>::iterator	itUV;
-	std::vector<OBJVertex>::iterator itNorm;
-	std::stringstream* pSSS;
+	std::vector<OBJVertex>::const_iterator itVert;
+	std::vector<OBJUV>::const_iterator itUV;
+	std::vector<OBJVertex>::const_iterator itNorm;
+	size_t i;
 
 	if (!getTextureName(WZM_TEX_DIFFUSE).empty())
 	{
 		out << "mtllib " << getTextureName(WZM_TEX_DIFFUSE) << ".mtl\nusemtl " << getTextureName(WZM_TEX_DIFFUSE) << "\n\n";
 	}
 
-	for (itM = m_meshes.begin(); itM != m_meshes.end(); ++itM)
+	// The tables precede the objects, so index everything first
+	for (i = 0; i < m_meshes.size(); ++i)
 	{
-		Mesh expMesh(*itM);
-		expMesh.mirrorFromPoint(WZMVertex(), 0);
-		expMesh.reverseWinding();
-
-		objectBuffers.push_back(expMesh.exportToOBJ(params));
+		m_meshes[i].indexForOBJ(tables, pointIndices[i]);
 	}
 
-	out << "# " << vertices.size() << " vertices\n";
-	for (itVert = vertices.begin(); itVert != vertices.end(); ++itVert)
+	out << "# " << tables.vertices().size() << " vertices\n";
+	for (itVert = tables.vertices().begin(); itVert != tables.vertices().end(); ++itVert)
 	{
 		writeOBJVertex(*itVert, out);
 	}
 
 	out << '\n';
 
-	out << "# " << uvs.size() << " texture coords\n";
-	for (itUV = uvs.begin(); itUV != uvs.end(); ++itUV)
+	out << "# " << tables.uvs().size() << " texture coords\n";
+	for (itUV = tables.uvs().begin(); itUV != tables.uvs().end(); ++itUV)
 	{
 		writeOBJUV(*itUV, out);
 	}
 
 	out << '\n';
 
-	out << "# " << normals.size() << " vertex normals\n";
-	for (itNorm = normals.begin(); itNorm != normals.end(); ++itNorm)
+	out << "# " << tables.normals().size() << " vertex normals\n";
+	for (itNorm = tables.normals().begin(); itNorm != tables.normals().end(); ++itNorm)
 	{
 		writeOBJNormal(*itNorm, out);
 	}
 
-	while (!objectBuffers.empty())
+	for (i = 0; i < m_meshes.size(); ++i)
 	{
-		pSSS = objectBuffers.front();
-		objectBuffers.pop_front();
-
-		out << "\n" << pSSS->str();
-
-		delete pSSS;
+		out << '\n';
+		m_meshes[i].writeOBJFaces(out, pointIndices[i]);
 	}
 }
 
@@ -859,18 +1012,46 @@ void WZM::center(int mesh, int axis)
 	}
 }
 
-void WZM::recalculateTB(int mesh)
+/*
+ * Meshes are independent, so all of them are processed at once and the
+ * threads left over are shared among them for splitting large meshes.
+ */
+void WZM::recalculateTB(int mesh, unsigned threads)
 {
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
 	// All or a single mesh
 	if (mesh < 0)
 	{
-		for (auto& curMesh: m_meshes)
-			curMesh.recalculateTB();
+		const unsigned poolThreads = static_cast<unsigned>(std::min<size_t>(threads, m_meshes.size()));
+		const unsigned meshThreads = std::max(1u, threads / std::max(1u, poolThreads));
+
+		std::atomic<size_t> nextMesh(0);
+
+		auto worker = [&]()
+		{
+			for (size_t i = nextMesh++; i < m_meshes.size(); i = nextMesh++)
+			{
+				m_meshes[i].recalculateTB(meshThreads);
+			}
+		};
+
+		std::vector<std::thread> pool;
+		for (unsigned i = 1; i < poolThreads; ++i)
+		{
+			pool.emplace_back(worker);
+		}
+		worker();
+		for (std::thread& thread : pool)
+		{
+			thread.join();
+		}
 	}
 	else
 	{
 		if (m_meshes.size() > static_cast<size_t>(mesh))
-			m_meshes[static_cast<size_t>(mesh)].recalculateTB();
+			m_meshes[static_cast<size_t>(mesh)].recalculateTB(threads);
 	}
 }
 
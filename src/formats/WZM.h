@@ -25,6 +25,7 @@
 #include <map>
 
 #include "Mesh.h"
+#include "TextReader.h"
 
 #define WZM_MODEL_SIGNATURE "WZM"
 #define WZM_MODEL_VERSION_FD 3 // First draft version
@@ -69,7 +70,9 @@ struct WZMaterial
 	bool isDefault() const;
 };
 std::istream& operator>> (std::istream& in, WZMaterial& mat);
+TextReader& operator>> (TextReader& in, WZMaterial& mat);
 std::ostream& operator<< (std::ostream& out, const WZMaterial& mat);
+TextWriter& operator<< (TextWriter& out, const WZMaterial& mat);
 
 const static size_t MAX_CONNECTOR_COLORS = 10;
 const static WZMVertex CONNECTOR_COLORS[MAX_CONNECTOR_COLORS] = {
@@ -87,9 +90,11 @@ const static WZMVertex CONNECTOR_COLORS[MAX_CONNECTOR_COLORS] = {
 
 class WZM
 {
+	friend class ModelCache;
+	friend class TangentSpaceJob;
 public:
 	WZM();
-	WZM(const Pie3Model& p3);
+	WZM(const Pie3Model& p3, unsigned threads = 0); // threads for the tangents
 	virtual ~WZM() {clear();}
 
 	virtual operator Pie3Model() const;
@@ -97,7 +102,9 @@ public:
 	virtual bool read(std::istream& in);
 	virtual void write(std::ostream& out) const;
 
-	virtual bool importFromOBJ(std::istream& in, bool welder);
+	// threads for building the meshes and their tangents, 0 uses every core
+	virtual bool importFromOBJ(std::istream& in, bool welder, unsigned threads = 0);
+	virtual bool importFromOBJ(TextReader& in, bool welder, unsigned threads = 0);
 	virtual void exportToOBJ(std::ostream& out) const;
 
 	virtual int version() const;
@@ -126,12 +133,19 @@ public:
 	virtual void reverseWinding(int mesh = -1);
 	virtual void flipNormals(int mesh = -1);
 	virtual void center(int mesh, int axis);
-	virtual void recalculateTB(int mesh = -1);
+	virtual void recalculateTB(int mesh = -1, unsigned threads = 0); // 0: every core
 
 	virtual WZMVertex calculateCenterPoint() const;
 protected:
 	virtual void clear();
 
+	void buildOBJMeshes(const std::vector<OBJObject>& objects,
+			    const std::vector<OBJTri>& faces,
+			    const std::vector<OBJVertex>& verts,
+			    const std::vector<OBJUV>& uvs,
+			    const std::vector<OBJVertex>& normals,
+			    bool welder, unsigned threads);
+
 	std::vector<Mesh> m_meshes;
 	std::map<wzm_texture_type_t, std::string> m_textures;
 	WZMaterial m_material;
@@ -21,12 +21,11 @@
 #include <QCoreApplication>
 #include <QSettings>
 
-#include <iostream>
-#include <fstream>
+#include <cstring>
 
 #include "MainWindow.h"
-#include "WZM.h"
-#include "Pie.h"
+#include "QtGLView.h"
+#include "CommandLine.h"
 #include "wmit.h"
 
 #if defined(Q_OS_WIN) && defined(QT_STATICPLUGIN)
@@ -34,80 +33,31 @@
 Q_IMPORT_PLUGIN(QWindowsIntegrationPlugin);
 #endif
 
-void printWelcomeBanner(const bool printLicense)
-{
-	std::cout << "Welcome to " WMIT_APPNAME " " WMIT_VER_STR << std::endl;
-
-	if (printLicense)
-	{
-		std::cout << std::endl <<
-		"Copyright (C) 2010-2021 Warzone 2100 Project" << std::endl <<
-		"This program comes with ABSOLUTELY NO WARRANTY;" << std::endl <<
-		"This is free software, and you are welcome to redistribute it" << std::endl <<
-		"under certain conditions; see About in graphical UI for details." << std::endl;
-	}
-
-	std::cout << std::endl;
-}
-
 int main(int argc, char *argv[])
 {
+	const ModelCacheMode cacheMode = takeCacheModeArgs(argc, argv);
 
 	if(argc == 2 && strcmp("--help", argv[1]) == 0)
 	{
 		printWelcomeBanner(true);
-
-		printf("Usage:\n");
-		printf("  <no parameters> (opens GUI application)\n");
-		printf("  --help (shows this message)\n");
-		printf("  [filename] (opens a file in GUI)\n");
-		printf("  [input] [output] (converts between formats PIE and OBJ. Deprecated WZM format is supported as input.)\n");
+		printCommandLineHelp(true);
 		exit(0);
 	}
 
-	if (argc > 2)
+	if (argc > 1 && isBatchConversionArg(argv[1]))
 	{
-		printWelcomeBanner(false);
-		std::cout << "Converting files:" << std::endl;
-		std::cout << "Input file \"" << argv[1] << '"' << std::endl;
-		std::cout << "Output file \"" << argv[2] << '"' << std::endl;
-		std::cout << std::endl;
+		return runBatchConversion(argc, argv, cacheMode);
+	}
 
+	if (argc > 2)
+	{
 		// command line conversion mode
-		QString inname = argv[1];
-
-		ModelInfo info;
-		WZM model;
-
-		info.m_saveAsFile = argv[2];
-		if (!MainWindow::guessModelTypeFromFilename(info.m_saveAsFile, info.m_save_type))
-		{
-			std::cerr << "Could not guess save model type from filename. Only PIE and OBJ formats are supported!" << std::endl;
-			return 1;
-		}
-
-		std::cout << "Loading model..." << std::endl;
-		if (!MainWindow::loadModel(inname, model, info, true))
-		{
-			printf("Could not load model\n");
-			return 1;
-		}
-
-		info.defaultPieCapsIfNeeded();
-
-		std::cout << "Saving model..." << std::endl;
-		if(!MainWindow::saveModel(model, info))
-		{
-			printf("Could not save model\n");
-			return 1;
-		}
-
-		std::cout << "Done." << std::endl;
-		return 0;
+		return runConversion(argv[1], argv[2], cacheMode);
 	}
 	else
 	{
 		QApplication a(argc, argv);
+		QtGLView::logStartupTime("application created");
 
 		a.setWindowIcon(QIcon(WMIT_IMAGES_LOGO_64));
 		a.setApplicationName(WMIT_APPNAME);
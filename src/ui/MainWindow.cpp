@@ -29,8 +29,6 @@
 #include "LightColorDock.h"
 #include "aboutdialog.h"
 
-#include <fstream>
-
 #include <QFileInfo>
 #include <QFileDialog>
 #include <QInputDialog>
@@ -45,6 +43,7 @@
 #include "Pie.h"
 #include "WZLight.h"
 #include "Util.h"
+#include "UiUtil.h"
 
 QString MainWindow::buildAppTitle()
 {
@@ -143,12 +142,11 @@ MainWindow::MainWindow(QWZM &model, QWidget *parent) : QMainWindow(parent),
 	connect(m_ui->actionShowGrid, SIGNAL(toggled(bool)), m_ui->centralWidget, SLOT(setGridIsDrawn(bool)));
 	connect(m_ui->actionShowLightSource, SIGNAL(toggled(bool)), m_ui->centralWidget, SLOT(setDrawLightSource(bool)));
 	connect(m_ui->actionLink_Light_Source_To_Camera, SIGNAL(toggled(bool)), m_ui->centralWidget, SLOT(setLinkLightToCamera(bool)));
-	// Only spin libQGLViewer's 60 Hz redraw loop when the loaded model actually has an animation object.
-	connect(m_ui->actionAnimate, &QAction::toggled, this, [this](bool enabled) {
-		m_ui->centralWidget->setAnimateState(enabled && m_model->hasAnimObject());
-	});
+	connect(m_ui->actionAnimate, SIGNAL(toggled(bool)), this, SLOT(updateAnimateState()));
 	connect(m_ui->actionEnable_Ecm_Effect, SIGNAL(toggled(bool)), this, SLOT(setEcmState(bool)));
 	connect(m_ui->actionEnable_Alpha_Test, SIGNAL(toggled(bool)), this, SLOT(setAlphaTestState(bool)));
+	connect(m_ui->actionCompress_Textures, SIGNAL(toggled(bool)), m_ui->centralWidget, SLOT(setTextureCompression(bool)));
+	connect(m_ui->actionShow_Frame_Timings, SIGNAL(toggled(bool)), m_ui->centralWidget, SLOT(setFrameTimingsShown(bool)));
 	connect(m_ui->actionAboutQt, SIGNAL(triggered()), QApplication::instance(), SLOT(aboutQt()));
 	connect(m_ui->actionAbout, SIGNAL(triggered()), this, SLOT(aboutWMIT()));
 	connect(m_ui->actionSetTeamColor, SIGNAL(triggered()), this, SLOT(actionSetTeamColor()));
@@ -173,6 +171,7 @@ MainWindow::MainWindow(QWZM &model, QWidget *parent) : QMainWindow(parent),
 	connect(m_transformDock, SIGNAL(applyTransformations()), m_model, SLOT(applyTransformations()));
 	connect(m_transformDock, SIGNAL(changeActiveMesh(int)), m_model, SLOT(setActiveMesh(int)));
 	connect(m_transformDock, SIGNAL(recalculateTB()), m_model, SLOT(slotRecalculateTB()));
+	connect(m_model, SIGNAL(tangentsChanged()), this, SLOT(updateModelRender()));
 	connect(m_transformDock, SIGNAL(removeMesh()), this, SLOT(removeMesh()));
 	connect(m_transformDock, SIGNAL(mirrorAxis(int)), this, SLOT(mirrorAxis(int)));
 	connect(m_transformDock, SIGNAL(centerMesh(int)), this, SLOT(centerMesh(int)));
@@ -223,11 +222,8 @@ void MainWindow::doAfterModelWasLoaded(const bool success)
 	// Disallow mirroring as it will mess-up animation
 	m_transformDock->setMirrorState(success && !hasAnim);
 
-	// Re-evaluate whether the redraw loop needs to run for this model.
-	m_ui->centralWidget->setAnimateState(success && hasAnim && m_ui->actionAnimate->isChecked());
-
-	// The viewport is not redrawn continuously any more, so loading, appending or closing a model has to ask for a frame explicitly
-	updateModelRender();
+	// Re-evaluate whether the redraw loop needs to run for this model, this also asks for a frame
+	updateAnimateState();
 
 	m_ui->actionShowModelCenter->setEnabled(!hasAnim);
 }
@@ -266,70 +262,6 @@ bool MainWindow::openFile(const QString &filePath)
 	return true;
 }
 
-bool MainWindow::guessModelTypeFromFilename(const QString& fname, wmit_filetype_t& type)
-{
-	const QString ext = fname.right(fname.size() - fname.lastIndexOf('.') - 1);
-
-	if (ext.compare(QString("wzm"), Qt::CaseInsensitive) == 0)
-	{
-		type = WMIT_FT_WZM;
-	}
-	else if (ext.compare(QString("obj"), Qt::CaseInsensitive) == 0)
-	{
-		type = WMIT_FT_OBJ;
-	}
-	else if (ext.compare(QString("pie"), Qt::CaseInsensitive) == 0)
-	{
-		type = WMIT_FT_PIE;
-	}
-	else
-	{
-		return false;
-	}
-
-	return true;
-}
-
-bool MainWindow::saveModel(const WZM &model, const ModelInfo &info)
-{
-	std::ofstream out;
-	bool save_result = true;
-
-	if (info.m_save_type == WMIT_FT_WZM)
-	{
-		std::cerr << WMIT_WARN_DEPRECATED_WZM << std::endl;
-		return false;
-	}
-
-	out.open(info.m_saveAsFile.toLocal8Bit().constData());
-
-	switch (info.m_save_type)
-	{
-	case WMIT_FT_OBJ:
-		model.exportToOBJ(out);
-		break;
-	case WMIT_FT_PIE:
-	{
-		Pie3Model p3 = model;
-		p3.write(out, &info.m_pieCaps);
-		break;
-	}
-	case WMIT_FT_PIE2:
-	{
-		Pie3Model p3 = model;
-		Pie2Model p2 = p3;
-		p2.write(out, &info.m_pieCaps);
-		break;
-	}
-	default:
-		save_result = false;
-	}
-
-	out.close();
-
-	return save_result;
-}
-
 void MainWindow::changeEvent(QEvent *event)
 {
 	QMainWindow::changeEvent(event);
@@ -363,6 +295,9 @@ void MainWindow::closeEvent(QCloseEvent *event)
 	settings.setValue("3DView/Animate", m_ui->actionAnimate->isChecked());
 	settings.setValue("3DView/EcmEffect", m_ui->actionEnable_Ecm_Effect->isChecked());
 	settings.setValue("3DView/AlphaTest", m_ui->actionEnable_Alpha_Test->isChecked());
+	settings.setValue("3DView/CompressTextures", m_ui->actionCompress_Textures->isChecked());
+	settings.setValue("3DView/TextureBudgetMB", m_ui->centralWidget->textureBudget() / (1024 * 1024));
+	settings.setValue("3DView/ShowFrameTimings", m_ui->actionShow_Frame_Timings->isChecked());
 	settings.setValue("3DView/ShowConnectors", m_ui->actionShow_Connectors->isChecked());
 	settings.setValue("3DView/ShaderTag", wz_shader_type_tag[getShaderType()]);
 
@@ -375,83 +310,18 @@ bool MainWindow::loadModel(const QString& file, WZM& model, ModelInfo &info, boo
 {
 	wmit_filetype_t type;
 
-	if (!guessModelTypeFromFilename(file, type))
-	{
-		printf("Could not guess model type from filename. Only formats PIE, WZM, and OBJ are supported.\n");
-		return false;
-	}
-
-	info.m_read_type = type;
-
-	if (info.m_read_type == WMIT_FT_WZM)
-	{
-		std::cout << WMIT_WARN_DEPRECATED_WZM << std::endl;
-	}
-
-	bool read_success = false;
-	std::ifstream f;
-	ImportDialog* importDialog = nullptr;
-	QSettings* settings = nullptr;
-
-	f.open(file.toLocal8Bit(), std::ios::in | std::ios::binary);
-
-	switch (type)
+	if (guessModelTypeFromFilename(file, type) && type == WMIT_FT_OBJ && !nogui)
 	{
-	case WMIT_FT_WZM:
-		read_success = model.read(f);
-		break;
-	case WMIT_FT_OBJ:
-		if (!nogui)
-		{
-			importDialog = new ImportDialog();
-			int result = importDialog->exec();
-			delete importDialog;
-			importDialog = nullptr;
-
-			if (result != QDialog::Accepted)
-			{
-				return false;
-			}
-		}
-
-		settings = new QSettings();
-
-		read_success = model.importFromOBJ(f, settings->value(WMIT_SETTINGS_IMPORT_WELDER, true).toBool());
-		break;
-	case WMIT_FT_PIE:
-	case WMIT_FT_PIE2:
-		int pieversion = pieVersion(f);
-		if (pieversion <= 2)
-		{
-			Pie2Model p2;
-			read_success = p2.read(f);
-			if (read_success)
-			{
-				Pie3Model p3(p2);
-				info.m_pieCaps = p3.getCaps();
-				model = WZM(p3);
-			}
-		}
-		else // 3 or higher
+		ImportDialog importDialog;
+		if (importDialog.exec() != QDialog::Accepted)
 		{
-			Pie3Model p3;
-			read_success = p3.read(f);
-			if (read_success)
-			{
-				info.m_pieCaps = p3.getCaps();
-				model = WZM(p3);
-			}
+			return false;
 		}
 	}
 
-	f.close();
-
-	if (importDialog)
-		delete importDialog;
-	if (settings)
-		delete settings;
+	const bool welder = QSettings().value(WMIT_SETTINGS_IMPORT_WELDER, true).toBool();
 
-	return read_success;
+	return ::loadModel(file, model, info, welder);
 }
 
 bool MainWindow::fireTextureDialog(const bool reinit)
@@ -726,6 +596,20 @@ bool MainWindow::reloadShader(wz_shader_type_t type, bool user_shader, QString *
 	return false;
 }
 
+bool MainWindow::ensureShader(wz_shader_type_t type)
+{
+	// Built-in shaders never change, an already compiled one is reused
+	if (m_ui->centralWidget->hasShader(type) && !m_ui->centralWidget->isShaderExternal(type))
+	{
+		m_pathvert.clear();
+		m_pathfrag.clear();
+		return true;
+	}
+
+	QString errMessage;
+	return reloadShader(type, false, &errMessage);
+}
+
 void MainWindow::viewerInitialized()
 {
 	// Only do init once
@@ -767,8 +651,7 @@ void MainWindow::viewerInitialized()
 			shaderAct->setShortcut(QKeySequence(tr("Ctrl+%1").arg(i+1)));
 		shaderAct->setCheckable(true);
 
-		reloadShader(static_cast<wz_shader_type_t>(i), false);
-
+		// Compiled when first selected
 		connect(shaderAct, &QAction::triggered, this, [this, i]() { shaderAction(i); });
 	}
 
@@ -795,6 +678,13 @@ void MainWindow::viewerInitialized()
 	connect(m_ui->actionShow_Connectors, SIGNAL(triggered(bool)),
 		m_model, SLOT(setDrawConnectors(bool)));
 
+	// The viewport only redraws on demand
+	connect(m_ui->actionShowModelCenter, SIGNAL(triggered(bool)), this, SLOT(updateModelRender()));
+	connect(m_ui->actionShowNormals, SIGNAL(triggered(bool)), this, SLOT(updateModelRender()));
+	connect(m_ui->actionShow_Tangent_And_Bitangent, SIGNAL(triggered(bool)), this, SLOT(updateModelRender()));
+	connect(m_ui->actionShow_Connectors, SIGNAL(triggered(bool)), this, SLOT(updateModelRender()));
+	connect(m_actionEnableTangentInShaders, SIGNAL(triggered(bool)), this, SLOT(updateModelRender()));
+
 	/// Load previous state
 	m_ui->actionShowModelCenter->setChecked(m_settings->value("3DView/ShowModelCenter", false).toBool());
 	m_model->setDrawCenterPointFlag(m_ui->actionShowModelCenter->isChecked());
@@ -820,6 +710,9 @@ void MainWindow::viewerInitialized()
 
 	m_ui->actionEnable_Ecm_Effect->setChecked(m_settings->value("3DView/EcmEffect", false).toBool());
 	m_ui->actionEnable_Alpha_Test->setChecked(m_settings->value("3DView/AlphaTest", true).toBool());
+	m_ui->actionCompress_Textures->setChecked(m_settings->value("3DView/CompressTextures", false).toBool());
+	m_ui->centralWidget->setTextureBudget(m_settings->value("3DView/TextureBudgetMB", 256).toLongLong() * 1024 * 1024);
+	m_ui->actionShow_Frame_Timings->setChecked(m_settings->value("3DView/ShowFrameTimings", false).toBool());
 
 	actionEnableUserShaders(m_actionEnableUserShaders->isChecked());
 
@@ -857,6 +750,8 @@ void MainWindow::viewerInitialized()
 
 	m_lightColorDock->refreshColorUI();
 	m_lightColorDock->useCustomColors(isUsingCustomLightColor());
+
+	QtGLView::logStartupTime("active shader ready");
 }
 
 void MainWindow::shaderAction(int type)
@@ -891,7 +786,7 @@ void MainWindow::shaderAction(int type)
 	}
 
 	if (!useUserShader)
-		reloadShader(stype, false);
+		ensureShader(stype);
 
 	if (static_cast<wz_shader_type_t>(type) != WZ_SHADER_NONE)
 	{
@@ -914,7 +809,7 @@ void MainWindow::shaderAction(int type)
 void MainWindow::setEcmState(bool checked)
 {
 	m_model->setEcmState(checked);
-	updateModelRender();
+	updateAnimateState();
 }
 
 void MainWindow::setAlphaTestState(bool checked)
@@ -992,6 +887,7 @@ void MainWindow::lightColorChangedFromUI()
 void MainWindow::useCustomLightColorChangedFromUI(bool use)
 {
 	setUseCustomLightColor(use);
+	updateModelRender();
 }
 
 void MainWindow::actionReloadUserShader()
@@ -1056,7 +952,10 @@ void MainWindow::actionSetTeamColor()
 {
     QColor newColor = QColorDialog::getColor(m_model->getTCMaskColor(), this, "Select new TeamColor");
     if (newColor.isValid())
+    {
         m_model->setTCMaskColor(newColor);
+        updateModelRender();
+    }
 }
 
 void MainWindow::actionEnableUserShaders(bool checked)
@@ -1185,6 +1084,7 @@ void MainWindow::actionImport_Connectors()
 
 	// Update related view
 	updateConnectorsView();
+	updateModelRender();
 	// And notify model info about new connectors
 	m_modelinfo.m_pieCaps.set(PIE_OPT_DIRECTIVES::podCONNECTORS);
 }
@@ -1242,6 +1142,15 @@ void MainWindow::updateModelRender()
 	m_ui->centralWidget->update();
 }
 
+void MainWindow::updateAnimateState()
+{
+	// The viewport is redrawn on demand, libQGLViewer's 60 Hz loop only runs
+	// while something on screen moves by itself: mesh animation frames or the
+	// ECM effect, which cycles with the shader time.
+	const bool moving = m_model->meshes() > 0 && (m_model->hasAnimObject() || m_model->getEcmState());
+	m_ui->centralWidget->setAnimateState(m_ui->actionAnimate->isChecked() && moving);
+}
+
 void MainWindow::updateConnectorsView()
 {
 	m_meshDock->resetConnectorViewModel();
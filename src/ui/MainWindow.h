@@ -31,6 +31,7 @@
 #include <QBasicTimer>
 
 #include "QWZM.h"
+#include "ModelIO.h"
 #include "Pie.h"
 #include "wmit.h"
 #include "WZLight.h"
@@ -50,40 +51,6 @@ namespace Ui
 	class MainWindow;
 }
 
-struct ModelInfo
-{
-	ModelInfo() {clear();}
-
-	PieCaps m_pieCaps;
-	wmit_filetype_t m_save_type;
-	wmit_filetype_t m_read_type;
-	QString m_currentFile;
-	QString m_saveAsFile;
-
-	void clear()
-	{
-		m_save_type = m_read_type = WMIT_FT_PIE;
-		m_pieCaps.reset();
-		m_currentFile.clear();
-		m_saveAsFile.clear();
-	}
-
-	void defaultPieCapsIfNeeded()
-	{
-		if (m_read_type != WMIT_FT_PIE && m_read_type != WMIT_FT_PIE2)
-			m_pieCaps = m_save_type == WMIT_FT_PIE? PIE3_CAPS : PIE2_CAPS;
-	}
-
-	void prepareForSaveToSelf()
-	{
-		// Use orignal type and filename if we never went through a save before
-		if (!m_saveAsFile.isEmpty())
-			return;
-		m_save_type = m_read_type;
-		m_saveAsFile = m_currentFile;
-	}
-};
-
 class MainWindow : public QMainWindow
 {
 	Q_OBJECT
@@ -95,9 +62,8 @@ public:
 	void clear();
 	bool openFile(const QString& file);
 
+	// Same as ::loadModel, but asks for the OBJ import options unless nogui is set
 	static bool loadModel(const QString& file, WZM& model, ModelInfo &info, bool nogui = false);
-	static bool guessModelTypeFromFilename(const QString &fname, wmit_filetype_t &type);
-	static bool saveModel(const WZM& model, const ModelInfo &info);
 
 	void PrependFileToRecentList(const QString &filename);
 
@@ -125,6 +91,7 @@ private slots:
 	void aboutWMIT();
 	void updateRecentFilesMenu();
 	void updateModelRender();
+	void updateAnimateState();
 	void updateConnectorsView();
 	void viewerInitialized();
 	void shaderAction(int);
@@ -174,6 +141,7 @@ private:
 	QString buildAppTitle();
 	bool fireTextureDialog(const bool reinit = false);
 	bool reloadShader(wz_shader_type_t type, bool user_shader, QString* errMessage = nullptr);
+	bool ensureShader(wz_shader_type_t type);
 	void doAfterModelWasLoaded(const bool success = true);
 
 	wz_shader_type_t getShaderType() const
@@ -30,6 +30,7 @@
 
 #include "TexConfigDialog.h"
 #include "Util.h"
+#include "UiUtil.h"
 
 TextureDialog::TextureDialog(QWidget *parent) :
 	QDialog(parent),
@@ -0,0 +1,80 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "UiUtil.h"
+
+#include <QtDebug>
+
+#include <QGuiApplication>
+#include <QScreen>
+#include <QSettings>
+#include <QWidget>
+
+void restoreWidgetGeometry(QWidget& widget, QSettings& settings, const QString& groupKey)
+{
+	const QSize storedSize = settings.value(groupKey + "/size", widget.size()).toSize();
+	const QPoint storedPos = settings.value(groupKey + "/position", widget.pos()).toPoint();
+
+	QSize newSize = storedSize;
+	if (!newSize.isValid() || newSize.isEmpty())
+		newSize = widget.size();
+
+	// Clamp to the largest screen so a size saved on a big monitor cannot leave the window bigger than anything currently attached
+	const QScreen *primary = QGuiApplication::primaryScreen();
+	if (primary != nullptr)
+	{
+		const QSize maxSize = primary->availableGeometry().size();
+		newSize = newSize.boundedTo(maxSize);
+	}
+
+	widget.resize(newSize);
+
+	// Only honour the stored position if the resulting frame is genuinely visible on some screen
+	const QRect target(storedPos, newSize);
+	bool visible = false;
+	const QList<QScreen*> screens = QGuiApplication::screens();
+	for (const QScreen *screen : screens)
+	{
+		// Require a reasonable overlap, not just a single shared pixel, so a window peeking in from off-screen still gets re-centred
+		const QRect overlap = screen->availableGeometry().intersected(target);
+		if (overlap.width() >= qMin(120, newSize.width())
+		    && overlap.height() >= qMin(60, newSize.height()))
+		{
+			visible = true;
+			break;
+		}
+	}
+
+	if (visible)
+	{
+		widget.move(storedPos);
+	}
+	else
+	{
+		if (!storedPos.isNull())
+		{
+			qWarning() << "Ignoring off-screen stored geometry for" << groupKey << storedPos << newSize;
+		}
+		if (primary != nullptr)
+		{
+			const QRect avail = primary->availableGeometry();
+			widget.move(avail.center() - QPoint(newSize.width() / 2, newSize.height() / 2));
+		}
+	}
+}
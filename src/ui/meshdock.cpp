@@ -198,17 +198,19 @@ bool WzmConnectorsModel::setData(const QModelIndex &index, const QVariant &value
 	{
 		int row = index.row();
 
-		auto& connector = m_mesh.getConnector(row);
+		WZMVertex pos = m_mesh.getConnector(row).getPos();
 
 		if (index.column() == 1)
-			connector.getPos().x() = -value.toFloat();
+			pos.x() = -value.toFloat();
 		else if (index.column() == 2)
-			connector.getPos().y() = value.toFloat();
+			pos.y() = value.toFloat();
 		else if (index.column() == 3)
-			connector.getPos().z() = value.toFloat();
+			pos.z() = value.toFloat();
 		else
 			return false;
 
+		m_mesh.setConnectorPos(row, pos);
+
 		emit connectorsWereUpdated();
 		emit dataChanged(index, index, {role});
 
@@ -0,0 +1,86 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "AnimationPoses.h"
+
+#include <cmath>
+
+AnimationPoses::AnimationPoses(): m_generation(0), m_frameTime(0.)
+{
+}
+
+void AnimationPoses::update(unsigned long long generation, const std::vector<Frame>& frames, int frameTime)
+{
+	if (generation == m_generation && frames.size() == m_poses.size())
+		return;
+
+	m_generation = generation;
+	m_frameTime = frameTime;
+
+	m_poses.resize(frames.size());
+	for (size_t i = 0; i < frames.size(); ++i)
+	{
+		const Frame& frame = frames[i];
+		Pose& pose = m_poses[i];
+
+		pose.enabled = frame.scale.x() >= 0;
+		pose.trans = QVector3D(frame.trans.x(), frame.trans.y(), frame.trans.z());
+		pose.scale = QVector3D(frame.scale.x(), frame.scale.y(), frame.scale.z());
+
+		// Same order as glRotatef around x, then y, then z
+		pose.rot = QQuaternion::fromAxisAndAngle(1.f, 0.f, 0.f, frame.rot.x()) *
+			   QQuaternion::fromAxisAndAngle(0.f, 1.f, 0.f, frame.rot.y()) *
+			   QQuaternion::fromAxisAndAngle(0.f, 0.f, 1.f, frame.rot.z());
+
+		pose.matrix.setToIdentity();
+		pose.matrix.translate(pose.trans);
+		pose.matrix.rotate(pose.rot);
+		pose.matrix.scale(pose.scale);
+	}
+}
+
+bool AnimationPoses::pose(double msecs, bool interpolate, QMatrix4x4& matrix) const
+{
+	if (m_poses.empty())
+		return false;
+
+	// A zero frame time would be a division by zero, hold the first frame then
+	const double frames = m_frameTime > 0. ? msecs / m_frameTime : 0.;
+	const double whole = std::floor(frames);
+	const size_t frame = static_cast<size_t>(whole) % m_poses.size();
+	const Pose& cur = m_poses[frame];
+
+	if (!cur.enabled)
+		return false;
+
+	const Pose& next = m_poses[(frame + 1) % m_poses.size()];
+	const float fraction = static_cast<float>(frames - whole);
+
+	if (!interpolate || !next.enabled || fraction <= 0.f || m_poses.size() == 1)
+	{
+		matrix = cur.matrix;
+		return true;
+	}
+
+	matrix.setToIdentity();
+	matrix.translate(cur.trans + (next.trans - cur.trans) * fraction);
+	matrix.rotate(QQuaternion::slerp(cur.rot, next.rot, fraction));
+	matrix.scale(cur.scale + (next.scale - cur.scale) * fraction);
+	return true;
+}
@@ -0,0 +1,66 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ANIMATIONPOSES_HPP
+#define ANIMATIONPOSES_HPP
+
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QQuaternion>
+#include <QVector3D>
+
+#include "Mesh.h"
+
+/*
+  Keyframe poses of one mesh, precomputed from its Frame array.
+
+  A pose is the transformation QWZM used to apply with glTranslatef, three
+  glRotatef and glScalef. Each frame keeps it as a ready matrix, and as
+  translation, rotation quaternion and scale for blending. With
+  interpolation (the INTERPOLATE directive of WZ 4.0) a pose is blended
+  between the current and the next keyframe, the rotation with slerp.
+  Otherwise the current keyframe is used as is.
+  */
+class AnimationPoses
+{
+public:
+	AnimationPoses();
+
+	// Rebuilds the table unless it was built for this mesh generation
+	void update(unsigned long long generation, const std::vector<Frame>& frames, int frameTime);
+
+	// False when there are no frames or the frame at msecs is disabled
+	bool pose(double msecs, bool interpolate, QMatrix4x4& matrix) const;
+
+private:
+	struct Pose
+	{
+		bool enabled; // WZ disables a frame with a negative scale, for key frame animation
+		QVector3D trans, scale;
+		QQuaternion rot;
+		QMatrix4x4 matrix;
+	};
+
+	unsigned long long m_generation;
+	double m_frameTime;
+	std::vector<Pose> m_poses;
+};
+
+#endif // ANIMATIONPOSES_HPP
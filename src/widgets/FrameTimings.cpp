@@ -0,0 +1,128 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FrameTimings.h"
+
+#include <algorithm>
+#include <cmath>
+
+FrameTimings::FrameTimings(size_t window):
+	m_window(std::max<size_t>(window, 1)),
+	m_frames(0)
+{
+	clear();
+}
+
+const char* FrameTimings::stageName(Stage stage)
+{
+	static const char* const names[STAGE__LAST] = {
+		"frame", "animation", "uniforms", "textures", "draw", "overlays", "GPU"
+	};
+	return stage < STAGE__LAST ? names[stage] : "";
+}
+
+void FrameTimings::add(Stage stage, double msecs)
+{
+	m_current[stage] += msecs;
+	m_touched[stage] = true;
+}
+
+void FrameTimings::countMesh(const std::string& name, size_t triangles, unsigned drawCalls)
+{
+	MeshCounts counts = {name, triangles, drawCalls};
+	m_currentMeshes.push_back(counts);
+}
+
+void FrameTimings::endFrame()
+{
+	for (int i = 0; i < STAGE__LAST; ++i)
+	{
+		if (!m_touched[i])
+			continue;
+
+		std::vector<double>& history = m_history[i];
+		if (history.size() < m_window)
+			history.push_back(m_current[i]);
+		else
+			history[m_next[i]] = m_current[i];
+		m_next[i] = (m_next[i] + 1) % m_window;
+
+		m_current[i] = 0.;
+		m_touched[i] = false;
+	}
+
+	m_meshes.swap(m_currentMeshes);
+	m_currentMeshes.clear();
+	++m_frames;
+}
+
+void FrameTimings::clear()
+{
+	for (int i = 0; i < STAGE__LAST; ++i)
+	{
+		m_current[i] = 0.;
+		m_touched[i] = false;
+		m_history[i].clear();
+		m_next[i] = 0;
+	}
+	m_currentMeshes.clear();
+	m_meshes.clear();
+	m_frames = 0;
+}
+
+double FrameTimings::average(Stage stage) const
+{
+	const std::vector<double>& history = m_history[stage];
+	if (history.empty())
+		return 0.;
+
+	double sum = 0.;
+	for (double msecs : history)
+		sum += msecs;
+	return sum / history.size();
+}
+
+double FrameTimings::percentile95(Stage stage) const
+{
+	std::vector<double> sorted = m_history[stage];
+	if (sorted.empty())
+		return 0.;
+
+	// Nearest rank
+	const size_t rank = static_cast<size_t>(std::ceil(0.95 * sorted.size())) - 1;
+	std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+	return sorted[rank];
+}
+
+FrameTimings::Lap::Lap(FrameTimings* timings):
+	m_timings(timings)
+{
+	if (m_timings)
+		m_last = std::chrono::steady_clock::now();
+}
+
+void FrameTimings::Lap::to(Stage stage)
+{
+	if (!m_timings)
+		return;
+
+	const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	m_timings->add(stage, std::chrono::duration<double, std::milli>(now - m_last).count());
+	m_last = now;
+}
@@ -0,0 +1,103 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef FRAMETIMINGS_HPP
+#define FRAMETIMINGS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/*
+  Per stage CPU (and GPU) times of the viewport frames, kept over a rolling
+  window of frames for averages and the 95th percentile.
+
+  Stages are summed over a frame with add() or a Lap, endFrame() moves the
+  frame into the window. Times added between two frames, like the animation
+  tick, count for the next frame. The triangle and draw call counts of the
+  meshes are kept for the last frame only.
+  */
+class FrameTimings
+{
+public:
+	enum Stage
+	{
+		STAGE_FRAME,		// draw() and postDraw() as a whole
+		STAGE_ANIMATION,	// animation tick and keyframe poses
+		STAGE_UNIFORMS,		// bindShader(), attribute and uniform setup
+		STAGE_TEXTURES,		// texture unit setup and reset
+		STAGE_DRAW,		// buffer binding, client state and draw submission
+		STAGE_OVERLAYS,		// normals, connectors and the centre point
+		STAGE_GPU,		// GL_TIME_ELAPSED of a frame, a few frames late
+		STAGE__LAST
+	};
+
+	struct MeshCounts
+	{
+		std::string name;
+		size_t triangles;
+		unsigned drawCalls;
+	};
+
+	explicit FrameTimings(size_t window = 120);
+
+	static const char* stageName(Stage stage);
+
+	void add(Stage stage, double msecs);
+	void countMesh(const std::string& name, size_t triangles, unsigned drawCalls);
+	void endFrame();
+	void clear();
+
+	// Over the frames in the window that had the stage, 0 when there are none
+	double average(Stage stage) const;
+	double percentile95(Stage stage) const;
+	size_t samples(Stage stage) const {return m_history[stage].size();}
+
+	const std::vector<MeshCounts>& meshCounts() const {return m_meshes;}
+	size_t frames() const {return m_frames;}
+	size_t window() const {return m_window;}
+
+	/*
+	  Stopwatch charging the time since the previous lap to a stage. Does
+	  not read the clock at all without timings.
+	  */
+	class Lap
+	{
+	public:
+		explicit Lap(FrameTimings* timings);
+
+		void to(Stage stage);
+
+	private:
+		FrameTimings* m_timings;
+		std::chrono::steady_clock::time_point m_last;
+	};
+
+private:
+	size_t m_window;
+	size_t m_frames;
+	double m_current[STAGE__LAST];
+	bool m_touched[STAGE__LAST];
+	std::vector<double> m_history[STAGE__LAST];	// ring buffers of m_window frames
+	size_t m_next[STAGE__LAST];
+	std::vector<MeshCounts> m_currentMeshes, m_meshes;
+};
+
+#endif // FRAMETIMINGS_HPP
@@ -20,6 +20,9 @@
 #include "QWZM.h"
 #include "Pie.h"
 
+#include <cstddef>
+#include <limits>
+
 #include "QtGLView.h"
 #include "WZLight.h"
 
@@ -42,29 +45,50 @@ QWZM::QWZM(QObject *parent):
 	m_drawConnectors(false),
 	m_ecmState(0),
 	m_alphatest(1),
-	m_enableTangentsInShaders(true)
+	m_enableTangentsInShaders(true),
+	m_tangentJobId(0),
+	m_timings(nullptr)
 {
 	defaultConstructor();
+
+	connect(this, SIGNAL(tangentJobFinished(unsigned)), this, SLOT(applyTangentJob(unsigned)), Qt::QueuedConnection);
 }
 
 QWZM::~QWZM()
 {
+	cancelTangentJob();
 }
 
 static QMatrix4x4 render_mtxModelView, render_mtxModelView_preAnim, render_mtxProj;
 static QMatrix4x4 render_mtxMVP, render_mtxNM;
 static QVector4D render_posSun;
 
+static const QMatrix4x4& invertedModelView(const QMatrix4x4& mtx)
+{
+	static QMatrix4x4 lastMtx, lastInverse;
+
+	if (mtx != lastMtx)
+	{
+		lastMtx = mtx;
+		lastInverse = mtx.inverted();
+	}
+	return lastInverse;
+}
+
 void QWZM::render(const float* mtxModelView, const float* mtxProj, const float* posSun)
 {
 	int activeShader = getActiveShader();
 
 	QOpenGLShaderProgram* shader = nullptr;
 
+	FrameTimings::Lap lap(m_timings);
+
 	glPushAttrib(GL_TEXTURE_BIT);
 
 	// prepare shader data
-	if (!setupTextureUnits(activeShader))
+	const bool texturesReady = setupTextureUnits(activeShader);
+	lap.to(FrameTimings::STAGE_TEXTURES);
+	if (!texturesReady)
 	{
 		glPopAttrib();
 		return;
@@ -118,6 +142,18 @@ void QWZM::render(const float* mtxModelView, const float* mtxProj, const float*
 
 	QMatrix4x4 origMshMV = render_mtxModelView;
 
+	// Drop the buffers of meshes removed since the last frame
+	for (size_t i = m_meshes.size(); i < m_meshBuffers.size(); ++i)
+	{
+		m_meshBuffers[i].vertices.destroy();
+		m_meshBuffers[i].indices.destroy();
+		m_meshBuffers[i].overlay.destroy();
+	}
+	m_meshBuffers.resize(m_meshes.size());
+	m_animationPoses.resize(m_meshes.size());
+
+	lap.to(FrameTimings::STAGE_DRAW);
+
 	for (size_t i = 0; i < m_meshes.size(); ++i)
 	{
 		const Mesh& msh = m_meshes.at(i);
@@ -135,35 +171,46 @@ void QWZM::render(const float* mtxModelView, const float* mtxProj, const float*
 
 		if ((m_animation_elapsed_msecs >= 0.) && !msh.m_frameArray.empty())
 		{
-			const size_t animframe_fromtime = static_cast<size_t>(m_animation_elapsed_msecs /
-								  static_cast<double>(msh.m_frame_time));
-			const size_t animframe_to_draw = animframe_fromtime % msh.m_frameArray.size();
-			const Frame& curAnimFrame = msh.m_frameArray[animframe_to_draw];
+			AnimationPoses& poses = m_animationPoses[i];
+			poses.update(msh.generation(), msh.m_frameArray, msh.m_frame_time);
 
-			// disabled frame if negative, for implementing key frame animation
-			if (curAnimFrame.scale.x() >= 0)
+			QMatrix4x4 pose;
+			if (poses.pose(m_animation_elapsed_msecs, m_ani_interpolate != 0, pose))
 			{
 				render_mtxModelView_preAnim = render_mtxModelView;
 
-				glTranslatef(curAnimFrame.trans.x(), curAnimFrame.trans.y(), curAnimFrame.trans.z());
-				glRotatef(curAnimFrame.rot.x(), 1.f, 0.f, 0.f);
-				glRotatef(curAnimFrame.rot.y(), 0.f, 1.f, 0.f);
-				glRotatef(curAnimFrame.rot.z(), 0.f, 0.f, 1.f);
-				glScalef(curAnimFrame.scale.x(), curAnimFrame.scale.y(), curAnimFrame.scale.z());
+				glMultMatrixf(pose.constData());
 
 				if (!isFixedPipelineRenderer())
-				{
-					render_mtxModelView.translate(curAnimFrame.trans.x(), curAnimFrame.trans.y(), curAnimFrame.trans.z());
-					render_mtxModelView.rotate(curAnimFrame.rot.x(), 1.f, 0.f, 0.f);
-					render_mtxModelView.rotate(curAnimFrame.rot.y(), 0.f, 1.f, 0.f);
-					render_mtxModelView.rotate(curAnimFrame.rot.z(), 0.f, 0.f, 1.f);
-					render_mtxModelView.scale(curAnimFrame.scale.x(), curAnimFrame.scale.y(), curAnimFrame.scale.z());
-				}
+					render_mtxModelView *= pose;
 			}
+			lap.to(FrameTimings::STAGE_ANIMATION);
 		}
 
+		// Offsets into the mesh buffers while they are bound, client memory otherwise
+		MeshBuffers* buffers = meshBuffers(i);
+		const GLvoid *vertexData, *uvData, *normalData, *tangentData, *indexData;
+		if (buffers)
+		{
+			vertexData = nullptr;
+			uvData = reinterpret_cast<const GLvoid*>(buffers->uvOffset);
+			normalData = reinterpret_cast<const GLvoid*>(buffers->normalOffset);
+			tangentData = reinterpret_cast<const GLvoid*>(buffers->tangentOffset);
+			indexData = nullptr;
+		}
+		else
+		{
+			vertexData = msh.m_vertexArray.data();
+			uvData = msh.m_textureArray.data();
+			normalData = msh.m_normalArray.data();
+			tangentData = msh.m_tangentArray.data();
+			indexData = msh.drawIndexData();
+		}
+		lap.to(FrameTimings::STAGE_DRAW);
+
 		// prepare shader data
 		setupTextureUnits(activeShader);
+		lap.to(FrameTimings::STAGE_TEXTURES);
 
 		if (!isFixedPipelineRenderer())
 		{
@@ -177,12 +224,13 @@ void QWZM::render(const float* mtxModelView, const float* mtxProj, const float*
 					shader->enableAttributeArray(vertexTexCoordAtributeName);
 					shader->enableAttributeArray(vertexTangentAtributeName);
 
-					shader->setAttributeArray(vertexAtributeName, msh.m_vertexArray[0], 3);
-					shader->setAttributeArray(vertexTexCoordAtributeName, msh.m_textureArray[0], 2);
-					shader->setAttributeArray(vertexNormalAtributeName, msh.m_normalArray[0], 3);
-					shader->setAttributeArray(vertexTangentAtributeName, msh.m_tangentArray[0], 4);
+					shader->setAttributeArray(vertexAtributeName, static_cast<const GLfloat*>(vertexData), 3);
+					shader->setAttributeArray(vertexTexCoordAtributeName, static_cast<const GLfloat*>(uvData), 2);
+					shader->setAttributeArray(vertexNormalAtributeName, static_cast<const GLfloat*>(normalData), 3);
+					shader->setAttributeArray(vertexTangentAtributeName, static_cast<const GLfloat*>(tangentData), 4);
 				}
 			}
+			lap.to(FrameTimings::STAGE_UNIFORMS);
 		}
 
 		glMaterialfv(GL_FRONT, GL_EMISSION, m_material.vals[WZM_MAT_EMISSIVE]);
@@ -192,15 +240,21 @@ void QWZM::render(const float* mtxModelView, const float* mtxProj, const float*
 		glMaterialf(GL_FRONT, GL_SHININESS, m_material.shininess);
 
 		static_assert(sizeof(WZMUV) == sizeof(GLfloat)*2, "WZMUV has become fat.");
-		glTexCoordPointer(2, GL_FLOAT, 0, &msh.m_textureArray[0]);
+		glTexCoordPointer(2, GL_FLOAT, 0, uvData);
 
-		glNormalPointer(GL_FLOAT, 0, &msh.m_normalArray[0]);
+		glNormalPointer(GL_FLOAT, 0, normalData);
 
 		static_assert(sizeof(WZMVertex) == sizeof(GLfloat)*3, "WZMVertex has become fat.");
-		glVertexPointer(3, GL_FLOAT, 0, &msh.m_vertexArray[0]);
+		glVertexPointer(3, GL_FLOAT, 0, vertexData);
 
-		static_assert(sizeof(IndexedTri) == sizeof(GLushort)*3, "IndexedTri has become fat.");
-		glDrawElements(GL_TRIANGLES, static_cast<int>(msh.m_indexArray.size()) * 3, GL_UNSIGNED_SHORT, &msh.m_indexArray[0]);
+		glDrawElements(GL_TRIANGLES, static_cast<int>(msh.m_indexArray.size()) * 3, msh.drawIndexType(), indexData);
+
+		if (buffers)
+		{
+			buffers->vertices.release();
+			buffers->indices.release();
+		}
+		lap.to(FrameTimings::STAGE_DRAW);
 
 		if (!isFixedPipelineRenderer())
 		{
@@ -216,16 +270,23 @@ void QWZM::render(const float* mtxModelView, const float* mtxProj, const float*
 				shader->disableAttributeArray(vertexTangentAtributeName);
 			}
 			releaseShader(activeShader);
+			lap.to(FrameTimings::STAGE_UNIFORMS);
 		}
 
 		clearTextureUnits(activeShader);
+		lap.to(FrameTimings::STAGE_TEXTURES);
 
-		if (m_drawNormals)
-			drawNormals(i, m_drawTangentAndBitangent);
-		if (m_drawConnectors)
-			drawConnectors(i);
+		unsigned drawCalls = 1;
+		if (m_drawNormals || m_drawConnectors)
+		{
+			drawCalls += drawOverlays(i);
+			lap.to(FrameTimings::STAGE_OVERLAYS);
+		}
 
 		glPopMatrix();
+
+		if (m_timings)
+			m_timings->countMesh(msh.m_name, msh.m_indexArray.size(), drawCalls);
 	}
 
 	// set it back
@@ -238,50 +299,129 @@ void QWZM::render(const float* mtxModelView, const float* mtxProj, const float*
 	if (!hasAnimObject())
 	{
 		if (m_drawCenterPoint)
+		{
 			drawCenterPoint();
+			lap.to(FrameTimings::STAGE_OVERLAYS);
+		}
 	}
 
 	glPopMatrix();
 	glPopClientAttrib();
 	glPopAttrib();
+	lap.to(FrameTimings::STAGE_DRAW);
 }
 
-void QWZM::drawAPoint(const WZMVertex& center, const WZMVertex& scale, const WZMVertex& color, const float lineLength)
+QWZM::MeshBuffers* QWZM::meshBuffers(size_t mesh_idx)
+{
+	const Mesh& msh = m_meshes.at(mesh_idx);
+	MeshBuffers& buffers = m_meshBuffers.at(mesh_idx);
+
+	const size_t points = msh.vertices();
+	const size_t indexSize = msh.drawIndexType() == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	const size_t indexBytes = msh.indices() * 3 * indexSize;
+	const size_t vertexBytes = points * (2 * sizeof(WZMVertex) + sizeof(WZMUV) + sizeof(WZMVertex4));
+
+	if (!points || !indexBytes || vertexBytes > static_cast<size_t>(std::numeric_limits<int>::max()) ||
+		msh.m_tangentArray.size() != points)
+	{
+		return nullptr;
+	}
+
+	if (!buffers.vertices.isCreated() && !buffers.vertices.create())
+		return nullptr;
+	if (!buffers.indices.isCreated() && !buffers.indices.create())
+		return nullptr;
+
+	if (!buffers.vertices.bind() || !buffers.indices.bind())
+	{
+		buffers.vertices.release();
+		return nullptr;
+	}
+
+	if (buffers.generation != msh.generation())
+	{
+		buffers.uvOffset = points * sizeof(WZMVertex);
+		buffers.normalOffset = buffers.uvOffset + points * sizeof(WZMUV);
+		buffers.tangentOffset = buffers.normalOffset + points * sizeof(WZMVertex);
+
+		buffers.vertices.allocate(static_cast<int>(vertexBytes));
+		buffers.vertices.write(0, msh.m_vertexArray.data(), static_cast<int>(buffers.uvOffset));
+		buffers.vertices.write(static_cast<int>(buffers.uvOffset), msh.m_textureArray.data(),
+				       static_cast<int>(buffers.normalOffset - buffers.uvOffset));
+		buffers.vertices.write(static_cast<int>(buffers.normalOffset), msh.m_normalArray.data(),
+				       static_cast<int>(buffers.tangentOffset - buffers.normalOffset));
+		buffers.vertices.write(static_cast<int>(buffers.tangentOffset), msh.m_tangentArray.data(),
+				       static_cast<int>(vertexBytes - buffers.tangentOffset));
+
+		buffers.indices.allocate(msh.drawIndexData(), static_cast<int>(indexBytes));
+
+		buffers.generation = msh.generation();
+	}
+
+	return &buffers;
+}
+
+void QWZM::releaseMeshBuffers()
+{
+	for (MeshBuffers& buffers : m_meshBuffers)
+	{
+		buffers.vertices.destroy();
+		buffers.indices.destroy();
+		buffers.overlay.destroy();
+	}
+	m_meshBuffers.clear();
+}
+
+void QWZM::addLine(std::vector<OverlayVertex>& lines, const WZMVertex& from, const WZMVertex& to,
+		   const WZMVertex& colour)
+{
+	const OverlayVertex start = {{from.x(), from.y(), from.z()}, {colour.x(), colour.y(), colour.z()}};
+	const OverlayVertex end = {{to.x(), to.y(), to.z()}, {colour.x(), colour.y(), colour.z()}};
+	lines.push_back(start);
+	lines.push_back(end);
+}
+
+void QWZM::addCross(std::vector<OverlayVertex>& lines, const WZMVertex& center, const WZMVertex& scale,
+		    const WZMVertex& colour, float lineLength)
 {
 	GLfloat x, y, z;
 	x = center.x() * scale[0];
 	y = center.y() * scale[1];
 	z = center.z() * scale[2];
 
-	GLboolean lighting, texture;
+	addLine(lines, WZMVertex(-lineLength + x, y, z), WZMVertex(lineLength + x, y, z), colour);
+	addLine(lines, WZMVertex(x, -lineLength + y, z), WZMVertex(x, lineLength + y, z), colour);
+	addLine(lines, WZMVertex(x, y, -lineLength + z), WZMVertex(x, y, lineLength + z), colour);
+}
 
-	glGetBooleanv(GL_LIGHTING, &lighting);
-	if (lighting)
-		glDisable(GL_LIGHTING);
+bool QWZM::drawLines(const GLvoid* vertices, GLint first, GLsizei count, GLfloat width)
+{
+	if (count <= 0)
+		return false;
 
-	texture = glIsEnabled(GL_TEXTURE_2D);
-	if (texture)
-		glDisable(GL_TEXTURE_2D);
+	glPushAttrib(GL_ENABLE_BIT | GL_LINE_BIT | GL_CURRENT_BIT);
+	glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
 
-	glEnable(GL_LINE_SMOOTH);
-	glLineWidth(2);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_TEXTURE_2D);
+	if (width > 1.f)
+		glEnable(GL_LINE_SMOOTH);
+	glLineWidth(width);
 
-	glColor3f(color.x(), color.y(), color.z());
+	glDisableClientState(GL_NORMAL_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
 
-	glBegin(GL_LINES);
-	glVertex3f(-lineLength + x, y, z);
-	glVertex3f(lineLength + x, y, z);
-	glVertex3f(x, -lineLength + y, z);
-	glVertex3f(x, lineLength + y, z);
-	glVertex3f(x, y, -lineLength + z);
-	glVertex3f(x, y, lineLength + z);
-	glEnd();
+	const GLubyte* base = static_cast<const GLubyte*>(vertices);
+	glVertexPointer(3, GL_FLOAT, sizeof(OverlayVertex), base + offsetof(OverlayVertex, pos));
+	glColorPointer(3, GL_FLOAT, sizeof(OverlayVertex), base + offsetof(OverlayVertex, colour));
 
-	if (texture)
-		glEnable(GL_TEXTURE_2D);
+	glDrawArrays(GL_LINES, first, count);
 
-	if (lighting)
-		glEnable(GL_LIGHTING);
+	glPopClientAttrib();
+	glPopAttrib();
+	return true;
 }
 
 void QWZM::drawCenterPoint()
@@ -300,76 +440,111 @@ void QWZM::drawCenterPoint()
 	}
 
 	const static WZMVertex whiteCol = WZMVertex(1.f, 1.f, 1.f);
-	drawAPoint(center, scale, whiteCol, 40.f);
+
+	std::vector<OverlayVertex> lines;
+	addCross(lines, center, scale, whiteCol, 40.f);
+	drawLines(lines.data(), 0, static_cast<GLsizei>(lines.size()), 2.f);
 }
 
-void QWZM::drawNormals(size_t mesh_idx, bool draw_tb)
+QWZM::MeshBuffers& QWZM::meshOverlay(size_t mesh_idx)
 {
-	GLboolean lighting, texture;
+	const Mesh& msh = m_meshes.at(mesh_idx);
+	MeshBuffers& buffers = m_meshBuffers.at(mesh_idx);
 
-	glGetBooleanv(GL_LIGHTING, &lighting);
-	if (lighting)
-		glDisable(GL_LIGHTING);
+	if (buffers.overlayGeneration == msh.generation() && buffers.overlayScale == scale_all)
+		return buffers;
 
-	texture = glIsEnabled(GL_TEXTURE_2D);
-	if (texture)
-		glDisable(GL_TEXTURE_2D);
+	static const WZMVertex normalCol(0.7f, 1.0f, 0.7f);
+	static const WZMVertex tangentCol(1.0f, 0.7f, 0.7f);
+	static const WZMVertex bitangentCol(0.7f, 0.7f, 1.0f);
+	static const WZMVertex connectorScale(1.f, 1.f, 1.f);
 
-	glColor3f(0.7f, 1.0f, 0.7f);
+	std::vector<OverlayVertex>& lines = buffers.overlayVertices;
+	lines.clear();
+	lines.reserve(msh.m_vertexArray.size() * 6 + msh.connectors() * 6);
 
-	WZMVertex nrm, tb;
-	qglviewer::Vec from, to;
+	const float length = 2.f / scale_all;
 
-	const Mesh& msh = m_meshes.at(mesh_idx);
+	buffers.overlayFirst[OVERLAY_NORMALS] = 0;
 	for (size_t j = 0; j < msh.m_vertexArray.size(); ++j)
 	{
-		nrm = msh.m_normalArray[j].normalize() * 2. / scale_all;
-		from = qglviewer::Vec(msh.m_vertexArray[j].x(), msh.m_vertexArray[j].y(), msh.m_vertexArray[j].z());
-
-		if (draw_tb)
-			glColor3f(0.7f, 1.0f, 0.7f);
-		to = qglviewer::Vec(from + qglviewer::Vec(nrm.x(), nrm.y(), nrm.z()));
-		QGLViewer::drawArrow(from, to);
+		addLine(lines, msh.m_vertexArray[j], msh.m_vertexArray[j] + msh.m_normalArray[j].normalize() * length,
+			normalCol);
+	}
 
-		if (draw_tb)
-		{
-			const WZMVertex4& tngt = msh.m_tangentArray[j];
-			tb = WZMVertex(tngt.x(), tngt.y(), tngt.z()).normalize() * 2. / scale_all;
+	buffers.overlayFirst[OVERLAY_TANGENTS] = static_cast<GLint>(lines.size());
+	for (size_t j = 0; j < msh.m_vertexArray.size() && j < msh.m_tangentArray.size(); ++j)
+	{
+		const WZMVertex4& tngt = msh.m_tangentArray[j];
+		addLine(lines, msh.m_vertexArray[j],
+			msh.m_vertexArray[j] + WZMVertex(tngt.x(), tngt.y(), tngt.z()).normalize() * length, tangentCol);
+	}
 
-			glColor3f(1.0f, 0.7f, 0.7f);
-			to = qglviewer::Vec(from + qglviewer::Vec(tb.x(), tb.y(), tb.z()));
-			QGLViewer::drawArrow(from, to);
+	buffers.overlayFirst[OVERLAY_BITANGENTS] = static_cast<GLint>(lines.size());
+	for (size_t j = 0; j < msh.m_vertexArray.size() && j < msh.m_bitangentArray.size(); ++j)
+	{
+		addLine(lines, msh.m_vertexArray[j], msh.m_vertexArray[j] + msh.m_bitangentArray[j].normalize() * length,
+			bitangentCol);
+	}
 
-			tb = msh.m_bitangentArray[j].normalize() * 2. / scale_all;
+	buffers.overlayFirst[OVERLAY_CONNECTORS] = static_cast<GLint>(lines.size());
+	size_t con_idx = 0;
+	for (auto itC = msh.m_connectors.begin(); itC != msh.m_connectors.end(); ++itC)
+	{
+		addCross(lines, itC->getPos(), connectorScale, CONNECTOR_COLORS[con_idx % MAX_CONNECTOR_COLORS], 20.f);
+		++con_idx;
+	}
 
-			glColor3f(0.7f, 0.7f, 1.0f);
-			to = qglviewer::Vec(from + qglviewer::Vec(tb.x(), tb.y(), tb.z()));
-			QGLViewer::drawArrow(from, to);
-		}
+	for (int i = 0; i < OVERLAY_COUNT; ++i)
+	{
+		const GLint last = i + 1 < OVERLAY_COUNT ? buffers.overlayFirst[i + 1] : static_cast<GLint>(lines.size());
+		buffers.overlayCount[i] = last - buffers.overlayFirst[i];
 	}
 
-	if (texture)
-		glEnable(GL_TEXTURE_2D);
+	buffers.overlayUploaded = false;
+	const size_t bytes = lines.size() * sizeof(OverlayVertex);
+	if (!lines.empty() && bytes <= static_cast<size_t>(std::numeric_limits<int>::max()) &&
+		(buffers.overlay.isCreated() || buffers.overlay.create()) && buffers.overlay.bind())
+	{
+		buffers.overlay.allocate(lines.data(), static_cast<int>(bytes));
+		buffers.overlay.release();
+		buffers.overlayUploaded = true;
+		std::vector<OverlayVertex>().swap(lines);
+	}
 
-	if (lighting)
-		glEnable(GL_LIGHTING);
+	buffers.overlayGeneration = msh.generation();
+	buffers.overlayScale = scale_all;
+	return buffers;
 }
 
-void QWZM::drawConnectors(size_t mesh_idx)
+unsigned QWZM::drawOverlays(size_t mesh_idx)
 {
-	static const WZMVertex scale(1.f, 1.f, 1.f);
+	MeshBuffers& buffers = meshOverlay(mesh_idx);
 
-	const Mesh& msh = m_meshes.at(mesh_idx);
+	const GLvoid* vertices = buffers.overlayVertices.data();
+	if (buffers.overlayUploaded)
+	{
+		if (!buffers.overlay.bind())
+			return 0;
+		vertices = nullptr;
+	}
 
-	for (size_t j = 0; j < msh.connectors(); ++j)
+	unsigned drawCalls = 0;
+	if (m_drawNormals)
 	{
-		size_t con_idx = 0;
-		for (auto itC = msh.m_connectors.begin(); itC != msh.m_connectors.end(); ++itC)
+		drawCalls += drawLines(vertices, buffers.overlayFirst[OVERLAY_NORMALS], buffers.overlayCount[OVERLAY_NORMALS], 1.f);
+		if (m_drawTangentAndBitangent)
 		{
-			drawAPoint(itC->getPos(), scale, CONNECTOR_COLORS[con_idx % MAX_CONNECTOR_COLORS], 20.f);
-			++con_idx;
+			drawCalls += drawLines(vertices, buffers.overlayFirst[OVERLAY_TANGENTS], buffers.overlayCount[OVERLAY_TANGENTS], 1.f);
+			drawCalls += drawLines(vertices, buffers.overlayFirst[OVERLAY_BITANGENTS], buffers.overlayCount[OVERLAY_BITANGENTS], 1.f);
 		}
 	}
+	if (m_drawConnectors)
+		drawCalls += drawLines(vertices, buffers.overlayFirst[OVERLAY_CONNECTORS], buffers.overlayCount[OVERLAY_CONNECTORS], 2.f);
+
+	if (buffers.overlayUploaded)
+		buffers.overlay.release();
+	return drawCalls;
 }
 
 void QWZM::animate()
@@ -387,6 +562,7 @@ void QWZM::animate()
 
 void QWZM::clear()
 {
+	cancelTangentJob();
 	meshCountChanged();
 
 	WZM::clear();
@@ -446,6 +622,12 @@ QColor QWZM::getTCMaskColor()
     return m_tcmaskColour;
 }
 
+void QWZM::setShaderManager(IGLShaderManager* manager)
+{
+	m_shaderUniforms.clear();
+	IGLShaderRenderable::setShaderManager(manager);
+}
+
 void QWZM::setTextureManager(IGLTextureManager * manager)
 {
 	std::map<wzm_texture_type_t, QString> texture_names;
@@ -462,6 +644,9 @@ void QWZM::setTextureManager(IGLTextureManager * manager)
 		}
 	}
 
+	// The buffers belong to the context of the old manager
+	releaseMeshBuffers();
+
 	IGLTexturedRenderable::setTextureManager(manager);
 
 	for (it_names = texture_names.begin(); it_names != texture_names.end(); it_names++)
@@ -666,6 +851,9 @@ bool QWZM::initShader(int type)
 		break;
 	}
 
+	// The values set above are not known to the cache, look everything up anew
+	shaderUniforms(type, shader, true);
+
 	shader->release();
 	return true;
 }
@@ -680,78 +868,57 @@ bool QWZM::bindShader(int type)
 	if (!shader || !shader->bind())
 		return false;
 
-	int uniloc;
+	typedef ShaderUniforms U;
+	ShaderUniforms& uniforms = shaderUniforms(type, shader);
 
-	uniloc = shader->uniformLocation("hasTangents");
-	if (uniloc >= 0)
-		shader->setUniformValue(uniloc, GLint(m_enableTangentsInShaders));
+	setUniform(shader, uniforms, U::HAS_TANGENTS, GLint(m_enableTangentsInShaders));
 
-	uniloc = shader->uniformLocation("tcmask");
 	if (hasGLRenderTexture(WZM_TEX_TCMASK))
 	{
-		shader->setUniformValue(uniloc, GLint(1));
-		uniloc = shader->uniformLocation("teamcolour");
-		shader->setUniformValue(uniloc,
-					m_tcmaskColour.redF(), m_tcmaskColour.greenF(),
-					m_tcmaskColour.blueF(), m_tcmaskColour.alphaF());
+		setUniform(shader, uniforms, U::TCMASK, GLint(1));
+		setUniform(shader, uniforms, U::TEAMCOLOUR,
+			   QVector4D(m_tcmaskColour.redF(), m_tcmaskColour.greenF(),
+				     m_tcmaskColour.blueF(), m_tcmaskColour.alphaF()));
 	}
 	else
-		shader->setUniformValue(uniloc, GLint(0));
-
-	uniloc = shader->uniformLocation("normalmap");
-	if (hasGLRenderTexture(WZM_TEX_NORMALMAP))
-		shader->setUniformValue(uniloc, GLint(1));
-	else
-		shader->setUniformValue(uniloc, GLint(0));
-
-	uniloc = shader->uniformLocation("specularmap");
-	if (hasGLRenderTexture(WZM_TEX_SPECULAR))
-		shader->setUniformValue(uniloc, GLint(1));
-	else
-		shader->setUniformValue(uniloc, GLint(0));
+		setUniform(shader, uniforms, U::TCMASK, GLint(0));
 
-	uniloc = shader->uniformLocation("graphicsCycle");
-	shader->setUniformValue(uniloc, GLfloat(m_shadertime));
-
-	uniloc = shader->uniformLocation("ecmEffect");
-	shader->setUniformValue(uniloc, GLint(m_ecmState));
+	setUniform(shader, uniforms, U::NORMALMAP, GLint(hasGLRenderTexture(WZM_TEX_NORMALMAP) ? 1 : 0));
+	setUniform(shader, uniforms, U::SPECULARMAP, GLint(hasGLRenderTexture(WZM_TEX_SPECULAR) ? 1 : 0));
+	setUniform(shader, uniforms, U::GRAPHICS_CYCLE, GLfloat(m_shadertime));
+	setUniform(shader, uniforms, U::ECM_EFFECT, GLint(m_ecmState));
 
 	switch (type)
 	{
 	case WZ_SHADER_WZ32:
 	case WZ_SHADER_WZ33:
 	case WZ_SHADER_WZ40:
-		uniloc = shader->uniformLocation("ModelViewMatrix");
-		shader->setUniformValue(uniloc,	render_mtxModelView);
+	{
+		shader->setUniformValue(uniforms.locations[U::MODELVIEW], render_mtxModelView);
 
 		render_mtxMVP = render_mtxProj * render_mtxModelView;
+		shader->setUniformValue(uniforms.locations[U::MVP], render_mtxMVP);
 
-		uniloc = shader->uniformLocation("ModelViewProjectionMatrix");
-		shader->setUniformValue(uniloc,	render_mtxMVP);
-
-		render_mtxNM = render_mtxModelView.inverted().transposed();
-
-		uniloc = shader->uniformLocation("NormalMatrix");
-		shader->setUniformValue(uniloc,	render_mtxNM);
+		// Without an animation frame both matrices are the same, and so are most
+		// of them from one mesh to the next
+		const QMatrix4x4& mtxInverse = invertedModelView(render_mtxModelView);
+		render_mtxNM = mtxInverse.transposed();
+		shader->setUniformValue(uniforms.locations[U::NORMALMATRIX], render_mtxNM);
 
-		uniloc = shader->uniformLocation("lightPosition");
-		shader->setUniformValue(uniloc,	render_posSun * render_mtxModelView_preAnim.inverted());
-
-		uniloc = shader->uniformLocation("sceneColor");
-		shader->setUniformValue(uniloc,	lightCol0[LIGHT_EMISSIVE][0], lightCol0[LIGHT_EMISSIVE][1],
-				lightCol0[LIGHT_EMISSIVE][2], lightCol0[LIGHT_EMISSIVE][3]);
-
-		uniloc = shader->uniformLocation("ambient");
-		shader->setUniformValue(uniloc,	lightCol0[LIGHT_AMBIENT][0], lightCol0[LIGHT_AMBIENT][1],
-				lightCol0[LIGHT_AMBIENT][2], lightCol0[LIGHT_AMBIENT][3]);
-
-		uniloc = shader->uniformLocation("diffuse");
-		shader->setUniformValue(uniloc,	lightCol0[LIGHT_DIFFUSE][0], lightCol0[LIGHT_DIFFUSE][1],
-				lightCol0[LIGHT_DIFFUSE][2], lightCol0[LIGHT_DIFFUSE][3]);
-
-		uniloc = shader->uniformLocation("specular");
-		shader->setUniformValue(uniloc,	lightCol0[LIGHT_SPECULAR][0], lightCol0[LIGHT_SPECULAR][1],
-				lightCol0[LIGHT_SPECULAR][2], lightCol0[LIGHT_SPECULAR][3]);
+		if (render_mtxModelView_preAnim == render_mtxModelView)
+			shader->setUniformValue(uniforms.locations[U::LIGHT_POSITION], render_posSun * mtxInverse);
+		else
+			shader->setUniformValue(uniforms.locations[U::LIGHT_POSITION],
+						render_posSun * render_mtxModelView_preAnim.inverted());
+
+		setUniform(shader, uniforms, U::SCENE_COLOR, QVector4D(lightCol0[LIGHT_EMISSIVE][0], lightCol0[LIGHT_EMISSIVE][1],
+				lightCol0[LIGHT_EMISSIVE][2], lightCol0[LIGHT_EMISSIVE][3]));
+		setUniform(shader, uniforms, U::AMBIENT, QVector4D(lightCol0[LIGHT_AMBIENT][0], lightCol0[LIGHT_AMBIENT][1],
+				lightCol0[LIGHT_AMBIENT][2], lightCol0[LIGHT_AMBIENT][3]));
+		setUniform(shader, uniforms, U::DIFFUSE, QVector4D(lightCol0[LIGHT_DIFFUSE][0], lightCol0[LIGHT_DIFFUSE][1],
+				lightCol0[LIGHT_DIFFUSE][2], lightCol0[LIGHT_DIFFUSE][3]));
+		setUniform(shader, uniforms, U::SPECULAR, QVector4D(lightCol0[LIGHT_SPECULAR][0], lightCol0[LIGHT_SPECULAR][1],
+				lightCol0[LIGHT_SPECULAR][2], lightCol0[LIGHT_SPECULAR][3]));
 
 /*
 		uniloc = shader->uniformLocation("sceneColor");
@@ -782,20 +949,76 @@ bool QWZM::bindShader(int type)
 				m_material.vals[WZM_MAT_SPECULAR][2],
 				m_material.vals[WZM_MAT_SPECULAR][3]);
 */
-		uniloc = shader->uniformLocation("shininess");
-		if (uniloc >= 0)
-			shader->setUniformValue(uniloc,	m_material.shininess);
-
-		uniloc = shader->uniformLocation("alphaTest");
-		if (uniloc >= 0)
-			shader->setUniformValue(uniloc,	m_alphatest);
+		setUniform(shader, uniforms, U::SHININESS, GLfloat(m_material.shininess));
+		setUniform(shader, uniforms, U::ALPHA_TEST, GLint(m_alphatest));
 
 		break;
 	}
+	}
 
 	return true;
 }
 
+QWZM::ShaderUniforms& QWZM::shaderUniforms(int type, QOpenGLShaderProgram* shader, bool reload)
+{
+	static const char* const names[ShaderUniforms::UNIFORM_COUNT] = {
+		"hasTangents", "tcmask", "teamcolour", "normalmap", "specularmap",
+		"graphicsCycle", "ecmEffect", "ModelViewMatrix", "ModelViewProjectionMatrix", "NormalMatrix",
+		"lightPosition", "sceneColor", "ambient", "diffuse", "specular",
+		"shininess", "alphaTest"
+	};
+
+	const unsigned revision = m_shaderman->shaderRevision(type);
+
+	std::map<int, ShaderUniforms>::iterator it = m_shaderUniforms.find(type);
+	if (it != m_shaderUniforms.end() && it->second.revision == revision && !reload)
+		return it->second;
+
+	ShaderUniforms& uniforms = m_shaderUniforms[type];
+	uniforms.revision = revision;
+	for (int i = 0; i < ShaderUniforms::UNIFORM_COUNT; ++i)
+	{
+		uniforms.locations[i] = shader->uniformLocation(names[i]);
+		uniforms.uploaded[i] = false;
+	}
+	return uniforms;
+}
+
+void QWZM::setUniform(QOpenGLShaderProgram* shader, ShaderUniforms& uniforms,
+		      ShaderUniforms::Uniform uniform, GLint value)
+{
+	const QVector4D cached(static_cast<float>(value), 0.f, 0.f, 0.f);
+	if (uniforms.locations[uniform] < 0 || (uniforms.uploaded[uniform] && uniforms.values[uniform] == cached))
+		return;
+
+	shader->setUniformValue(uniforms.locations[uniform], value);
+	uniforms.values[uniform] = cached;
+	uniforms.uploaded[uniform] = true;
+}
+
+void QWZM::setUniform(QOpenGLShaderProgram* shader, ShaderUniforms& uniforms,
+		      ShaderUniforms::Uniform uniform, GLfloat value)
+{
+	const QVector4D cached(value, 0.f, 0.f, 0.f);
+	if (uniforms.locations[uniform] < 0 || (uniforms.uploaded[uniform] && uniforms.values[uniform] == cached))
+		return;
+
+	shader->setUniformValue(uniforms.locations[uniform], value);
+	uniforms.values[uniform] = cached;
+	uniforms.uploaded[uniform] = true;
+}
+
+void QWZM::setUniform(QOpenGLShaderProgram* shader, ShaderUniforms& uniforms,
+		      ShaderUniforms::Uniform uniform, const QVector4D& value)
+{
+	if (uniforms.locations[uniform] < 0 || (uniforms.uploaded[uniform] && uniforms.values[uniform] == value))
+		return;
+
+	shader->setUniformValue(uniforms.locations[uniform], value);
+	uniforms.values[uniform] = value;
+	uniforms.uploaded[uniform] = true;
+}
+
 void QWZM::releaseShader(int type)
 {
 	if (m_shaderman)
@@ -845,7 +1068,33 @@ void QWZM::slotMirrorAxis(int axis)
 void QWZM::slotRecalculateTB()
 {
 	applyTransformations();
-	recalculateTB(m_active_mesh);
+
+	// Runs in the background, a newer request replaces a running one
+	cancelTangentJob();
+	const unsigned jobId = ++m_tangentJobId;
+	m_tangentJob.reset(new TangentSpaceJob(*this, m_active_mesh));
+	m_tangentJob->start([this, jobId]() {emit tangentJobFinished(jobId);});
+}
+
+void QWZM::applyTangentJob(unsigned job)
+{
+	if (!m_tangentJob || job != m_tangentJobId)
+		return;
+
+	// Meshes edited in the meantime keep their tangents
+	if (m_tangentJob->apply(*this))
+		emit tangentsChanged();
+	m_tangentJob.reset();
+}
+
+void QWZM::cancelTangentJob()
+{
+	// The worker of a destroyed job runs out on its own, without a signal
+	if (m_tangentJob)
+	{
+		m_tangentJob->cancel();
+		m_tangentJob.reset();
+	}
 }
 
 void QWZM::applyTransformations()
@@ -929,9 +1178,9 @@ void QWZM::slotRemoveActiveMesh()
 	meshCountChanged(meshes(), getMeshNames());
 }
 
-bool QWZM::importFromOBJ(std::istream& in, bool welder)
+bool QWZM::importFromOBJ(std::istream& in, bool welder, unsigned threads)
 {
-	if (WZM::importFromOBJ(in, welder))
+	if (WZM::importFromOBJ(in, welder, threads))
 	{
 		meshCountChanged(meshes(), getMeshNames());
 		return true;
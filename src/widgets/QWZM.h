@@ -23,6 +23,9 @@
 #include <GL/glew.h>
 
 #include <chrono>
+#include <map>
+#include <memory>
+#include <vector>
 
 #include <QtCore>
 #include <QString>
@@ -30,8 +33,13 @@
 #include <QObject>
 #include <QMap>
 #include <QColor>
+#include <QOpenGLBuffer>
+#include <QVector4D>
 
 #include "WZM.h"
+#include "TangentSpace.h"
+#include "AnimationPoses.h"
+#include "FrameTimings.h"
 #include "IAnimatable.h"
 #include "IGLTexturedRenderable.h"
 #include "IGLShaderRenderable.h"
@@ -89,6 +97,10 @@ public:
 	QColor getTCMaskColor();
 signals:
 	void meshCountChanged(int cnt = 0, QStringList lst = QStringList());
+	void tangentsChanged();
+
+	// Emitted from the worker thread of the tangent job
+	void tangentJobFinished(unsigned job);
 
 public slots:
 	void setScaleXYZ(GLfloat xyz);
@@ -111,6 +123,9 @@ public slots:
 
 	void setAlphaTestState(bool enable) {m_alphatest = enable ? 1 : 0;}
 
+private slots:
+	void applyTangentJob(unsigned job);
+
 public:
 	/// IAnimatable
 	void animate();
@@ -118,8 +133,10 @@ public:
 	/// IGLTexturedRenderable
 	void render(const float *mtxModelView, const float *mtxProj, const float *posSun);
 	void setTextureManager(IGLTextureManager * manager);
+	void setFrameTimings(FrameTimings* timings) {m_timings = timings;}
 
 	/// IGLShaderRenderable
+	void setShaderManager(IGLShaderManager* manager);
 	bool initShader(int type);
 	bool bindShader(int type);
 	void releaseShader(int type);
@@ -128,28 +145,104 @@ public:
 	virtual operator Pie3Model() const;
 	void write(std::ostream& out) const;
 
-	bool importFromOBJ(std::istream& in, bool welder);
+	bool importFromOBJ(std::istream& in, bool welder, unsigned threads = 0);
 	void exportToOBJ(std::ostream& out) const;
 
 	void addMesh (const Mesh& mesh);
 
 	void setEcmState(bool enable);
+	bool getEcmState() const {return m_ecmState != 0;}
 
 private:
 	Q_DISABLE_COPY(QWZM)
 	void defaultConstructor();
-	void drawAPoint(const WZMVertex &center, const WZMVertex &scale, const WZMVertex &color, const float lineLength);
 	void drawCenterPoint();
-	void drawNormals(size_t mesh_idx, bool draw_tb);
-	void drawConnectors(size_t mesh_idx);
+	unsigned drawOverlays(size_t mesh_idx); // returns the draw calls made
 
 	bool setupTextureUnits(int type);
 	void clearTextureUnits(int type);
 
 	void applyPendingChangesToModel(WZM& model) const;
 	void resetAllPendingChanges();
+	void cancelTangentJob();
+
+	// Vertex of the debug overlays, drawn as GL_LINES
+	struct OverlayVertex
+	{
+		GLfloat pos[3];
+		GLfloat colour[3];
+	};
+
+	enum Overlay {OVERLAY_NORMALS, OVERLAY_TANGENTS, OVERLAY_BITANGENTS, OVERLAY_CONNECTORS, OVERLAY_COUNT};
+
+	static void addLine(std::vector<OverlayVertex>& lines, const WZMVertex& from, const WZMVertex& to,
+			    const WZMVertex& colour);
+	static void addCross(std::vector<OverlayVertex>& lines, const WZMVertex& center, const WZMVertex& scale,
+			     const WZMVertex& colour, float lineLength);
+	// vertices is an offset into the bound buffer or client memory
+	static bool drawLines(const GLvoid* vertices, GLint first, GLsizei count, GLfloat width);
+
+	/*
+	  GPU copy of the geometry of a mesh, the vertex buffer holds the
+	  positions, UVs, normals and tangents one array after the other.
+	  It is uploaded again whenever Mesh::generation() moves on.
+	  */
+	struct MeshBuffers
+	{
+		MeshBuffers(): generation(0), indices(QOpenGLBuffer::IndexBuffer),
+			uvOffset(0), normalOffset(0), tangentOffset(0),
+			overlayGeneration(0), overlayScale(0.f), overlayUploaded(false) {}
+
+		unsigned long long generation;
+		QOpenGLBuffer vertices, indices;
+		size_t uvOffset, normalOffset, tangentOffset;
+
+		// Debug lines, rebuilt when the mesh or scale_all change. The
+		// client copy is only kept when the buffer can't be used.
+		unsigned long long overlayGeneration;
+		GLfloat overlayScale;
+		std::vector<OverlayVertex> overlayVertices;
+		QOpenGLBuffer overlay;
+		bool overlayUploaded;
+		GLint overlayFirst[OVERLAY_COUNT];
+		GLsizei overlayCount[OVERLAY_COUNT];
+	};
+
+	/*
+	  Uniform locations of one shader program, looked up once per load of
+	  the shader, and the values last uploaded so unchanged ones are skipped.
+	  The matrices change per mesh and are always uploaded.
+	  */
+	struct ShaderUniforms
+	{
+		enum Uniform {HAS_TANGENTS, TCMASK, TEAMCOLOUR, NORMALMAP, SPECULARMAP,
+			      GRAPHICS_CYCLE, ECM_EFFECT, MODELVIEW, MVP, NORMALMATRIX,
+			      LIGHT_POSITION, SCENE_COLOR, AMBIENT, DIFFUSE, SPECULAR,
+			      SHININESS, ALPHA_TEST, UNIFORM_COUNT};
+
+		unsigned revision; // IGLShaderManager::shaderRevision() of the lookup
+		int locations[UNIFORM_COUNT];
+		bool uploaded[UNIFORM_COUNT];
+		QVector4D values[UNIFORM_COUNT];
+	};
+
+	ShaderUniforms& shaderUniforms(int type, QOpenGLShaderProgram* shader, bool reload = false);
+	static void setUniform(QOpenGLShaderProgram* shader, ShaderUniforms& uniforms,
+			       ShaderUniforms::Uniform uniform, GLint value);
+	static void setUniform(QOpenGLShaderProgram* shader, ShaderUniforms& uniforms,
+			       ShaderUniforms::Uniform uniform, GLfloat value);
+	static void setUniform(QOpenGLShaderProgram* shader, ShaderUniforms& uniforms,
+			       ShaderUniforms::Uniform uniform, const QVector4D& value);
+
+	// Needs the current context, nullptr when buffers are not available
+	MeshBuffers* meshBuffers(size_t mesh_idx);
+	MeshBuffers& meshOverlay(size_t mesh_idx);
+	void releaseMeshBuffers();
 
 	std::map<wzm_texture_type_t, GLuint> m_gl_textures;
+	std::vector<MeshBuffers> m_meshBuffers;
+	std::vector<AnimationPoses> m_animationPoses;
+	std::map<int, ShaderUniforms> m_shaderUniforms;
 
 	GLfloat scale_all, scale_xyz[3];
 	static const GLint winding;
@@ -170,6 +263,11 @@ private:
 	int m_alphatest;
 
 	int m_enableTangentsInShaders;
+
+	std::unique_ptr<TangentSpaceJob> m_tangentJob;
+	unsigned m_tangentJobId;
+
+	FrameTimings* m_timings; // nullptr while the viewport does not collect timings
 };
 
 #endif // QWZM_HPP
@@ -24,21 +24,35 @@
 # include <CoreFoundation/CFURL.h>
 #endif
 
+#include <cstring>
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QFileInfo>
+#include <QFontDatabase>
+#include <QLabel>
 #include <QRegularExpression>
 #include <QTextStream>
 #include <QPixmap>
 #include <QImage>
 #include <QApplication>
+#include <QRunnable>
+#include <QSaveFile>
 
 #include <QOpenGLShaderProgram>
 #include <QOpenGLTexture>
 #include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFunctions>
+#include <QOpenGLTimerQuery>
 #include <QtDebug>
 
 #include <QGLViewer/vec.h>
 
+#include "wmit.h"
+#include "ModelIO.h"
 #include "IGLTexturedRenderable.h"
 #include "IGLShaderRenderable.h"
 #include "IAnimatable.h"
@@ -96,15 +110,126 @@ private:
 	QOpenGLWidget *m_widget;
 };
 
+#define WMIT_PROGRAM_BINARY_EXT ".wmitprog"
+
+/*!
+ * The files the view keeps in the cache directory, which share one budget.
+ * Program binaries are keyed on the driver and the shader sources, so every
+ * driver update or shader edit leaves the old ones behind to be pruned.
+ */
+QStringList viewCacheFilters()
+{
+	return QStringList() << "*" WMIT_TEXTURE_CACHE_EXT << "*" WMIT_PROGRAM_BINARY_EXT;
+}
+
+/*!
+ * Reads a texture image on a pool thread and hands its mip chain to
+ * QtGLView::textureDecoded() on the GUI thread.
+ *
+ * The chain is looked up in the texture cache first, keyed by the bytes of the
+ * image file. On a miss the image is decoded, downsampled and - if asked for -
+ * BC3 compressed right here, and stored for the next time the file is opened.
+ */
+class TextureDecodeTask : public QRunnable
+{
+public:
+	TextureDecodeTask(QObject *view, const QString& fileName, uint decode,
+			  const QString& cacheDir, bool compress) :
+		m_view(view), m_fileName(fileName), m_decode(decode),
+		m_cacheDir(cacheDir), m_compress(compress) {}
+
+	void run()
+	{
+		QFile file(m_fileName);
+		const QByteArray bytes = file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+
+		TextureCacheKey key;
+		std::string cachePath;
+		if (!bytes.isEmpty() && !m_cacheDir.isEmpty() && QDir().mkpath(m_cacheDir))
+		{
+			key = TextureCache::makeKey(bytes.constData(), static_cast<size_t>(bytes.size()),
+						    m_compress ? WMIT_TEXTURE_BC3 : WMIT_TEXTURE_RGBA8);
+			cachePath = TextureCache::entryPath(m_cacheDir.toLocal8Bit().constData(), key);
+		}
+
+		TextureChain chain;
+		if (!cachePath.empty() && TextureCache::read(cachePath, key, chain))
+		{
+			touchCacheEntry(QString::fromLocal8Bit(cachePath.c_str()));
+		}
+		else
+		{
+			QImage image;
+			if (image.loadFromData(bytes))
+			{
+				image = image.convertToFormat(QImage::Format_RGBA8888);
+				buildMipChain(image.constBits(), image.width(), image.height(), image.bytesPerLine(), chain);
+				if (m_compress)
+					compressChainBC3(chain, chain);
+
+				// A full chain of a 2048x2048 page is over 20 MB, and hot reloading
+				// writes one for every save of the image
+				if (!cachePath.empty() && TextureCache::write(cachePath, key, chain))
+				{
+					pruneCacheDirectory(m_cacheDir, viewCacheFilters(), WMIT_TEXTURE_CACHE_MAX_BYTES,
+							    static_cast<qint64>(chain.byteSize()));
+				}
+			}
+		}
+
+		QMetaObject::invokeMethod(m_view, "textureDecoded", Qt::QueuedConnection,
+					  Q_ARG(QString, m_fileName), Q_ARG(uint, m_decode), Q_ARG(TextureChain, chain));
+	}
+
+private:
+	QObject *m_view;
+	QString m_fileName;
+	uint m_decode;
+	QString m_cacheDir;
+	bool m_compress;
+};
+
 } // anonymous namespace
 
 const Vec lightPos(2.25, 6., 4.5);
 
 QtGLView::QtGLView(QWidget *parent) :
 		QGLViewer(parent),
+		m_textureBudget(256 * 1024 * 1024),
+		m_textureBytes(0),
+		m_textureClock(0),
+		m_textureStats(),
+		m_lastDecode(0),
+		m_cacheDir(modelCacheDirectory()),
+		m_compressTextures(false),
+		m_canCompressTextures(false),
+		m_maxAnisotropy(0.f),
 		drawLightSource(true),
-		linkLightToCamera(true)
+		linkLightToCamera(true),
+		m_canCacheProgramBinaries(false),
+		m_drewFirstFrame(false),
+		m_showFrameTimings(false),
+		m_frameTimingsLabel(nullptr),
+		m_timerQueryNext(0),
+		m_timerQueryActive(-1),
+		m_triedTimerQueries(false)
 {
+	qRegisterMetaType<TextureChain>();
+
+	for (int i = 0; i < TIMER_QUERIES; ++i)
+	{
+		m_timerQueries[i] = nullptr;
+		m_timerQueryPending[i] = false;
+	}
+
+	// A plain child widget, QGLViewer's own text drawing is disabled below
+	m_frameTimingsLabel = new QLabel(this);
+	m_frameTimingsLabel->setAttribute(Qt::WA_TransparentForMouseEvents);
+	m_frameTimingsLabel->setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+	m_frameTimingsLabel->setStyleSheet("QLabel {color: white; background-color: rgba(0, 0, 0, 160); padding: 4px;}");
+	m_frameTimingsLabel->move(8, 8);
+	m_frameTimingsLabel->hide();
+
 	setStateFileName(QString());
 	connect(&textureUpdater, SIGNAL(fileChanged(QString)), this, SLOT(textureChanged(QString)));
 
@@ -120,6 +245,10 @@ QtGLView::~QtGLView()
 	// same missing-current-context problem.)
 	ScopedGLContext ctxGuard(this);
 
+	// Decodes still running post their results to us
+	m_decodePool.clear();
+	m_decodePool.waitForDone();
+
 	foreach(IGLRenderable* obj, renderList)
 	{
 		dynamicManagedSetup(obj, true);
@@ -131,14 +260,24 @@ QtGLView::~QtGLView()
 			texIt->pTexture->destroy();
 	}
 	m_textures.clear();
+
+	for (int i = 0; i < TIMER_QUERIES; ++i)
+	{
+		if (m_timerQueries[i] != nullptr)
+			m_timerQueries[i]->destroy();
+	}
 }
 
 void QtGLView::animate()
 {
+	FrameTimings::Lap lap(m_showFrameTimings ? &m_frameTimings : nullptr);
+
 	foreach(IAnimatable* obj, animateList)
 	{
 		obj->animate();
 	}
+
+	lap.to(FrameTimings::STAGE_ANIMATION);
 }
 
 void QtGLView::setLightColors()
@@ -174,6 +313,27 @@ void QtGLView::init()
 	qInfo("OpenGL renderer: %s", glRenderer ? reinterpret_cast<const char*>(glRenderer) : "(null)");
 	qInfo("OpenGL version: %s", glVersion ? reinterpret_cast<const char*>(glVersion) : "(null)");
 
+	// Optional texture features, queried through Qt as GLEW may not be usable
+	QOpenGLContext *ctx = QOpenGLContext::currentContext();
+	if (ctx && (ctx->hasExtension("GL_EXT_texture_filter_anisotropic") ||
+		    ctx->hasExtension("GL_ARB_texture_filter_anisotropic")))
+	{
+		glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &m_maxAnisotropy);
+	}
+	m_canCompressTextures = ctx && ctx->hasExtension("GL_EXT_texture_compression_s3tc");
+
+	if (ctx && ctx->hasExtension("GL_ARB_get_program_binary"))
+	{
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		m_canCacheProgramBinaries = formats > 0;
+	}
+
+	// Textures created before we had a context were uploaded without one
+	reloadAllTextures();
+
+	logStartupTime("OpenGL initialized");
+
 	setLightColors();
 	glLightModelf(GL_LIGHT_MODEL_LOCAL_VIEWER, 1.0);
 	glEnable(GL_LIGHT0);
@@ -212,6 +372,9 @@ void QtGLView::draw()
 {
 	static float mtxPrj[16], mtxMV[16], larr[4] = {0.f};
 
+	if (m_showFrameTimings)
+		beginFrameTiming();
+
 	camera()->getProjectionMatrix(mtxPrj);
 	camera()->getModelViewMatrix(mtxMV);
 
@@ -232,6 +395,21 @@ void QtGLView::draw()
 	{
 		obj->render(mtxMV, mtxPrj, larr);
 	}
+
+	if (!m_drewFirstFrame)
+	{
+		m_drewFirstFrame = true;
+		logStartupTime("first frame drawn");
+	}
+}
+
+void QtGLView::logStartupTime(const char* milestone)
+{
+	static QElapsedTimer startup;
+	if (!startup.isValid())
+		startup.start();
+
+	qInfo("Startup: %s after %lld ms", milestone, static_cast<long long>(startup.elapsed()));
 }
 
 void QtGLView::postDraw()
@@ -358,6 +536,157 @@ void QtGLView::postDraw()
 
 	if (texture)
 		glEnable(GL_TEXTURE_2D);
+
+	if (m_showFrameTimings)
+		endFrameTiming();
+}
+
+void QtGLView::setFrameTimingsShown(bool shown)
+{
+	if (m_showFrameTimings == shown)
+		return;
+
+	m_showFrameTimings = shown;
+	m_frameTimings.clear();
+	m_frameTimingsRefresh.invalidate();
+
+	foreach(IGLRenderable* obj, renderList)
+	{
+		obj->setFrameTimings(shown ? &m_frameTimings : nullptr);
+	}
+
+	if (shown)
+	{
+		m_frameTimingsLabel->setText(tr("Collecting frame timings..."));
+		m_frameTimingsLabel->adjustSize();
+		m_frameTimingsLabel->show();
+	}
+	else
+	{
+		m_frameTimingsLabel->hide();
+	}
+	update();
+}
+
+void QtGLView::beginFrameTiming()
+{
+	m_frameStart.start();
+
+	if (!m_triedTimerQueries)
+	{
+		m_triedTimerQueries = true;
+
+		QOpenGLContext* ctx = context();
+		if (ctx && ctx->hasExtension("GL_ARB_timer_query"))
+		{
+			for (int i = 0; i < TIMER_QUERIES; ++i)
+			{
+				m_timerQueries[i] = new QOpenGLTimerQuery(this);
+				if (!m_timerQueries[i]->create())
+				{
+					for (int j = 0; j <= i; ++j)
+					{
+						delete m_timerQueries[j];
+						m_timerQueries[j] = nullptr;
+					}
+					break;
+				}
+			}
+		}
+
+		if (m_timerQueries[0] == nullptr)
+			qInfo("Frame timings: GL_ARB_timer_query is not available, no GPU times");
+	}
+
+	// Skip the GPU time of this frame when every query is still in flight
+	m_timerQueryActive = -1;
+	if (m_timerQueries[0] != nullptr && !m_timerQueryPending[m_timerQueryNext])
+	{
+		m_timerQueryActive = m_timerQueryNext;
+		m_timerQueries[m_timerQueryActive]->begin();
+		m_timerQueryNext = (m_timerQueryNext + 1) % TIMER_QUERIES;
+	}
+}
+
+void QtGLView::endFrameTiming()
+{
+	if (m_timerQueryActive >= 0)
+	{
+		m_timerQueries[m_timerQueryActive]->end();
+		m_timerQueryPending[m_timerQueryActive] = true;
+		m_timerQueryActive = -1;
+	}
+
+	// Oldest query first, stop at the first one the GPU is not done with
+	for (int n = 0; n < TIMER_QUERIES; ++n)
+	{
+		const int i = (m_timerQueryNext + n) % TIMER_QUERIES;
+		if (!m_timerQueryPending[i])
+			continue;
+		if (!m_timerQueries[i]->isResultAvailable())
+			break;
+
+		m_frameTimings.add(FrameTimings::STAGE_GPU, m_timerQueries[i]->waitForResult() / 1e6);
+		m_timerQueryPending[i] = false;
+	}
+
+	m_frameTimings.add(FrameTimings::STAGE_FRAME, m_frameStart.nsecsElapsed() / 1e6);
+	m_frameTimings.endFrame();
+
+	if (m_frameTimings.frames() % m_frameTimings.window() == 0)
+		qInfo("%s", qPrintable(frameTimingsReport()));
+
+	if (!m_frameTimingsRefresh.isValid() || m_frameTimingsRefresh.elapsed() >= 250)
+	{
+		m_frameTimingsLabel->setText(frameTimingsReport());
+		m_frameTimingsLabel->adjustSize();
+		m_frameTimingsRefresh.start();
+	}
+}
+
+QString QtGLView::frameTimingsReport() const
+{
+	QString report = QString("Frame timings over %1 frames\n%2 %3 %4")
+		.arg(m_frameTimings.samples(FrameTimings::STAGE_FRAME))
+		.arg("ms", -10).arg("avg", 8).arg("p95", 8);
+
+	for (int i = 0; i < FrameTimings::STAGE__LAST; ++i)
+	{
+		const FrameTimings::Stage stage = static_cast<FrameTimings::Stage>(i);
+		report += QString("\n%1 ").arg(FrameTimings::stageName(stage), -10);
+
+		if (m_frameTimings.samples(stage) == 0)
+		{
+			report += stage == FrameTimings::STAGE_GPU && m_timerQueries[0] == nullptr ?
+					QString("unavailable").rightJustified(17) : QString("-").rightJustified(8);
+			continue;
+		}
+		report += QString("%1 %2").arg(m_frameTimings.average(stage), 8, 'f', 3)
+				.arg(m_frameTimings.percentile95(stage), 8, 'f', 3);
+	}
+
+	size_t triangles = 0, drawCalls = 0;
+	QString meshes;
+	for (const FrameTimings::MeshCounts& counts : m_frameTimings.meshCounts())
+	{
+		triangles += counts.triangles;
+		drawCalls += counts.drawCalls;
+		meshes += QString("\n  %1 %2 tris %3 calls").arg(QString::fromStdString(counts.name), -12)
+				.arg(counts.triangles, 7).arg(counts.drawCalls, 3);
+	}
+	report += QString("\n%1 meshes, %2 triangles, %3 draw calls")
+			.arg(m_frameTimings.meshCounts().size()).arg(triangles).arg(drawCalls);
+	report += meshes;
+
+	// Counted since the view was created, not per window
+	const TextureCacheStats textures = textureCacheStats();
+	report += QString("\n%1 textures, %2 of %3 MiB, %4 hits %5 misses %6 evictions")
+			.arg(textures.residentTextures)
+			.arg(textures.residentBytes / (1024. * 1024.), 0, 'f', 1)
+			.arg(m_textureBudget / (1024. * 1024.), 0, 'f', 1)
+			.arg(textures.hits).arg(textures.misses).arg(textures.evictions);
+
+	return report;
 }
 
 void QtGLView::dynamicManagedSetup(IGLRenderable *object, bool remove)
@@ -371,6 +700,8 @@ void QtGLView::dynamicManagedSetup(IGLRenderable *object, bool remove)
 	IGLShaderRenderable* obj_sr = dynamic_cast<IGLShaderRenderable*>(object);
 	if (obj_sr)
 		obj_sr->setShaderManager(remove ? nullptr : this);
+
+	object->setFrameTimings(!remove && m_showFrameTimings ? &m_frameTimings : nullptr);
 }
 
 void QtGLView::addToRenderList(IGLRenderable* object)
@@ -435,47 +766,167 @@ void QtGLView::timerEvent(QTimerEvent *event)
 
 void QtGLView::updateTextures()
 {
-	ScopedGLContext ctxGuard(this);
-
 	t_texIt texIt;
 	for (texIt = m_textures.begin(); texIt != m_textures.end(); ++texIt)
 	{
 		if (texIt.value().update)
 		{
-			QImage image(texIt.key());
+			// The old image stays on screen until the new one is decoded
 			texIt.value().update = false;
-			if (!image.isNull())
+			queueDecode(texIt.key(), texIt.value());
+		}
+	}
+}
+
+void QtGLView::reloadAllTextures()
+{
+	for (t_texIt texIt = m_textures.begin(); texIt != m_textures.end(); ++texIt)
+	{
+		queueDecode(texIt.key(), texIt.value());
+	}
+}
+
+void QtGLView::setTextureCompression(bool enabled)
+{
+	if (m_compressTextures != enabled)
+	{
+		m_compressTextures = enabled;
+		reloadAllTextures();
+	}
+}
+
+void QtGLView::queueDecode(const QString& fileName, ManagedGLTexture& texture)
+{
+	texture.decode = ++m_lastDecode;
+	m_decodePool.start(new TextureDecodeTask(this, fileName, texture.decode, m_cacheDir,
+						 m_compressTextures && m_canCompressTextures));
+}
+
+void QtGLView::textureDecoded(const QString& fileName, uint decode, const TextureChain& chain)
+{
+	t_texIt texIt = m_textures.find(fileName);
+
+	// Deleted meanwhile, or the file changed again and a newer decode is on its way
+	if (texIt == m_textures.end() || texIt.value().decode != decode)
+		return;
+
+	if (chain.isNull())
+	{
+		qWarning("QtGLView: unable to read texture %s", qUtf8Printable(fileName));
+		return;
+	}
+
+	ScopedGLContext ctxGuard(this);
+
+	ManagedGLTexture& texture = texIt.value();
+	uploadChain(texture.pTexture->textureId(), chain);
+
+	m_textureBytes += static_cast<qint64>(chain.byteSize()) - static_cast<qint64>(texture.bytes);
+	texture.bytes = chain.byteSize();
+	evictTextures();
+
+	update();
+}
+
+void QtGLView::uploadChain(GLuint id, const TextureChain& chain)
+{
+	// NOT mirrored: WZ2100 texture coordinates put v = 0 at the TOP of the
+	// image (the .pie origin is top-left) and the game uploads its textures
+	// the same way. Mirroring here made a texture flip vertically the moment
+	// it was re-read from disk - i.e. every time an artist saved from their
+	// paint package with the model open.
+	//
+	// Plain glTexImage2D rather than QOpenGLTexture::setData(): the storage
+	// has to be reallocated when the placeholder is replaced, or when a
+	// reloaded image changed its size, and QOpenGLTexture keeps the first one.
+	QOpenGLContext *ctx = QOpenGLContext::currentContext();
+
+	glBindTexture(GL_TEXTURE_2D, id);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4); // RGBA scanlines are always 4 byte aligned
+	for (size_t i = 0; i < chain.levels.size(); ++i)
+	{
+		const TextureLevel& level = chain.levels[i];
+		if (chain.format == WMIT_TEXTURE_BC3)
+		{
+			// Only requested when the context has S3TC, and GL 1.3 is not in every GL header
+			if (ctx != nullptr)
 			{
-				// NOT mirrored: this has to match the initial upload in
-				// GLTexture(), which hands the QImage to QOpenGLTexture
-				// unflipped. WZ2100 texture coordinates put v = 0 at the TOP
-				// of the image (the .pie origin is top-left) and the game
-				// uploads its textures the same way, so the unflipped form is
-				// the correct one. Mirroring here made a texture flip
-				// vertically the moment it was re-read from disk - i.e. every
-				// time an artist saved from their paint package with the model
-				// open.
-				texIt.value().pTexture->setData(image);
+				ctx->functions()->glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i),
+									 GL_COMPRESSED_RGBA_S3TC_DXT5_EXT,
+									 level.width, level.height, 0,
+									 static_cast<GLsizei>(level.data.size()),
+									 level.data.data());
 			}
 		}
+		else
+		{
+			glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), GL_RGBA8, level.width, level.height, 0,
+				     GL_RGBA, GL_UNSIGNED_BYTE, level.data.data());
+		}
 	}
-	update();
+
+	// A reloaded image may come with fewer levels, the stale ones must not count
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(chain.levels.size()) - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (m_maxAnisotropy > 1.f)
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, m_maxAnisotropy);
 }
 
 void QtGLView::_deleteTexture(t_texIt& texIt)
 {
 	textureUpdater.removePath(texIt.key());
 	texIt.value().pTexture->destroy();
+	m_textureBytes -= static_cast<qint64>(texIt.value().bytes);
 	texIt = m_textures.erase(texIt);
 }
 
+void QtGLView::evictTextures()
+{
+	while (m_textureBytes > m_textureBudget)
+	{
+		t_texIt oldest = m_textures.end();
+		for (t_texIt texIt = m_textures.begin(); texIt != m_textures.end(); ++texIt)
+		{
+			if (texIt->users <= 0 && (oldest == m_textures.end() || texIt->lastUse < oldest->lastUse))
+				oldest = texIt;
+		}
+
+		// Whatever is left is in use
+		if (oldest == m_textures.end())
+			break;
+
+		_deleteTexture(oldest);
+		++m_textureStats.evictions;
+	}
+}
+
+QtGLView::TextureCacheStats QtGLView::textureCacheStats() const
+{
+	TextureCacheStats stats = m_textureStats;
+	stats.residentBytes = m_textureBytes;
+	stats.residentTextures = m_textures.size();
+	return stats;
+}
+
+void QtGLView::setTextureBudget(qint64 bytes)
+{
+	ScopedGLContext ctxGuard(this);
+
+	m_textureBudget = std::max<qint64>(bytes, 0);
+	evictTextures();
+}
+
 /// GLTextureManager components
 
 QtGLView::ManagedGLTexture::ManagedGLTexture(QOpenGLTexture *pInputTexture):
 	GLTexture(pInputTexture->textureId(), pInputTexture->width(), pInputTexture->height()),
 	pTexture(pInputTexture),
 	users(1),
-	update(false)
+	update(false),
+	decode(0),
+	bytes(0),
+	lastUse(0)
 {}
 
 GLTexture QtGLView::createTexture(const QString& fileName)
@@ -487,39 +938,39 @@ GLTexture QtGLView::createTexture(const QString& fileName)
 		t_texIt texIt = m_textures.find(fileName);
 		if (texIt == m_textures.end())
 		{
-			QImage image(fileName);
-			QOpenGLTexture *pTexture = new QOpenGLTexture(image);
-			pTexture->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+			// Drawn with the placeholder until the image is decoded
+			static const TextureChain placeholder = [] {
+				const QImage image = QImage(WMIT_IMAGES_NOTEXTURE).convertToFormat(QImage::Format_RGBA8888);
+				TextureChain chain;
+				buildMipChain(image.constBits(), image.width(), image.height(), image.bytesPerLine(), chain);
+				return chain;
+			}();
+
+			QOpenGLTexture *pTexture = new QOpenGLTexture(QOpenGLTexture::Target2D);
+			pTexture->create();
+			uploadChain(pTexture->textureId(), placeholder);
 			ManagedGLTexture texture(pTexture);
-			texture.pTexture->bind();
+			texture.bytes = placeholder.byteSize();
+			texture.lastUse = ++m_textureClock;
 
-			m_textures.insert(fileName, texture);
+			texIt = m_textures.insert(fileName, texture);
+			m_textureBytes += static_cast<qint64>(texture.bytes);
+			++m_textureStats.misses;
+			queueDecode(fileName, texIt.value());
 
 			textureUpdater.addPath(fileName);
 
-			if (m_textures.size() > 2)
-			{
-				// Remove some old textures now
-				texIt = m_textures.begin();
-				while (texIt != m_textures.end())
-				{
-					if (texIt->users <= 0)
-					{
-						_deleteTexture(texIt);
-						texIt = m_textures.begin();
-					}
-					else
-					{
-						++texIt;
-					}
-				}
-			}
+			// Make room, the new texture is in use and stays
+			evictTextures();
 
 			return std::move(texture);
 		}
 		else
 		{
+			// Possibly released and kept resident since
 			texIt.value().users++;
+			texIt.value().lastUse = ++m_textureClock;
+			++m_textureStats.hits;
 			return texIt.value();
 		}
 	}
@@ -554,9 +1005,11 @@ void QtGLView::deleteTexture(GLuint id)
 		if (texIt->id() == id)
 		{
 			texIt->users = std::max(texIt->users - 1, 0);
-			if ( m_textures.size() > 2 && texIt->users == 0)
+			if (texIt->users == 0)
 			{
-				_deleteTexture(texIt);
+				// Stays resident for a reopen until the budget is exceeded
+				texIt->lastUse = ++m_textureClock;
+				evictTextures();
 			}
 			break;
 		}
@@ -571,9 +1024,10 @@ void QtGLView::deleteTexture(const QString& fileName)
 	if (texIt != m_textures.end())
 	{
 		texIt->users = std::max(texIt->users - 1, 0);
-		if (m_textures.size() > 2 && texIt->users == 0)
+		if (texIt->users == 0)
 		{
-			_deleteTexture(texIt);
+			texIt->lastUse = ++m_textureClock;
+			evictTextures();
 		}
 	}
 }
@@ -657,10 +1111,15 @@ static bool readShaderSource(const QString& fileName, QString& out, QString* err
 bool QtGLView::loadShader(int type, const QString& fileNameVert, const QString& fileNameFrag,
                           QString* errString)
 {
+	// Shaders are compiled on first use and in idle time, not only in initializeGL()
+	ScopedGLContext ctxGuard(this);
+
 	if (QOpenGLShaderProgram::hasOpenGLShaderPrograms(context()))
 	{
 		QOpenGLShaderProgram* shader = getShader(type);
+		const bool reload = shader != nullptr;
 		bool ok_flag = true;
+		bool linked = false;
 
 		if (shader != nullptr)
 		{
@@ -672,7 +1131,7 @@ bool QtGLView::loadShader(int type, const QString& fileNameVert, const QString&
 			shader = new QOpenGLShaderProgram(this);
 		}
 
-		QString vertSrc, fragSrc, readErr;
+		QString vertSrc, fragSrc, readErr, binaryPath;
 
 		if (!readShaderSource(fileNameVert, vertSrc, &readErr))
 		{
@@ -686,31 +1145,66 @@ bool QtGLView::loadShader(int type, const QString& fileNameVert, const QString&
 				*errString = QString("QtGLView::loadShader - %1").arg(readErr);
 			ok_flag = false;
 		}
-		else if (!shader->addShaderFromSourceCode(QOpenGLShader::Vertex, vertSrc))
-		{
-			if (errString)
-				*errString = QString("QtGLView::loadShader - Error loading vertex shader:\n%1").arg(shader->log());
-			ok_flag = false;
-		}
-		else if (!shader->addShaderFromSourceCode(QOpenGLShader::Fragment, fragSrc))
+
+		if (ok_flag)
 		{
-			if (errString)
-				*errString = QString("QtGLView::loadShader - Error loading fragment shader:\n%1").arg(shader->log());
-			ok_flag = false;
+			binaryPath = programBinaryPath(type, vertSrc, fragSrc);
+
+			if (reload && !fileNameFrag.startsWith(":"))
+			{
+				// Someone is working on their own shaders, always build those from source
+				const QString previous = m_programBinaries.value(type);
+				if (!previous.isEmpty())
+					QFile::remove(previous);
+				if (!binaryPath.isEmpty())
+					QFile::remove(binaryPath);
+			}
+			else
+			{
+				linked = loadProgramBinary(shader, binaryPath);
+			}
 		}
-		else if (!shader->link())
+
+		if (ok_flag && !linked)
 		{
-			if (errString)
-				*errString = QString("QtGLView::loadShader - Error linking shaders:\n%1").arg(shader->log());
-			ok_flag = false;
+			if (!binaryPath.isEmpty())
+			{
+				context()->extraFunctions()->glProgramParameteri(shader->programId(),
+										 GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			}
+
+			if (!shader->addShaderFromSourceCode(QOpenGLShader::Vertex, vertSrc))
+			{
+				if (errString)
+					*errString = QString("QtGLView::loadShader - Error loading vertex shader:\n%1").arg(shader->log());
+				ok_flag = false;
+			}
+			else if (!shader->addShaderFromSourceCode(QOpenGLShader::Fragment, fragSrc))
+			{
+				if (errString)
+					*errString = QString("QtGLView::loadShader - Error loading fragment shader:\n%1").arg(shader->log());
+				ok_flag = false;
+			}
+			else if (!shader->link())
+			{
+				if (errString)
+					*errString = QString("QtGLView::loadShader - Error linking shaders:\n%1").arg(shader->log());
+				ok_flag = false;
+			}
+			else
+			{
+				saveProgramBinary(shader, binaryPath);
+			}
 		}
 
 		if (!ok_flag)
 			shader = nullptr;
+		m_programBinaries[type] = ok_flag ? binaryPath : QString();
 
 		auto& sinfo = m_shaders[type];
 		sinfo.program = shader;
 		sinfo.is_external = ok_flag && !fileNameFrag.startsWith(":");
+		++sinfo.revision;
 
 		return ok_flag;
 	}
@@ -718,8 +1212,128 @@ bool QtGLView::loadShader(int type, const QString& fileNameVert, const QString&
 	return false;
 }
 
+QString QtGLView::programBinaryPath(int type, const QString& vertSrc, const QString& fragSrc) const
+{
+	if (!m_canCacheProgramBinaries || m_cacheDir.isEmpty())
+		return QString();
+
+	// A binary is only good for the driver that produced it
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(QByteArray::number(type));
+	for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION})
+	{
+		const GLubyte *str = glGetString(name);
+		hash.addData(QByteArray(1, '\0'));
+		if (str)
+			hash.addData(reinterpret_cast<const char*>(str));
+	}
+	hash.addData(QByteArray(1, '\0'));
+	hash.addData(vertSrc.toUtf8());
+	hash.addData(QByteArray(1, '\0'));
+	hash.addData(fragSrc.toUtf8());
+
+	return m_cacheDir + "/" + QString::fromLatin1(hash.result().toHex()) + WMIT_PROGRAM_BINARY_EXT;
+}
+
+namespace {
+
+const char PROGRAM_BINARY_MAGIC[8] = {'W', 'M', 'I', 'T', 'P', 'R', 'O', 'G'};
+const quint32 PROGRAM_BINARY_VERSION = 1;
+
+struct ProgramBinaryHeader
+{
+	char magic[8];
+	quint32 version;
+	quint32 format;	// as returned by glGetProgramBinary
+	quint32 length;
+};
+
+} // anonymous namespace
+
+bool QtGLView::loadProgramBinary(QOpenGLShaderProgram* shader, const QString& path)
+{
+	if (path.isEmpty())
+		return false;
+
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	const QByteArray data = file.readAll();
+	file.close();
+
+	ProgramBinaryHeader header;
+	if (static_cast<size_t>(data.size()) < sizeof(header))
+		return false;
+	memcpy(&header, data.constData(), sizeof(header));
+
+	if (memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(PROGRAM_BINARY_MAGIC)) != 0 ||
+	    header.version != PROGRAM_BINARY_VERSION ||
+	    header.length != static_cast<size_t>(data.size()) - sizeof(header))
+	{
+		QFile::remove(path);
+		return false;
+	}
+
+	QOpenGLExtraFunctions *gl = context()->extraFunctions();
+	const GLuint program = shader->programId();
+	GLint status = 0;
+
+	gl->glProgramBinary(program, header.format, data.constData() + sizeof(header),
+			    static_cast<GLsizei>(header.length));
+	gl->glGetProgramiv(program, GL_LINK_STATUS, &status);
+
+	// Drivers reject binaries of other driver builds, compiling from source replaces the entry
+	if (status == 0)
+	{
+		QFile::remove(path);
+		return false;
+	}
+
+	touchCacheEntry(path);
+
+	// Without attached shaders link() only picks up the link status
+	return shader->link();
+}
+
+void QtGLView::saveProgramBinary(QOpenGLShaderProgram* shader, const QString& path)
+{
+	if (path.isEmpty() || !QDir().mkpath(m_cacheDir))
+		return;
+
+	QOpenGLExtraFunctions *gl = context()->extraFunctions();
+	const GLuint program = shader->programId();
+	GLint length = 0;
+
+	gl->glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	ProgramBinaryHeader header;
+	memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(PROGRAM_BINARY_MAGIC));
+	header.version = PROGRAM_BINARY_VERSION;
+
+	QByteArray data(static_cast<int>(sizeof(header)) + length, '\0');
+	GLsizei written = 0;
+	GLenum format = 0;
+	gl->glGetProgramBinary(program, length, &written, &format, data.data() + sizeof(header));
+	if (written <= 0)
+		return;
+
+	header.format = format;
+	header.length = static_cast<quint32>(written);
+	memcpy(data.data(), &header, sizeof(header));
+	data.resize(static_cast<int>(sizeof(header)) + written);
+
+	QSaveFile file(path);
+	if (file.open(QIODevice::WriteOnly) && file.write(data) == data.size() && file.commit())
+		pruneCacheDirectory(m_cacheDir, viewCacheFilters(), WMIT_TEXTURE_CACHE_MAX_BYTES, data.size());
+}
+
 void QtGLView::unloadShader(int type)
 {
+	ScopedGLContext ctxGuard(this);
+
 	if (QOpenGLShaderProgram::hasOpenGLShaderPrograms(context()))
 	{
 		QOpenGLShaderProgram* shader = getShader(type);
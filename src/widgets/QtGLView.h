@@ -27,7 +27,10 @@
 #include <QList>
 #include <QHash>
 #include <QBasicTimer>
+#include <QElapsedTimer>
 #include <QFileSystemWatcher>
+#include <QImage>
+#include <QThreadPool>
 
 #include <QGLViewer/qglviewer.h>
 #include <QGLViewer/manipulatedFrame.h>
@@ -35,13 +38,17 @@
 #include "GLTexture.h"
 #include "IGLTextureManager.h"
 #include "IGLShaderManager.h"
+#include "TextureCache.h"
+#include "FrameTimings.h"
 
 class IGLRenderable;
 class IAnimatable;
 class ITexturedRenderable;
 class ITCMaskRenderable;
+class QLabel;
 class QOpenGLShaderProgram;
 class QOpenGLTexture;
+class QOpenGLTimerQuery;
 
 class QtGLView : public QGLViewer, public IGLTextureManager, public IGLShaderManager
 {
@@ -70,16 +77,41 @@ public:
 	virtual void deleteTexture(const QString& fileName);
 	virtual void deleteAllTextures();
 
+	struct TextureCacheStats
+	{
+		quint64 hits;		// createTexture() found the texture resident
+		quint64 misses;		// createTexture() had to create and decode it
+		quint64 evictions;	// released textures dropped to stay within the budget
+		qint64 residentBytes;	// uploaded levels of all resident textures
+		int residentTextures;
+	};
+	TextureCacheStats textureCacheStats() const;
+
+	// Released textures stay resident, the least recently used ones are
+	// dropped once all textures together take more than bytes
+	void setTextureBudget(qint64 bytes);
+	qint64 textureBudget() const {return m_textureBudget;}
+
 	/// IGLShaderManager component
     virtual bool loadShader(int type, const QString& fileNameVert, const QString& fileNameFrag,
                             QString *errString);
 	virtual void unloadShader(int type);
 
 	void setLightColors();
+
+	// Startup timing log: prints the time since the first call, which main() makes
+	// right after creating the QApplication
+	static void logStartupTime(const char* milestone);
+
 public slots:
 	void setDrawLightSource(bool draw);
 	void setLinkLightToCamera(bool link);
 	void setAnimateState(bool enabled);
+	// S3TC textures when the driver supports them, reloads every texture
+	void setTextureCompression(bool enabled);
+	// Stage times and mesh counts in a corner of the viewport, also logged
+	// once per window of frames
+	void setFrameTimingsShown(bool shown);
 
 protected:
 	void init();
@@ -91,6 +123,9 @@ protected:
 		QOpenGLTexture *pTexture;
 		int users;
 		bool update;
+		uint decode; // latest decode request, older results are dropped
+		size_t bytes; // of the uploaded levels
+		quint64 lastUse; // m_textureClock when last handed out or released
 		ManagedGLTexture(QOpenGLTexture *pInputTexture);
 
 		virtual ~ManagedGLTexture(){}
@@ -107,6 +142,24 @@ private:
 
 	void updateTextures();
 	void _deleteTexture(t_texIt& texIt);
+	void evictTextures();
+
+	qint64 m_textureBudget;
+	qint64 m_textureBytes;
+	quint64 m_textureClock;
+	TextureCacheStats m_textureStats;
+
+	// Images are decoded on the pool and uploaded when they arrive in textureDecoded()
+	void queueDecode(const QString& fileName, ManagedGLTexture& texture);
+	void uploadChain(GLuint id, const TextureChain& chain);
+	void reloadAllTextures();
+
+	QThreadPool m_decodePool;
+	uint m_lastDecode;
+	QString m_cacheDir; // mip chains and program binaries, empty when there is no cache
+	bool m_compressTextures;
+	bool m_canCompressTextures; // GL_EXT_texture_compression_s3tc
+	GLfloat m_maxAnisotropy; // 0 without GL_EXT_texture_filter_anisotropic
 
 	QFileSystemWatcher textureUpdater;
 	QBasicTimer updateTimer;
@@ -116,8 +169,39 @@ private:
 
 	void dynamicManagedSetup(IGLRenderable* object, bool remove = false);
 
+	// Linked program binaries below m_cacheDir, so a restart skips compiling the shaders
+	QString programBinaryPath(int type, const QString& vertSrc, const QString& fragSrc) const;
+	bool loadProgramBinary(QOpenGLShaderProgram* shader, const QString& path);
+	void saveProgramBinary(QOpenGLShaderProgram* shader, const QString& path);
+
+	bool m_canCacheProgramBinaries; // GL_ARB_get_program_binary with at least one format
+	bool m_drewFirstFrame;
+	QHash<int, QString> m_programBinaries; // entry of the program loaded per shader type
+
+	// Frame timings, collected only while they are shown
+	void beginFrameTiming();
+	void endFrameTiming();
+	QString frameTimingsReport() const;
+
+	FrameTimings m_frameTimings;
+	bool m_showFrameTimings;
+	QLabel* m_frameTimingsLabel;
+	QElapsedTimer m_frameTimingsRefresh;
+	QElapsedTimer m_frameStart;
+
+	// GL_TIME_ELAPSED queries, a few frames in flight so reading them never stalls
+	static const int TIMER_QUERIES = 4;
+	QOpenGLTimerQuery* m_timerQueries[TIMER_QUERIES];
+	bool m_timerQueryPending[TIMER_QUERIES];
+	int m_timerQueryNext;
+	int m_timerQueryActive; // begun in this frame, -1 for none
+	bool m_triedTimerQueries;
+
 private slots:
 	void textureChanged(const QString& fileName);
+	void textureDecoded(const QString& fileName, uint decode, const TextureChain& chain);
 };
 
+Q_DECLARE_METATYPE(TextureChain)
+
 #endif // QTGLVIEW_HPP
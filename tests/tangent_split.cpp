@@ -0,0 +1,187 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Tangent space split test.
+
+  Runs generateTangentSpace() on large meshes made of many islands with one
+  thread and with several, and checks that they are split and that every
+  thread count gives the same tangents to the bit. One mesh ends in a fan of
+  triangles around a shared edge, which MikkTSpace pairs in the unsorted
+  order of its last edge run. A small mesh must be done in a single pass.
+  */
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "TangentSpace.h"
+
+struct TestMesh
+{
+	std::vector<WZMVertex> positions;
+	std::vector<WZMVertex> normals;
+	std::vector<WZMUV> uvs;
+	std::vector<IndexedTri> triangles;
+
+	unsigned addVertex(float x, float y, float z, float u, float v)
+	{
+		positions.push_back(WZMVertex(x, y, z));
+		normals.push_back(WZMVertex(0.f, 0.f, 1.f));
+		WZMUV uv;
+		uv.u() = u;
+		uv.v() = v;
+		uvs.push_back(uv);
+		return static_cast<unsigned>(positions.size() - 1);
+	}
+
+	void addTriangle(unsigned a, unsigned b, unsigned c)
+	{
+		IndexedTri tri;
+		tri.a() = a;
+		tri.b() = b;
+		tri.c() = c;
+		triangles.push_back(tri);
+	}
+
+	TangentSpaceInput input() const
+	{
+		TangentSpaceInput in = {positions.data(), normals.data(), uvs.data(), positions.size(),
+					triangles.data(), triangles.size()};
+		return in;
+	}
+};
+
+// A bumpy grid of size x size quads with a UV seam in the middle, so that
+// islands have both welded and split corners
+static void addGridIsland(TestMesh& mesh, unsigned island, unsigned size)
+{
+	const float originX = static_cast<float>(island % 16) * (size + 2);
+	const float originY = static_cast<float>(island / 16) * (size + 2);
+	const unsigned seam = size / 2;
+
+	std::vector<unsigned> left((size + 1) * (size + 1)), right((size + 1) * (size + 1));
+	for (unsigned y = 0; y <= size; ++y)
+	{
+		for (unsigned x = 0; x <= size; ++x)
+		{
+			const float z = static_cast<float>((x * 7 + y * 13 + island * 5) % 11) * 0.1f;
+			const float u = static_cast<float>(x) / size, v = static_cast<float>(y) / size;
+			const unsigned i = y * (size + 1) + x;
+			left[i] = mesh.addVertex(originX + x, originY + y, z, u, v);
+			right[i] = x == seam ? mesh.addVertex(originX + x, originY + y, z, u + 0.5f, v) : left[i];
+		}
+	}
+
+	for (unsigned y = 0; y < size; ++y)
+	{
+		for (unsigned x = 0; x < size; ++x)
+		{
+			const std::vector<unsigned>& grid = x < seam ? left : right;
+			const unsigned i = y * (size + 1) + x;
+			mesh.addTriangle(grid[i], grid[i + 1], grid[i + size + 2]);
+			mesh.addTriangle(grid[i], grid[i + size + 2], grid[i + size + 1]);
+		}
+	}
+}
+
+// Triangles around the edge between two new vertices, after a strip that
+// brings in their other corners. The edge is then the last one MikkTSpace
+// sorts. Every third triangle is wound the other way, with its UVs on the
+// other side of the edge too, so any two of different winding make a
+// smooth pair and which ones pair up depends on the order of that run.
+static void addEdgeFan(TestMesh& mesh, unsigned triangles)
+{
+	std::vector<unsigned> tips;
+	for (unsigned i = 0; i < triangles; ++i)
+	{
+		const float x = static_cast<float>(i % 2) - 4.f;
+		const float u = (i % 3 == 0 ? 0.1f : -0.1f) * (i + 1);
+		tips.push_back(mesh.addVertex(x, static_cast<float>(i), 1.f + i, u, 1.f));
+	}
+	for (unsigned i = 0; i + 2 < triangles; ++i)
+	{
+		mesh.addTriangle(tips[i], tips[i + 1], tips[i + 2]);
+	}
+
+	const unsigned a = mesh.addVertex(-6.f, 0.f, 0.f, 0.f, 0.f);
+	const unsigned b = mesh.addVertex(-6.f, 8.f, 0.f, 0.f, 0.5f);
+	for (unsigned i = 0; i < triangles; ++i)
+	{
+		if (i % 3 == 0)
+			mesh.addTriangle(tips[i], a, b);
+		else
+			mesh.addTriangle(tips[i], b, a);
+	}
+}
+
+static bool checkMesh(const char* name, const TestMesh& mesh, TangentSpacePasses expected)
+{
+	const TangentSpaceInput in = mesh.input();
+	std::vector<WZMVertex4> first;
+
+	for (unsigned threads : {1, 2, 4, 8})
+	{
+		std::vector<WZMVertex4> tangents(in.vertices);
+		TangentSpacePasses passes;
+		if (!generateTangentSpace(in, tangents.data(), threads, nullptr, &passes))
+		{
+			printf("%s: %u threads failed\n", name, threads);
+			return false;
+		}
+		if (passes != expected)
+		{
+			printf("%s: %u threads took pass mode %d, expected %d\n", name, threads, passes, expected);
+			return false;
+		}
+		if (first.empty())
+		{
+			first.swap(tangents);
+		}
+		else if (memcmp(first.data(), tangents.data(), in.vertices * sizeof(WZMVertex4)) != 0)
+		{
+			printf("%s: %u threads differ from one thread\n", name, threads);
+			return false;
+		}
+	}
+
+	printf("%s: %zu triangles, same tangents on every thread count\n", name, in.triangleCount);
+	return true;
+}
+
+int main()
+{
+	// 96 islands of 512 triangles, well above the size that gets split
+	TestMesh islands;
+	for (unsigned i = 0; i < 96; ++i)
+	{
+		addGridIsland(islands, i, 16);
+	}
+
+	TestMesh fan = islands;
+	addEdgeFan(fan, 6);
+
+	TestMesh small;
+	addGridIsland(small, 0, 16);
+
+	bool ok = checkMesh("islands", islands, TANGENTS_SPLIT);
+	ok = checkMesh("islands with an edge fan", fan, TANGENTS_SPLIT) && ok;
+	ok = checkMesh("small mesh", small, TANGENTS_SINGLE_PASS) && ok;
+	return ok ? 0 : 1;
+}
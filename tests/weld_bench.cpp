@@ -0,0 +1,205 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Vertex welding benchmark.
+
+  Welds the corners of a jittered grid mesh with UV seams using the hash
+  grid VertexWelder and the previous std::set based approach, and prints
+  the time per corner for 1k to 1M corners. With --verify it only checks
+  that both produce the same vertex indices (used as a test).
+  */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <random>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include <GL/glew.h>
+#include "VectorTypes.h"
+#include "VertexWelder.h"
+
+typedef Vertex<GLfloat> WZMVertex;
+typedef UV<GLclampf> WZMUV;
+typedef std::tuple<WZMVertex, WZMUV, WZMVertex> WZMPoint;
+
+// The comparator Mesh used for welding before VertexWelder
+struct compareWZMPoint_less_wEps
+{
+	const WZMVertex::less_wEps vertLess;
+	const WZMUV::less_wEps uvLess;
+	const WZMVertex::equal_wEps vertEq;
+	const WZMUV::equal_wEps uvEq;
+
+	compareWZMPoint_less_wEps(float vertEps = 0.0001f, float uvEps = 0.0001f):
+		vertLess(vertEps), uvLess(uvEps), vertEq(vertEps), uvEq(uvEps) {}
+
+	bool operator() (const WZMPoint& lhs, const WZMPoint& rhs) const
+	{
+		if (vertLess(std::get<0>(lhs), std::get<0>(rhs)))
+			return true;
+		if (vertEq(std::get<0>(lhs), std::get<0>(rhs)))
+		{
+			if (uvLess(std::get<1>(lhs), std::get<1>(rhs)))
+				return true;
+			if (uvEq(std::get<1>(lhs), std::get<1>(rhs)))
+				return vertLess(std::get<2>(lhs), std::get<2>(rhs));
+		}
+		return false;
+	}
+};
+
+// Corners of a grid of quads with a UV seam every 8th column, so that some
+// positions must stay split. UVs and normals are jittered well below the
+// welding epsilon every time a grid point is referenced. Positions are not:
+// jittered positions break the strict weak ordering std::set relies on,
+// and the old welding would then miss some of the matches.
+static std::vector<WZMPoint> makeCorners(size_t corners)
+{
+	std::vector<WZMPoint> result;
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> jitter(-0.00003f, 0.00003f);
+
+	const size_t quads = std::max<size_t>(1, corners / 6);
+	const size_t side = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(quads))));
+
+	auto corner = [&](size_t x, size_t y, bool seam)
+	{
+		WZMVertex pos(x * 0.25f, std::sin(x * 0.1f) * std::cos(y * 0.1f), y * 0.25f);
+		WZMUV uv;
+		uv.u() = (seam ? 1.f : (x % 8) / 8.f) + jitter(rng);
+		uv.v() = (y % 64) / 64.f + jitter(rng);
+		WZMVertex nrm(jitter(rng), 1.f + jitter(rng), jitter(rng));
+		result.emplace_back(pos, uv, nrm);
+	};
+
+	result.reserve(corners);
+	for (size_t q = 0; result.size() < corners; ++q)
+	{
+		const size_t x = q % side, y = q / side;
+		const bool seam = (x + 1) % 8 == 0;
+
+		corner(x, y, false);
+		corner(x + 1, y, seam);
+		corner(x + 1, y + 1, seam);
+		corner(x, y, false);
+		corner(x + 1, y + 1, seam);
+		corner(x, y + 1, false);
+	}
+	result.resize(corners);
+	return result;
+}
+
+static std::vector<unsigned> weldWithHashGrid(const std::vector<WZMPoint>& corners)
+{
+	VertexWelder<WZMVertex, WZMUV> welder;
+	std::vector<unsigned> indices;
+	bool inserted;
+
+	welder.reserve(corners.size() / 4);
+	indices.reserve(corners.size());
+	for (const WZMPoint& p : corners)
+	{
+		indices.push_back(welder.insert(std::get<0>(p), std::get<1>(p), std::get<2>(p), inserted));
+	}
+	return indices;
+}
+
+static std::vector<unsigned> weldWithSet(const std::vector<WZMPoint>& corners)
+{
+	typedef std::set<WZMPoint, compareWZMPoint_less_wEps> t_tupleSet;
+	t_tupleSet tupleSet;
+	std::vector<unsigned> mapping;
+	std::vector<unsigned> indices;
+	unsigned points = 0;
+
+	indices.reserve(corners.size());
+	for (const WZMPoint& p : corners)
+	{
+		auto inResult = tupleSet.insert(p);
+		auto dist = std::distance(tupleSet.begin(), inResult.first);
+
+		if (!inResult.second)
+		{
+			indices.push_back(mapping[dist]);
+		}
+		else
+		{
+			mapping.insert(mapping.begin() + dist, points);
+			indices.push_back(points++);
+		}
+	}
+	return indices;
+}
+
+template <typename F>
+static double timeMs(F func)
+{
+	const auto start = std::chrono::steady_clock::now();
+	func();
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+	const bool verify = argc > 1 && strcmp(argv[1], "--verify") == 0;
+
+	if (verify)
+	{
+		for (size_t corners : {1000, 6000, 30000})
+		{
+			const std::vector<WZMPoint> data = makeCorners(corners);
+			if (weldWithHashGrid(data) != weldWithSet(data))
+			{
+				printf("Mismatch between hash grid and std::set welding for %zu corners\n", corners);
+				return 1;
+			}
+		}
+		printf("Hash grid welding matches std::set welding\n");
+		return 0;
+	}
+
+	printf("%10s %10s %14s %14s %14s\n", "corners", "points", "hash ms", "hash ns/corner", "set ms");
+	for (size_t corners : {1000, 10000, 100000, 1000000})
+	{
+		const std::vector<WZMPoint> data = makeCorners(corners);
+		std::vector<unsigned> indices;
+
+		const double hashMs = timeMs([&]() {indices = weldWithHashGrid(data);});
+		const unsigned points = indices.empty() ? 0 : *std::max_element(indices.begin(), indices.end()) + 1;
+
+		// The std::set version is quadratic, don't wait for it on big inputs
+		if (corners <= 100000)
+		{
+			const double setMs = timeMs([&]() {weldWithSet(data);});
+			printf("%10zu %10u %14.3f %14.1f %14.3f\n", corners, points, hashMs, hashMs * 1e6 / corners, setMs);
+		}
+		else
+		{
+			printf("%10zu %10u %14.3f %14.1f %14s\n", corners, points, hashMs, hashMs * 1e6 / corners, "-");
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,603 @@
+/*
+	Copyright 2010 Warzone 2100 Project
+
+	This file is part of WMIT.
+
+	WMIT is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	WMIT is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with WMIT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Model pipeline benchmark.
+
+  Generates deterministic grid, sphere and random triangle soup models of
+  1k to 1M triangles, with and without UV seams and animation frames, and
+  times each stage of the import/export pipeline separately:
+
+    pie_read            APieModel::read
+    mesh_from_pie       Mesh::Mesh(const Pie3Level&)
+    recalculate_tb      Mesh::recalculateTB
+    recalculate_bounds  Mesh::recalculateBoundData
+    mesh_to_pie         Mesh::operator Pie3Level
+    obj_import          WZM::importFromOBJ
+    obj_export          WZM::exportToOBJ
+
+  Each stage reports the fastest of --reps runs, in milliseconds, as JSON.
+  A stage is skipped (reported as null) for bigger models once the smaller
+  sizes predict it would take longer than --budget seconds, so that
+  quadratic stages show up as such instead of stalling the run.
+  */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "Pie.h"
+#include "TextReader.h"
+#include "WZM.h"
+#include "wmit.h"
+
+namespace
+{
+
+enum class Shape { Grid, Sphere, Soup };
+
+const char* shapeName(Shape shape)
+{
+	switch (shape)
+	{
+	case Shape::Grid:
+		return "grid";
+	case Shape::Sphere:
+		return "sphere";
+	default:
+		return "soup";
+	}
+}
+
+struct ModelSpec
+{
+	Shape shape;
+	size_t triangles;
+	bool seams;
+	unsigned frames;
+};
+
+struct Corner
+{
+	unsigned point;
+	float u, v;
+	float nx, ny, nz;
+};
+
+// Format independent model the PIE and OBJ texts are both written from
+struct SyntheticModel
+{
+	std::vector<float> points; // xyz
+	std::vector<Corner> corners; // 3 per triangle
+	unsigned frames;
+};
+
+// u within a strip of 8 columns when seams are wanted, so every 8th column
+// references the same points with a different u
+float columnU(size_t col, size_t quadCol, size_t columns, bool seams)
+{
+	if (!seams)
+		return static_cast<float>(col) / columns;
+	return static_cast<float>(quadCol % 8 + (col - quadCol)) / 8.f;
+}
+
+void addQuad(SyntheticModel& model, const Corner& c00, const Corner& c10, const Corner& c11, const Corner& c01,
+	     size_t maxCorners)
+{
+	for (const Corner* c : {&c00, &c10, &c11, &c00, &c11, &c01})
+	{
+		if (model.corners.size() == maxCorners)
+			return;
+		model.corners.push_back(*c);
+	}
+}
+
+void makeGrid(SyntheticModel& model, const ModelSpec& spec)
+{
+	const size_t side = static_cast<size_t>(std::ceil(std::sqrt(spec.triangles / 2.0)));
+	const float step = 0.25f;
+
+	auto height = [](size_t x, size_t y) {return std::sin(x * 0.1f) * std::cos(y * 0.1f);};
+
+	for (size_t y = 0; y <= side; ++y)
+	{
+		for (size_t x = 0; x <= side; ++x)
+		{
+			model.points.insert(model.points.end(), {x * step, height(x, y), y * step});
+		}
+	}
+
+	auto corner = [&](size_t x, size_t y, size_t qx)
+	{
+		// Analytic normal of the height field
+		const float dx = 0.1f * std::cos(x * 0.1f) * std::cos(y * 0.1f) / step;
+		const float dz = -0.1f * std::sin(x * 0.1f) * std::sin(y * 0.1f) / step;
+		const float len = std::sqrt(dx * dx + 1.f + dz * dz);
+		return Corner{static_cast<unsigned>(y * (side + 1) + x),
+			      columnU(x, qx, side, spec.seams), static_cast<float>(y) / side,
+			      -dx / len, 1.f / len, -dz / len};
+	};
+
+	const size_t maxCorners = spec.triangles * 3;
+	for (size_t q = 0; model.corners.size() < maxCorners; ++q)
+	{
+		const size_t x = q % side, y = q / side;
+		addQuad(model, corner(x, y, x), corner(x + 1, y, x), corner(x + 1, y + 1, x), corner(x, y + 1, x), maxCorners);
+	}
+}
+
+void makeSphere(SyntheticModel& model, const ModelSpec& spec)
+{
+	// Twice as many segments as rings, 2 triangles per cell
+	const size_t rings = std::max<size_t>(2, static_cast<size_t>(std::ceil(std::sqrt(spec.triangles / 4.0))));
+	const size_t segments = rings * 2;
+	const float radius = 50.f;
+	const float pi = 3.14159265358979f;
+
+	for (size_t r = 0; r <= rings; ++r)
+	{
+		const float theta = pi * r / rings;
+		for (size_t s = 0; s <= segments; ++s)
+		{
+			const float phi = 2.f * pi * s / segments;
+			model.points.insert(model.points.end(), {radius * std::sin(theta) * std::cos(phi),
+								 radius * std::cos(theta),
+								 radius * std::sin(theta) * std::sin(phi)});
+		}
+	}
+
+	auto corner = [&](size_t s, size_t r, size_t qs)
+	{
+		const size_t idx = r * (segments + 1) + s;
+		return Corner{static_cast<unsigned>(idx),
+			      columnU(s, qs, segments, spec.seams), static_cast<float>(r) / rings,
+			      model.points[idx * 3] / radius, model.points[idx * 3 + 1] / radius,
+			      model.points[idx * 3 + 2] / radius};
+	};
+
+	const size_t maxCorners = spec.triangles * 3;
+	for (size_t q = 0; model.corners.size() < maxCorners; ++q)
+	{
+		const size_t s = q % segments, r = (q / segments) % rings;
+		addQuad(model, corner(s, r, s), corner(s, r + 1, s), corner(s + 1, r + 1, s), corner(s + 1, r, s), maxCorners);
+	}
+}
+
+void makeSoup(SyntheticModel& model, const ModelSpec& spec)
+{
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> pos(-100.f, 100.f), unit(0.f, 1.f), dir(-1.f, 1.f);
+
+	for (size_t i = 0; i < spec.triangles * 3; ++i)
+	{
+		model.points.insert(model.points.end(), {pos(rng), pos(rng), pos(rng)});
+
+		float nx = dir(rng), ny = dir(rng), nz = dir(rng);
+		const float len = std::max(std::sqrt(nx * nx + ny * ny + nz * nz), 0.001f);
+		model.corners.push_back({static_cast<unsigned>(i), unit(rng), unit(rng), nx / len, ny / len, nz / len});
+	}
+}
+
+SyntheticModel makeModel(const ModelSpec& spec)
+{
+	SyntheticModel model;
+
+	model.frames = spec.frames;
+	model.corners.reserve(spec.triangles * 3);
+	switch (spec.shape)
+	{
+	case Shape::Grid:
+		makeGrid(model, spec);
+		break;
+	case Shape::Sphere:
+		makeSphere(model, spec);
+		break;
+	case Shape::Soup:
+		makeSoup(model, spec);
+		break;
+	}
+	return model;
+}
+
+std::string writePie(const SyntheticModel& model)
+{
+	std::ostringstream out;
+	const size_t tris = model.corners.size() / 3;
+
+	out << "PIE 3\nTYPE 200\nTEXTURE 0 page-7-barbarians-arizona.png 0 0\nLEVELS 1\nLEVEL 1\n";
+
+	out << "POINTS " << model.points.size() / 3 << '\n';
+	for (size_t i = 0; i < model.points.size(); i += 3)
+	{
+		out << '\t' << model.points[i] << ' ' << model.points[i + 1] << ' ' << model.points[i + 2] << '\n';
+	}
+
+	out << "NORMALS " << tris << '\n';
+	for (size_t t = 0; t < tris; ++t)
+	{
+		out << '\t';
+		for (size_t i = 0; i < 3; ++i)
+		{
+			const Corner& c = model.corners[t * 3 + i];
+			out << c.nx << ' ' << c.ny << ' ' << c.nz << (i < 2 ? ' ' : '\n');
+		}
+	}
+
+	out << "POLYGONS " << tris << '\n';
+	for (size_t t = 0; t < tris; ++t)
+	{
+		const Corner* c = &model.corners[t * 3];
+		out << "\t200 3 " << c[0].point << ' ' << c[1].point << ' ' << c[2].point;
+		for (size_t i = 0; i < 3; ++i)
+		{
+			out << ' ' << c[i].u << ' ' << c[i].v;
+		}
+		out << '\n';
+	}
+
+	if (model.frames > 0)
+	{
+		out << "ANIMOBJECT 80 0 " << model.frames << '\n';
+		for (int f = 0; f < static_cast<int>(model.frames); ++f)
+		{
+			out << '\t' << f << ' ' << f * 10 << ' ' << f * -5 << " 0  " << f * 100 << " 0 0  1 1 1\n";
+		}
+	}
+
+	return out.str();
+}
+
+std::string writeObj(const SyntheticModel& model)
+{
+	std::ostringstream out;
+
+	out << "o bench\n";
+	for (size_t i = 0; i < model.points.size(); i += 3)
+	{
+		out << "v " << model.points[i] << ' ' << model.points[i + 1] << ' ' << model.points[i + 2] << '\n';
+	}
+
+	// One vt/vn per corner, the importer has to weld them back together
+	for (const Corner& c : model.corners)
+	{
+		out << "vt " << c.u << ' ' << 1.f - c.v << '\n';
+	}
+	for (const Corner& c : model.corners)
+	{
+		out << "vn " << c.nx << ' ' << c.ny << ' ' << c.nz << '\n';
+	}
+
+	for (size_t i = 0; i < model.corners.size(); i += 3)
+	{
+		out << 'f';
+		for (size_t j = i; j < i + 3; ++j)
+		{
+			out << ' ' << model.corners[j].point + 1 << '/' << j + 1 << '/' << j + 1;
+		}
+		out << '\n';
+	}
+
+	return out.str();
+}
+
+// Gives access to the parsed level and to the protected bound data update
+class BenchPie3Model : public Pie3Model
+{
+public:
+	const Pie3Level& level(size_t i) const {return m_levels[i];}
+};
+
+class BenchMesh : public Mesh
+{
+public:
+	BenchMesh(const Pie3Level& p3): Mesh(p3) {}
+	using Mesh::recalculateBoundData;
+};
+
+struct Options
+{
+	unsigned reps = 3;
+	size_t maxTriangles = 1000000;
+	double budgetSeconds = 10.;
+	std::vector<Shape> shapes = {Shape::Grid, Shape::Sphere, Shape::Soup};
+	const char* jsonFile = nullptr;
+};
+
+const char* const STAGES[] = {"pie_read", "mesh_from_pie", "recalculate_tb", "recalculate_bounds",
+			      "mesh_to_pie", "obj_import", "obj_export"};
+
+typedef std::map<std::string, double> StageTimes; // ms, < 0 for skipped
+
+struct Result
+{
+	ModelSpec spec;
+	size_t piePoints;
+	size_t meshVertices;
+	StageTimes times;
+};
+
+/*
+  Fastest of up to reps runs of run(); setup() is not timed. Stops repeating
+  once a second was spent, so big models are only run once.
+  */
+double timeStage(unsigned reps, const std::function<void()>& setup, const std::function<void()>& run)
+{
+	double best = -1., total = 0.;
+
+	for (unsigned i = 0; i < reps && (i == 0 || total < 1000.); ++i)
+	{
+		setup();
+		const auto start = std::chrono::steady_clock::now();
+		run();
+		const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		best = best < 0. ? ms : std::min(best, ms);
+		total += ms;
+	}
+	return best;
+}
+
+bool runModel(const ModelSpec& spec, const Options& opts, const std::vector<Result>& smaller, Result& result)
+{
+	const SyntheticModel model = makeModel(spec);
+	const std::string pieText = writePie(model);
+	const std::string objText = writeObj(model);
+
+	result.spec = spec;
+	result.times.clear();
+
+	// Extrapolate from the smaller sizes with the growth seen between the last
+	// two of them (at least linear), so quadratic stages are caught early
+	auto wanted = [&](const char* stage)
+	{
+		if (smaller.empty())
+			return true;
+
+		const Result& last = smaller.back();
+		const double lastMs = last.times.at(stage);
+		if (lastMs < 0.)
+			return false;
+
+		double exponent = 1.;
+		if (smaller.size() > 1)
+		{
+			const Result& before = smaller[smaller.size() - 2];
+			const double beforeMs = before.times.at(stage);
+			// Sub-millisecond timings are too noisy to tell anything
+			if (beforeMs > 0.5)
+			{
+				exponent = std::log(lastMs / beforeMs) /
+					std::log(static_cast<double>(last.spec.triangles) / before.spec.triangles);
+				exponent = std::min(std::max(exponent, 1.), 3.);
+			}
+		}
+
+		const double predicted = lastMs * std::pow(static_cast<double>(spec.triangles) / last.spec.triangles, exponent);
+		return predicted <= opts.budgetSeconds * 1000.;
+	};
+
+	auto stage = [&](const char* name, const std::function<void()>& setup, const std::function<void()>& run)
+	{
+		result.times[name] = wanted(name) ? timeStage(opts.reps, setup, run) : -1.;
+	};
+
+	std::unique_ptr<BenchPie3Model> p3;
+	bool readOk = true;
+	auto readPie = [&]()
+	{
+		TextReader reader(pieText);
+		readOk = p3->read(reader);
+	};
+	stage("pie_read", [&]() {p3.reset(new BenchPie3Model());}, readPie);
+	if (result.times["pie_read"] < 0.)
+	{
+		p3.reset(new BenchPie3Model());
+		readPie();
+	}
+	if (!readOk)
+	{
+		std::cerr << "Failed to read the generated " << shapeName(spec.shape) << " model." << std::endl;
+		return false;
+	}
+	const Pie3Level& level = p3->level(0);
+	result.piePoints = level.points();
+
+	std::unique_ptr<BenchMesh> mesh;
+	stage("mesh_from_pie", [&]() {mesh.reset();}, [&]() {mesh.reset(new BenchMesh(level));});
+	if (!mesh)
+		mesh.reset(new BenchMesh(level));
+	result.meshVertices = mesh->vertices();
+
+	stage("recalculate_tb", []() {}, [&]() {mesh->recalculateTB();});
+	stage("recalculate_bounds", []() {}, [&]() {mesh->recalculateBoundData();});
+
+	std::unique_ptr<Pie3Level> back;
+	stage("mesh_to_pie", [&]() {back.reset();}, [&]() {back.reset(new Pie3Level(*mesh));});
+
+	std::unique_ptr<WZM> imported;
+	bool importOk = true;
+	stage("obj_import", [&]() {imported.reset(new WZM());},
+	      [&]() {TextReader reader(objText); importOk = imported->importFromOBJ(reader, true);});
+	imported.reset();
+	if (!importOk)
+	{
+		std::cerr << "Failed to import the generated " << shapeName(spec.shape) << " model from OBJ." << std::endl;
+		return false;
+	}
+
+	const WZM wzm(*p3);
+	std::unique_ptr<std::ostringstream> objOut;
+	stage("obj_export", [&]() {objOut.reset(new std::ostringstream());}, [&]() {wzm.exportToOBJ(*objOut);});
+
+	return true;
+}
+
+void writeJson(std::ostream& out, const Options& opts, const std::vector<Result>& results)
+{
+	out << "{\n";
+	out << "  \"wmit_version\": \"" << WMIT_VER_STR << "\",\n";
+	out << "  \"reps\": " << opts.reps << ",\n";
+	out << "  \"budget_seconds\": " << opts.budgetSeconds << ",\n";
+	out << "  \"results\": [";
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const Result& r = results[i];
+		out << (i ? "," : "") << "\n    {\"shape\": \"" << shapeName(r.spec.shape) << "\""
+		    << ", \"triangles\": " << r.spec.triangles
+		    << ", \"seams\": " << (r.spec.seams ? "true" : "false")
+		    << ", \"frames\": " << r.spec.frames
+		    << ", \"pie_points\": " << r.piePoints
+		    << ", \"mesh_vertices\": " << r.meshVertices
+		    << ",\n     \"ms\": {";
+		for (size_t s = 0; s < sizeof(STAGES) / sizeof(STAGES[0]); ++s)
+		{
+			const double ms = r.times.at(STAGES[s]);
+			out << (s ? ", " : "") << '"' << STAGES[s] << "\": ";
+			if (ms < 0.)
+				out << "null";
+			else
+				out << ms;
+		}
+		out << "}}";
+	}
+	out << "\n  ]\n}\n";
+}
+
+bool parseShapes(const char* arg, std::vector<Shape>& shapes)
+{
+	std::stringstream ss(arg);
+	std::string name;
+
+	shapes.clear();
+	while (std::getline(ss, name, ','))
+	{
+		if (name == "grid")
+			shapes.push_back(Shape::Grid);
+		else if (name == "sphere")
+			shapes.push_back(Shape::Sphere);
+		else if (name == "soup")
+			shapes.push_back(Shape::Soup);
+		else
+			return false;
+	}
+	return !shapes.empty();
+}
+
+void printHelp()
+{
+	printf("Usage: wmit_bench [options]\n");
+	printf("  --reps N         runs per stage, the fastest is reported (default 3)\n");
+	printf("  --max-tris N     largest model size, from 1000 to 1000000 (default 1000000)\n");
+	printf("  --budget S       skip stages predicted to take longer than S seconds (default 10)\n");
+	printf("  --shapes LIST    comma separated subset of grid,sphere,soup\n");
+	printf("  --json FILE      write the results to FILE instead of stdout\n");
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+	Options opts;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--reps") == 0 && hasValue)
+			opts.reps = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--max-tris") == 0 && hasValue)
+			opts.maxTriangles = static_cast<size_t>(atol(argv[++i]));
+		else if (strcmp(argv[i], "--budget") == 0 && hasValue)
+			opts.budgetSeconds = atof(argv[++i]);
+		else if (strcmp(argv[i], "--shapes") == 0 && hasValue)
+		{
+			if (!parseShapes(argv[++i], opts.shapes))
+			{
+				std::cerr << "Unknown shape in \"" << argv[i] << "\"." << std::endl;
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--json") == 0 && hasValue)
+			opts.jsonFile = argv[++i];
+		else
+		{
+			printHelp();
+			return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+		}
+	}
+
+	std::vector<Result> results;
+
+	for (Shape shape : opts.shapes)
+	{
+		for (bool seams : {false, true})
+		{
+			// Every soup triangle has its own points already
+			if (seams && shape == Shape::Soup)
+				continue;
+
+			for (unsigned frames : {0u, 24u})
+			{
+				std::vector<Result> smaller;
+
+				for (size_t tris = 1000; tris <= opts.maxTriangles; tris *= 10)
+				{
+					Result result;
+					const ModelSpec spec = {shape, tris, seams, frames};
+
+					std::cerr << shapeName(shape) << " " << tris << " triangles"
+						  << (seams ? ", seams" : "") << (frames ? ", animated" : "") << "..." << std::endl;
+					if (!runModel(spec, opts, smaller, result))
+						return 1;
+
+					smaller.push_back(result);
+					results.push_back(result);
+				}
+			}
+		}
+	}
+
+	if (opts.jsonFile)
+	{
+		std::ofstream out(opts.jsonFile);
+		if (!out.is_open())
+		{
+			std::cerr << "Could not open \"" << opts.jsonFile << "\" for writing." << std::endl;
+			return 1;
+		}
+		writeJson(out, opts, results);
+	}
+	else
+	{
+		writeJson(std::cout, opts, results);
+	}
+
+	return 0;
+}
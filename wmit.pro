@@ -5,7 +5,7 @@ QT = core gui opengl xml
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
-CONFIG += c++11
+CONFIG += c++17
 
 INCLUDEPATH += src src/basic src/formats src/ui src/widgets 3rdparty/GLEW/include 3rdparty/mikktspace
 
@@ -19,17 +19,24 @@ HEADERS += \
     src/ui/TextureDialog.h \
     src/Generic.h \
     src/Util.h \
+    src/BatchConvert.h \
+    src/CommandLine.h \
+    src/ModelIO.h \
     src/widgets/QtGLView.h \
     src/ui/ExportDialog.h \
     src/ui/ImportDialog.h \
     src/ui/MainWindow.h \
     src/ui/TexConfigDialog.h \
     src/ui/TransformDock.h \
+    src/ui/UiUtil.h \
     src/ui/UVEditor.h \
     src/formats/Mesh.h \
+    src/formats/ModelCache.h \
     src/formats/OBJ.h \
     src/formats/Pie.h \
     src/formats/Pie_t.hpp \
+    src/formats/TangentSpace.h \
+    src/formats/TextureCache.h \
     src/formats/WZM.h \
     src/basic/GLTexture.h \
     src/basic/IAnimatable.h \
@@ -38,10 +45,15 @@ HEADERS += \
     src/basic/IGLTextureManager.h \
     src/basic/Polygon.h \
     src/basic/Polygon_t.hpp \
+    src/basic/TextReader.h \
+    src/basic/TextWriter.h \
+    src/basic/VertexWelder.h \
     src/basic/Vector.h \
     src/basic/VectorTypes.h \
     src/basic/WZLight.h \
     src/widgets/QWZM.h \
+    src/widgets/AnimationPoses.h \
+    src/widgets/FrameTimings.h \
     src/ui/MaterialDock.h \
     src/ui/LightColorWidget.h \
     src/ui/LightColorDock.h \
@@ -53,18 +65,29 @@ SOURCES += \
     src/formats/WZM.cpp \
     src/formats/Pie.cpp \
     src/formats/Mesh.cpp \
+    src/formats/ModelCache.cpp \
+    src/formats/TangentSpace.cpp \
+    src/formats/TextureCache.cpp \
     src/ui/UVEditor.cpp \
     src/ui/TransformDock.cpp \
     src/ui/MainWindow.cpp \
     src/ui/ImportDialog.cpp \
     src/ui/ExportDialog.cpp \
+    src/ui/UiUtil.cpp \
     src/Util.cpp \
+    src/BatchConvert.cpp \
+    src/CommandLine.cpp \
+    src/ModelIO.cpp \
     src/main.cpp \
     src/Generic.cpp \
     src/basic/GLTexture.cpp \
     src/basic/WZLight.cpp \
+    src/basic/TextReader.cpp \
+    src/basic/TextWriter.cpp \
     src/ui/aboutdialog.cpp \
     src/widgets/QWZM.cpp \
+    src/widgets/AnimationPoses.cpp \
+    src/widgets/FrameTimings.cpp \
     src/widgets/QtGLView.cpp \
     src/ui/TextureDialog.cpp \
     src/ui/TexConfigDialog.cpp \